@@ -8,6 +8,7 @@
 //class Rift;
 #include "ConfigDB.h"
 #include "Rift.h"
+#include "ScriptedHmd.h"
 #include <sstream>
 #include <string.h>
 #include "OGRE/Ogre.h"
@@ -15,6 +16,13 @@
 #include "Scene.h"
 #include "Camera.h"
 #include "Globals.h"
+#include "Trace.h"
+#include "Histogram.h"
+#include "LatencyProbe.h"
+#include "QualityGovernor.h"
+#include "IdleWorkQueue.h"
+#include "FramePacer.h"
+#include "Simulation.h"
 
 
 // The Debug window's size is the Oculus Rift Resolution times this factor.
@@ -58,7 +66,17 @@ class App : public Ogre::FrameListener, public OIS::KeyListener, public OIS::Mou
 		void quitRift();
 
 		void initCameras();
+		SyntheticSource::Settings loadSyntheticSettings(const std::string& name);
+		ScriptedHmdDevice::Settings loadScriptedHmdSettings();
+		FaultInjectingSource::Settings loadFaultInjectionSettings();
 		void quitCameras();
+		void printCameraStats();
+		void applySimulationSnapshot();
+		void updateVideoTextures();
+		void updateVideoRegions();
+		void printTimingReport();
+		void writeTimingHistograms();
+		void writeBenchmarkReport(const double measuredSeconds);
 
 		bool keyPressed(const OIS::KeyEvent& e );
 		bool keyReleased(const OIS::KeyEvent& e );
@@ -92,6 +110,7 @@ class App : public Ogre::FrameListener, public OIS::KeyListener, public OIS::Mou
 			Right
 		} eyeSelected = Left;
 		bool seethroughEnabled = false;
+		bool seethroughPending = false;		// capture requested, waiting for both first frames (see frameRenderingQueued)
 		Scene::StabilizationModel stabilizationModel = Scene::StabilizationModel::Head;
 
 		OIS::Mouse* mMouse = nullptr;
@@ -110,6 +129,8 @@ class App : public Ogre::FrameListener, public OIS::KeyListener, public OIS::Mou
 		Ogre::RenderWindow* mRiftViewWindow = nullptr;
 		Ogre::RenderWindow* mDebugRiftViewWindow = nullptr;
 		Ogre::RenderWindow* mEnvironmentViewWindow = nullptr;
+		Ogre::RenderTexture* mRiftViewTexture = nullptr;		// benchmark: Rift output rendered offscreen instead of mRiftViewWindow
+		Ogre::RenderWindow* mContextWindow = nullptr;			// benchmark: hidden window, only holds the GL context
 		//Ogre::Viewport* mViewportL;
 		//Ogre::Viewport* mViewportR;
 
@@ -117,18 +138,71 @@ class App : public Ogre::FrameListener, public OIS::KeyListener, public OIS::Mou
 		bool mShutdown = false;
 		bool mPause = false;
 		std::chrono::steady_clock::time_point loopStart_time;
+
+		// Timing histograms: summarized every timingReportInterval seconds (0 = never), fully dumped at shutdown
+		int timingReportInterval = 5;
+		std::string timingHistogramsFile = "timing_histograms.txt";
+		// budgets: HMD frame budget (set once the refresh rate is known, see frameBudgetMs in the main loop)
+		TimingHistogram renderFrameTimes{ "render frame time", 1000.0 / FORCE_3D_RENDERING_FPS };
+		TimingHistogram uploadTimes{ "texture upload", 1000.0 / FORCE_3D_RENDERING_FPS };
+
+		// Render thread work done in the wait before the timewarp point (see Rift::setIdleWorkQueue())
+		IdleWorkQueue mIdleWork;
+
+		// Frame pacing (see [Pacing]): frames start at the vsync predicted by the SDK, at FORCE_3D_RENDERING_FPS
+		// (fixed rate limiter), or are not capped at all (VSync and the Oculus compositor pace them)
+		enum FramePacing
+		{
+			VsyncPacing,
+			FixedRate,
+			NoPacing
+		} framePacing = VsyncPacing;
+		bool vsync = true;
+		FramePacer::Settings pacerSettings;
+		FramePacer* mFramePacer = nullptr;
+
+		// Benchmark run (only with --benchmark)
+		unsigned int benchmarkFrames = 600;
+		unsigned int benchmarkWarmupFrames = 60;
+		std::string benchmarkReportFile = "benchmark_report.json";
+
+		// Eye render quality (see [Quality]): fixed at best level, or driven by the governor when adaptiveQuality is set
+		bool stereoCulling = false;				// cull once per frame for both eyes (see StereoCuller)
+		bool sharedEyeTexture = false;			// both eyes in one side-by-side texture (see Rift::setSharedEyeTexture())
+		std::string distortionMeshCache = "distortion_mesh_";	// file prefix of cached distortion meshes (empty = no cache)
+		bool reprojection = false;				// a frame over budget is followed by a reprojected one (see Rift::setReprojectionFrame())
+		bool lateLatch = false;					// eye view matrix sampled again right before drawing (see Rift::setLateLatch())
+		float lateLatchPadding = 2.0f;			// degrees the culling FOV is widened by, with late latch
+		bool distortionLookup = false;			// lookup textures instead of the distortion mesh (see Rift::setDistortionMode())
+		float distortionLookupScale = 0.5f;
+		bool adaptiveQuality = false;
+		QualityGovernor::Settings qualitySettings;
+		bool qualityBudgetSet = false;			// [Quality] BudgetMs given: kept, instead of the HMD frame budget
+		QualityGovernor* mQualityGovernor = nullptr;
 		Scene* mScene = nullptr;
 
 		Rift* mRift = nullptr;
 
+		LatencyProbe* mLatencyProbe = nullptr;		// only with --latency-probe
+
 		FrameCaptureHandler* mCameraLeft = nullptr;
 		FrameCaptureHandler* mCameraRight = nullptr;
-		Ogre::PixelBox mOgrePixelBoxLeft;	//Ogre containers for opencv Mat image raw data
-		Ogre::PixelBox mOgrePixelBoxRight;	//Ogre containers for opencv Mat image raw data
-		FrameCaptureData nextFrameLeft;
-		FrameCaptureData nextFrameRight;
-		bool imageLeftReady = false;
-		bool imageRightReady = false;
+		std::shared_ptr<StereoRectification> mStereoRectification;	// only with a stereo calibration (see [Camera] StereoCalibration)
+
+		// Camera frames, markers and scene logic (see [Simulation]): snapshots applied by the render thread
+		bool simulationThread = false;
+		double simulationTickRate = 120.0;
+		Simulation* mSimulation = nullptr;
+		unsigned long long appliedVideoId = 0;
+		unsigned long long appliedMarkersId = 0;
+		std::shared_ptr<const SimulationSnapshot> mVideoSnapshot;	// video pair applied, not uploaded yet
+		bool stereoDepthEnabled = false;
+		StereoDepth::Settings stereoDepthSettings;
+		StereoDepth* mStereoDepth = nullptr;
+		Scene::FisheyeLens fisheyeLens;		// see [Fisheye]
+		bool videoRegionOfInterest = true;		// see [Camera] RegionOfInterest
+		float videoRegionMargin = 0.05f;
+		unsigned int appliedVideoLayout = 0;	// Scene video layout the camera regions of interest were computed for
 };
 
 #endif
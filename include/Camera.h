@@ -5,14 +5,24 @@
 #include <aruco.h>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
 #include "Rift.h"
 #include "OVR.h"
 #include "OGRE/Ogre.h"
 #include "Globals.h"
+#include "Histogram.h"
+#include "CaptureSource.h"
+#include "SyntheticSource.h"
+#include "FaultInjectingSource.h"
+#include "HangRecoverySource.h"
+#include "StereoRectification.h"
 
 struct ImageCaptureData
 {
 	cv::Mat rgb;
+	cv::Rect roi;		// pixels of rgb that were processed (see setRegionOfInterest()), the rest is undefined
 	double orientation[4];
 };
 
@@ -25,6 +35,32 @@ struct ARCaptureData
 struct FrameCaptureData {
 	ImageCaptureData image;
 	std::vector<ARCaptureData> markers;
+
+	// Frame metadata. Timestamps are ovr_GetTimeInSeconds() values, 0 when not available.
+	unsigned long long id = 0;		// monotonically increasing per handler (assigned when published, first frame is 1)
+	double grabTime = 0;			// right before grab() was called
+	double retrieveTime = 0;		// right after retrieve() decoded the image
+	double publishTime = 0;			// when the frame was handed to the render thread
+	double poseTime = 0;			// time the image orientation refers to (0 = no pose, identity)
+};
+
+// Snapshot of FrameCaptureHandler counters (see getStats()).
+// Counters are cumulative since the last startCapture(), rates are averaged over the same period.
+struct FrameCaptureStats {
+	unsigned long long captured = 0;		// frames grabbed and decoded
+	unsigned long long published = 0;		// frames handed to the render thread
+	unsigned long long consumed = 0;		// frames taken by the render thread with get()
+	unsigned long long overwritten = 0;		// frames replaced by a newer one before being consumed
+	unsigned long long failed = 0;			// grab() calls that returned no frame
+	unsigned int reconnectAttempts = 0;
+	unsigned int reconnects = 0;
+	unsigned int stalls = 0;				// grab() calls found blocked by the stall watchdog (see checkStall())
+	double downtimeMs = 0;
+	double elapsedSeconds = 0;
+	double captureRate = 0;					// frames per second
+	double publishRate = 0;
+	double consumeRate = 0;
+	double dropRatio = 0;					// overwritten / published
 };
 
 class FrameCaptureHandler
@@ -38,14 +74,37 @@ class FrameCaptureHandler
 			Precise_auto
 		};
 
+		// Lifecycle of the capture thread. Device I/O (open, first read, release) happens on the
+		// capture thread only, so the render thread just requests a transition and polls the state.
+		//	Stopped		-> no thread running, device closed
+		//	Opening		-> thread spawned, device is being opened and first frame retrieved
+		//	Streaming	-> first frame published, capture loop running
+		//	Reconnecting-> device stopped delivering frames, it is being closed and reopened (with backoff)
+		//	Stopping	-> stop requested, thread is leaving the loop and releasing the device
+		//	Failed		-> device could not be opened (or first frame not retrieved), thread has exited
+		enum CaptureState
+		{
+			Stopped,
+			Opening,
+			Streaming,
+			Reconnecting,
+			Stopping,
+			Failed
+		};
+
 	private:
-		unsigned int deviceId = 0;
-		string filePath;
-		cv::VideoCapture videoCapture;
+		std::unique_ptr<CaptureSource> source;	// only replaced while no capture thread is running
+		std::shared_ptr<const FaultInjectingSource::Counters> injectedFaults;	// set while the source is wrapped (see setFaultInjection())
+		std::shared_ptr<const RemapTables> remapTables;	// undistortion (and rectification), same rule as source
+		// Toon filter page locked buffers (capture thread only). Published frames are headers on the output buffer, which
+		// does not own its memory: buffers outlive the capture thread, and the ones replaced on a frame size change are
+		// kept (sizes change a few times at most) since a published frame may still be read from them.
+		cv::gpu::CudaMem filterSourceBuffer, filterOutputBuffer;
+		std::vector<cv::gpu::CudaMem> retiredFilterBuffers;
 		std::thread captureThread;
 		std::mutex mutex;
 		FrameCaptureData frame;
-		float aspectRatio = 0;
+		std::atomic<float> aspectRatio{ 0 };
 		bool arEnabled = false;
 
 		static bool isInitialized;
@@ -53,10 +112,40 @@ class FrameCaptureHandler
 		static void initCuda();
 		static void shutdownCuda();
 
-		bool fromFile = false;
-		bool hasFrame = false;
-		bool stopped = true;
-		bool opening_failed = false;
+		std::atomic<bool> hasFrame{ false };
+		std::atomic<bool> stopped{ true };
+		std::atomic<CaptureState> state{ Stopped };
+		bool cudaAcquired = false;		// render thread only: CUDA user count is not thread-safe
+
+		// Failure detection and recovery (see reconnect()).
+		// Device is reopened after reconnectAfterFailures consecutive grab() failures, or when no frame
+		// was grabbed for reconnectTimeout. Reopening is retried with exponential backoff.
+		unsigned int reconnectAfterFailures = 10;
+		std::chrono::milliseconds reconnectTimeout = std::chrono::milliseconds(2000);
+		std::chrono::milliseconds reconnectInitialBackoff = std::chrono::milliseconds(100);
+		std::chrono::milliseconds reconnectMaxBackoff = std::chrono::milliseconds(3200);
+		std::atomic<unsigned int> reconnectAttempts{ 0 };		// every reopen tried
+		std::atomic<unsigned int> reconnectCount{ 0 };			// every reopen succeeded
+		std::atomic<unsigned long long> downtimeMicros{ 0 };	// total time spent Reconnecting
+		std::atomic<unsigned int> injectedGrabFailures{ 0 };	// fault injection: next grab()/open calls to fail
+		// Stall watchdog (see checkStall()): a grab() that never returns is not a failure the capture loop can see
+		std::atomic<double> grabStartTime{ 0 };		// ovr time the running grab() was called, 0 = not grabbing
+		double stalledGrabTime = 0;					// render thread only: grabStartTime already reported as stalled
+		std::atomic<unsigned int> stallCount{ 0 };
+
+		// Frame counters (see getStats()). Written by the capture thread, except framesConsumed (render thread).
+		std::atomic<unsigned long long> framesCaptured{ 0 };
+		std::atomic<unsigned long long> framesPublished{ 0 };
+		std::atomic<unsigned long long> framesConsumed{ 0 };
+		std::atomic<unsigned long long> framesOverwritten{ 0 };
+		std::atomic<unsigned long long> framesFailed{ 0 };
+		std::atomic<double> statsStartTime{ 0 };		// ovr time of the last startCapture()
+		unsigned long long lastFrameId = 0;				// guarded by mutex
+		TimingHistogram grabIntervals{ "capture interval", 0 };	// time between successful grabs (capture thread adds)
+		std::atomic<bool> stampFrames{ false };				// write frame id in published images (see LatencyProbe)
+		mutable std::mutex regionMutex;
+		cv::Rect_<float> regionOfInterest{ 0, 0, 1, 1 };	// guarded by regionMutex, share of the image (see setRegionOfInterest())
+		cv::Rect getRegionOfInterest(const cv::Size& imageSize) const;
 
 		// Explanation:
 		// Usually time between "frame is captured by camera" and "frame is returned by OpenCV grab()" is more than 0
@@ -65,34 +154,60 @@ class FrameCaptureHandler
 		// Usage:
 		// If OpenCV and your camera support timestamping, cameraCaptureRealDelayMs is automatically set.
 		// Otherwise cameraCaptureManualDelayMs is used and can be adjusted manually with adjustManualCaptureDelay()
-		double cameraCaptureRealDelayMs = 0;		// Automatically computed.
-		double cameraCaptureManualDelayMs = 0;		// Clamped between 0 and 50.
+		// Atomic: the capture thread reads/writes them while the render thread adjusts or resets them (see stopCapture()).
+		std::atomic<double> cameraCaptureRealDelayMs{ 0 };		// Automatically computed.
+		std::atomic<double> cameraCaptureManualDelayMs{ 0 };	// Clamped between 0 and 50.
 		short unsigned int fps;
 		std::chrono::steady_clock::time_point captureStart_time;
 
 		Rift* headset = nullptr;
-		ovrHmd hmd = nullptr;
+		HmdDevice* hmd = nullptr;		// owned by headset
 
-		CompensationMode currentCompensationMode = Precise_manual;
+		std::atomic<CompensationMode> currentCompensationMode{ Precise_manual };	// capture thread may degrade it (see captureLoop())
+
+		// Camera parameters come from the source if it knows them,
+		// otherwise from camera<calibrationId>_intrinsics.yml (calibrationId < 0: keep current ones)
+		void initSource(std::unique_ptr<CaptureSource> newSource, const int calibrationId);
+		void loadCalibration(const int calibrationId);
 
 		// Internal capture functions
-		void set(const FrameCaptureData & newFrame);
-		void captureLoop();
-		void fromFileLoop();
+		void set(const FrameCaptureData & newFrame);	// assigns id and publishTime
+		void resetStats();
+		void captureThreadMain();		// capture thread entry: open device, run the loop, release device
+		bool openDevice();				// opens the source and publishes the first frame (capture thread)
+		bool reconnect();				// closes and reopens the source with backoff (capture thread)
+		void captureLoop();				// one loop for every source: pacing and timestamping follow source capabilities
+		bool retrieveFrame(cv::Mat& out);	// source retrieve() converted to 8 bit BGR
 
 	public:
 
 		FrameCaptureHandler(const unsigned int 	input_device, 	Rift* const input_headset, const bool enable_AR = false,  const std::chrono::steady_clock::time_point syncStart_time = std::chrono::steady_clock::now(), const unsigned short int desiredFps = 30);
 		FrameCaptureHandler(const std::string& 	input_file, 	Rift* const input_headset, const bool enable_AR = false,  const std::chrono::steady_clock::time_point syncStart_time = std::chrono::steady_clock::now(), const unsigned short int desiredFps = 30);
-
-		// Spawn capture thread and return webcam aspect ratio (width over height)
-		float startCapture();
+		FrameCaptureHandler(const SyntheticSource::Settings& input_synthetic, Rift* const input_headset, const bool enable_AR = false, const std::chrono::steady_clock::time_point syncStart_time = std::chrono::steady_clock::now(), const unsigned short int desiredFps = 30);
+		// Any other source (i.e. ImageSequenceCaptureSource)
+		FrameCaptureHandler(std::unique_ptr<CaptureSource> input_source, Rift* const input_headset, const bool enable_AR = false, const std::chrono::steady_clock::time_point syncStart_time = std::chrono::steady_clock::now(), const unsigned short int desiredFps = 30);
+		~FrameCaptureHandler();
+
+		// Request capture to start. Returns immediately: the device is opened on the capture thread.
+		// Poll getState() to know when the first frame has arrived (Streaming) or opening has Failed.
+		// Returns false if a previous capture is still Stopping (request it again later).
+		bool startCapture();
+		// Request capture to stop. Returns immediately: the device is released on the capture thread.
 		void stopCapture();
+		CaptureState getState() const { return state; }
 
 		// Get data
 		bool hasNewFrame();
 		bool get(FrameCaptureData & out);
-		float getAspectRatio(){ return aspectRatio; }
+		float getAspectRatio(){ return aspectRatio; }		// valid once state is Streaming
+		// Counters, rates and drop ratio. Lock-free: can be called from any thread, at any time.
+		FrameCaptureStats getStats() const;
+		TimingHistogram& getGrabIntervals() { return grabIntervals; }
+		void setFrameStamping(const bool enable){ stampFrames = enable; }
+		// Part of the image that is shown (share of width and height, i.e. see Scene::getVisibleVideoRegion()).
+		// Undistortion, filters and marker detection only process it, published frames tell it in image.roi.
+		// Any thread, takes effect from the next frame. Whole image by default.
+		void setRegionOfInterest(const cv::Rect_<float>& region);
 		//void getCameraParameters(aruco::CameraParameters& outParameters);
 		//void getCameraParametersUndistorted(aruco::CameraParameters& outParameters);
 		aruco::CameraParameters videoCaptureParams, videoCaptureParamsUndistorted;	// only dependency from aruco. Remove them?
@@ -104,8 +219,29 @@ class FrameCaptureHandler
 		double adjustManualCaptureDelay(const short int adjustValue);
 
 		void setCompensationMode(const CompensationMode newMode){ currentCompensationMode = newMode; }
-		bool setCaptureSource(const unsigned int newDeviceId);		// sets fromFile to false and the new deviceId. Capture must be stopped in order to take effect! Returns false otherwise!
-		bool setCaptureSource(const std::string& newFilePath);			// sets fromFile to true and filePath. Capture must be stopped in order to take effect! Returns false otherwise!
+		// Consecutive grab() failures and time without frames after which the device is reopened (0 keeps current value)
+		void setReconnectPolicy(const unsigned int maxConsecutiveFailures, const unsigned int timeoutMs);
+		unsigned int getReconnectAttempts() const { return reconnectAttempts; }
+		unsigned int getReconnectCount() const { return reconnectCount; }
+		double getDowntimeMs() const { return downtimeMicros / 1000.0; }
+		// Fault injection: make the next 'count' grab() (and reopen) calls fail, as an unplugged device would
+		void injectGrabFailures(const unsigned int count){ injectedGrabFailures = count; }
+		// Fault injection: wraps the current source in a FaultInjectingSource (dropouts and hangs on a schedule), and that
+		// in a HangRecoverySource if its hangs are device-like. Capture must be stopped, returns false otherwise.
+		bool setFaultInjection(const FaultInjectingSource::Settings& faults);
+		const FaultInjectingSource::Counters* getInjectedFaults() const { return injectedFaults.get(); }
+		// Stall watchdog, call it regularly from another thread (render thread): true while a grab() has been blocked
+		// for longer than the reconnect timeout. The source is then interrupted (if it can be), so that the capture
+		// loop sees a failed grab and reconnects; a device that can not be interrupted is reported until it returns.
+		bool checkStall();
+		bool setCaptureSource(const unsigned int newDeviceId);		// switches to device newDeviceId. Capture must be stopped in order to take effect! Returns false otherwise!
+		bool setCaptureSource(const std::string& newFilePath);			// switches to file newFilePath. Capture must be stopped in order to take effect! Returns false otherwise!
+		bool setCaptureSource(const SyntheticSource::Settings& newSettings);	// switches to a synthetic source (camera parameters from its intrinsics). Same rules as above.
+		bool setCaptureSource(std::unique_ptr<CaptureSource> newSource);	// switches to newSource. Same rules as above.
+		std::string getSourceName() const { return source->getName(); }
+		// Replaces undistortion with joint undistortion and rectification (see StereoRectification), in one remap.
+		// Marker detection then uses rectifiedParameters. Capture must be stopped, returns false otherwise.
+		bool setRectification(const std::shared_ptr<const RemapTables>& tables, const aruco::CameraParameters& rectifiedParameters);
 
 };
 
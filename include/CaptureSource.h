@@ -0,0 +1,124 @@
+#ifndef CAPTURESOURCE_H
+#define CAPTURESOURCE_H
+
+// Where FrameCaptureHandler takes its frames from.
+// A source only knows how to open, grab and decode frames: pacing, pose compensation, AR, statistics and
+// failure recovery (release and reopen) are done once in FrameCaptureHandler::captureLoop(), driven by the source Capabilities.
+// All calls but getCapabilities()/getName()/getFps()/interrupt() are made from the capture thread only.
+// A source whose grab() can block for good and can not be interrupted (devices) is wrapped in a HangRecoverySource.
+
+#include <memory>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include <aruco.h>
+
+class CaptureSource
+{
+	public:
+		struct Capabilities
+		{
+			bool selfPaced = false;			// grab() blocks until the next frame is due (devices): the loop never sleeps
+			bool liveCapture = false;		// frames are taken right now: head pose at grab time applies to them
+			bool deviceTimestamps = false;	// timestamp() returns when the frame was captured (Precise_auto usable)
+			bool finite = false;			// stream ends (files): rewind() is tried when grab() fails
+		};
+
+		virtual ~CaptureSource() {}
+
+		virtual bool open() = 0;
+		virtual bool isOpened() const = 0;
+		virtual void release() = 0;
+		virtual bool grab() = 0;						// takes a frame without decoding it
+		virtual bool retrieve(cv::Mat& out) = 0;		// decodes the grabbed frame into out (reallocated only if needed)
+		virtual double timestamp() { return -1; }		// device capture time of the grabbed frame in ms, -1 if unknown
+		virtual bool rewind() { return false; }			// back to the first frame (finite sources)
+		// Makes a grab() blocked in the source return false as soon as possible (no-op if the source can not tell).
+		// The only call allowed from another thread (see FrameCaptureHandler::checkStall()).
+		virtual void interrupt() {}
+		// New source, not opened, for the same input: replaces one stuck in grab() (see HangRecoverySource). nullptr if not possible.
+		virtual std::unique_ptr<CaptureSource> createFresh() const { return nullptr; }
+
+		virtual Capabilities getCapabilities() const = 0;
+		virtual std::string getName() const = 0;
+		virtual double getFps() const { return 0; }		// nominal frame rate, 0 if unknown
+		// Intrinsics known by the source itself (i.e. simulated lens). Returns false if a calibration file is needed.
+		virtual bool getCameraParameters(aruco::CameraParameters& out) const { return false; }
+};
+
+// Camera device through cv::VideoCapture (resolution forced to FORCE_WIDTH/HEIGHT_RESOLUTION)
+class DeviceCaptureSource : public CaptureSource
+{
+	public:
+		DeviceCaptureSource(const unsigned int input_device, const double desiredFps = 30) : deviceId(input_device), fps(desiredFps) {}
+
+		virtual bool open();
+		virtual bool isOpened() const { return videoCapture.isOpened(); }
+		virtual void release() { videoCapture.release(); }
+		virtual bool grab() { return videoCapture.grab(); }
+		virtual bool retrieve(cv::Mat& out) { return videoCapture.retrieve(out); }
+		virtual double timestamp() { return videoCapture.get(CV_CAP_PROP_POS_MSEC); }
+		virtual std::unique_ptr<CaptureSource> createFresh() const { return std::unique_ptr<CaptureSource>(new DeviceCaptureSource(deviceId, fps)); }
+
+		virtual Capabilities getCapabilities() const;
+		virtual std::string getName() const { return "camera " + std::to_string(deviceId); }
+		virtual double getFps() const { return fps; }
+		unsigned int getDeviceId() const { return deviceId; }
+
+	private:
+		unsigned int deviceId;
+		double fps;
+		cv::VideoCapture videoCapture;
+};
+
+// Video file through cv::VideoCapture, played at the handler rate and looped at its end
+class FileCaptureSource : public CaptureSource
+{
+	public:
+		FileCaptureSource(const std::string& input_file) : filePath(input_file) {}
+
+		virtual bool open();
+		virtual bool isOpened() const { return videoCapture.isOpened(); }
+		virtual void release() { videoCapture.release(); }
+		virtual bool grab() { return videoCapture.grab(); }
+		virtual bool retrieve(cv::Mat& out) { return videoCapture.retrieve(out); }
+		virtual bool rewind() { return videoCapture.set(CV_CAP_PROP_POS_FRAMES, 0) && videoCapture.grab(); }
+		virtual std::unique_ptr<CaptureSource> createFresh() const { return std::unique_ptr<CaptureSource>(new FileCaptureSource(filePath)); }
+
+		virtual Capabilities getCapabilities() const;
+		virtual std::string getName() const { return filePath; }
+		virtual double getFps() const { return fps; }
+
+	private:
+		std::string filePath;
+		double fps = 0;				// as encoded in the file, read on open()
+		cv::VideoCapture videoCapture;
+};
+
+// Numbered images (printf-like pattern, i.e. "frames/left_%04d.png"), played at the handler rate and looped at the end
+class ImageSequenceCaptureSource : public CaptureSource
+{
+	public:
+		ImageSequenceCaptureSource(const std::string& input_pattern, const unsigned int input_firstIndex = 0) : pattern(input_pattern), firstIndex(input_firstIndex) {}
+
+		virtual bool open();
+		virtual bool isOpened() const { return opened; }
+		virtual void release() { opened = false; grabbed.release(); }
+		virtual bool grab();
+		virtual bool retrieve(cv::Mat& out);
+		virtual bool rewind();
+		virtual std::unique_ptr<CaptureSource> createFresh() const { return std::unique_ptr<CaptureSource>(new ImageSequenceCaptureSource(pattern, firstIndex)); }
+
+		virtual Capabilities getCapabilities() const;
+		virtual std::string getName() const { return pattern; }
+
+	private:
+		std::string fileName(const unsigned int index) const;
+
+		std::string pattern;
+		unsigned int firstIndex;
+		unsigned int nextIndex = 0;
+		bool opened = false;
+		cv::Mat grabbed;			// images are decoded by grab(): imread has no separate decode step
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef DISTORTIONMESH_H
+#define DISTORTIONMESH_H
+
+// Distortion meshes of the Rift inner scene (see Rift::createRiftDisplayScene()).
+//	- DistortionMeshCache: SDK meshes stored on disk, so that startup does not generate them again.
+//	  Files are keyed by everything the SDK mesh depends on that the application can see: HMD product/type/resolution,
+//	  eye, FOV, distortion caps and the render desc computed from the user profile (eye relief changes it).
+//	- createPackedDistortionMesh(): static Ogre mesh with one interleaved vertex buffer and 16-bit indices:
+//		position	float2		(NDC)
+//		uv0..uv2	short2		tan eye angles R/G/B, quantized (shader multiplies by tanEyeAngleScale)
+//		colour		packed		vignette (rgb), timewarp factor (a)
+//	  24 bytes per vertex instead of 40 of the ManualObject it replaces.
+//	- bakeDistortionLookup(): the mesh rasterized once into lookup textures, drawn as one quad per eye
+//	  (see Rift::setDistortionMode()).
+
+#include <string>
+#include "OGRE/Ogre.h"
+#include "Hmd.h"
+
+class DistortionMeshCache
+{
+	public:
+		// filePrefix: path and file name start of the cache files (empty = cache disabled)
+		DistortionMeshCache(const std::string& filePrefix) : prefix(filePrefix) {}
+
+		static std::string makeKey(const HmdDevice& hmd, const int eye, const ovrEyeRenderDesc& renderDesc, const unsigned int distortionCaps);
+
+		// Returns false if disabled, missing, written for another key or unreadable (out is left empty)
+		bool load(const std::string& key, HmdDistortionMesh& out) const;
+		// Failing to write is not an error (next startup generates the mesh again)
+		void save(const std::string& key, const HmdDistortionMesh& mesh) const;
+
+		bool isEnabled() const { return !prefix.empty(); }
+
+	private:
+		std::string getFileName(const std::string& key) const;
+		std::string prefix;
+};
+
+// Bytes per vertex of the packed mesh, and of the ManualObject layout used before (float3, 3 x float2, colour)
+const size_t PackedDistortionVertexSize = 2 * sizeof(float) + 3 * 2 * sizeof(short) + sizeof(Ogre::RGBA);
+const size_t ManualDistortionVertexSize = 3 * sizeof(float) + 3 * 2 * sizeof(float) + sizeof(Ogre::RGBA);
+
+// Throws Ogre::Exception if the mesh has more vertices than 16-bit indices can address.
+// tanEyeAngleScale: value for the shader constant of the same name (dequantizes uv0..uv2)
+Ogre::MeshPtr createPackedDistortionMesh(const std::string& name, const HmdDistortionMesh& meshData, const std::string& materialName, float& tanEyeAngleScale);
+
+// Rasterizes meshData into two PF_FLOAT16_RGBA textures of width x height covering the NDC bounds of the mesh:
+//	lookup[0]	tan eye angles R (rg), G (ba)
+//	lookup[1]	tan eye angles B (rg), vignette (b), timewarp factor (a)
+// Texels outside the mesh have vignette 0 (black). ndcBounds: left, bottom, right, top of the area covered.
+void bakeDistortionLookup(const std::string& name, const HmdDistortionMesh& meshData, const unsigned int width, const unsigned int height, Ogre::TexturePtr lookup[2], Ogre::Vector4& ndcBounds);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef FAULTINJECTINGSOURCE_H
+#define FAULTINJECTINGSOURCE_H
+
+// Wraps any CaptureSource and makes it misbehave like a flaky USB camera, so that FrameCaptureHandler failure
+// detection and recovery can be exercised on purpose (see --fault-injection and [FaultInjection] in parameters.cfg):
+//	- dropouts: every dropoutInterval, grab() fails dropoutFrames times in a row, then the next failedReopens open() fail
+//	- hangs: every hangInterval, grab() blocks for hangSeconds (or until interrupt(), see the handler stall watchdog).
+//	  With hangsLikeDevice, interrupt() is ignored as a device driver would: the handler wraps the source in a
+//	  HangRecoverySource, which has to abandon it and reopen a fresh one (createFresh()) to recover.
+// Timers restart on every open(). Counters are atomic, shared by fresh sources, and can be read from any thread.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include "CaptureSource.h"
+
+class FaultInjectingSource : public CaptureSource
+{
+	public:
+		struct Settings
+		{
+			double dropoutIntervalSeconds = 0;		// 0 = no dropouts
+			unsigned int dropoutFrames = 15;
+			unsigned int failedReopens = 2;			// after each dropout
+			double hangIntervalSeconds = 0;			// 0 = no hangs
+			double hangSeconds = 3;
+			bool hangsLikeDevice = false;			// hangs can not be interrupted
+		};
+
+		struct Counters
+		{
+			std::atomic<unsigned int> dropouts{ 0 };
+			std::atomic<unsigned int> hangs{ 0 };
+			std::atomic<unsigned int> failedOpens{ 0 };
+		};
+
+		FaultInjectingSource(std::unique_ptr<CaptureSource> wrappedSource, const Settings& faultSettings, std::shared_ptr<Counters> faultCounters = std::make_shared<Counters>())
+			: inner(std::move(wrappedSource)), settings(faultSettings), counters(faultCounters) {}
+
+		virtual bool open();
+		virtual bool isOpened() const { return inner->isOpened(); }
+		virtual void release() { inner->release(); }
+		virtual bool grab();
+		virtual bool retrieve(cv::Mat& out) { return inner->retrieve(out); }
+		virtual double timestamp() { return inner->timestamp(); }
+		virtual bool rewind() { return inner->rewind(); }
+		virtual void interrupt();
+		virtual std::unique_ptr<CaptureSource> createFresh() const;
+
+		virtual Capabilities getCapabilities() const { return inner->getCapabilities(); }
+		virtual std::string getName() const { return inner->getName(); }
+		virtual double getFps() const { return inner->getFps(); }
+		virtual bool getCameraParameters(aruco::CameraParameters& out) const { return inner->getCameraParameters(out); }
+
+		const Settings& getSettings() const { return settings; }
+		std::shared_ptr<const Counters> getCounters() const { return counters; }
+
+	private:
+		std::unique_ptr<CaptureSource> inner;
+		Settings settings;
+		std::shared_ptr<Counters> counters;
+
+		// capture thread only
+		std::chrono::steady_clock::time_point nextDropout_time;
+		std::chrono::steady_clock::time_point nextHang_time;
+		unsigned int pendingDropoutFrames = 0;
+		unsigned int pendingFailedOpens = 0;
+
+		// hang wait, ended early by interrupt() (any thread)
+		std::mutex mutex;
+		std::condition_variable interrupted;
+		bool hanging = false;					// guarded by mutex
+		bool interruptRequested = false;		// guarded by mutex, only set while hanging
+};
+
+#endif
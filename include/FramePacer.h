@@ -0,0 +1,41 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+// Paces the render loop on the HMD display refresh (see [Pacing]).
+// A frame starts at the vsync the SDK predicted for the previous frame (ovrFrameTiming::NextFrameSeconds), so that
+// it has whole refresh periods to render before its own vsync and the start is always at the same phase of the
+// display, whatever the refresh rate (DK1 60 Hz, DK2 75 Hz).
+// Waiting is a coarse sleep up to shortly before the start, then a spin for the rest: sleep wakes up late by a
+// varying amount (scheduler granularity), so the sleep stops early by the wakeup error measured on the last sleeps
+// plus spinMs. A frame already late starts right away.
+
+#include "Histogram.h"
+
+class FramePacer
+{
+	public:
+		struct Settings
+		{
+			double refreshRate = 75.0;			// Hz (HmdDevice::getRefreshRate())
+			unsigned int vsyncInterval = 1;		// display refreshes per frame (2: half rate)
+			double spinMs = 0.3;				// minimum spin before the frame start
+			double startOffsetMs = 0;			// frame start after the vsync
+		};
+
+		FramePacer(const Settings& pacerSettings);
+
+		// Waits for the start of the next frame. predictedVsync: vsync of the frame just rendered (ovr_GetTimeInSeconds clock)
+		void waitForFrameStart(const double predictedVsync);
+
+		double getFramePeriodMs() const { return 1000.0 * settings.vsyncInterval / settings.refreshRate; }
+		// how late frames started (~0 when paced, the overrun when the frame was late already)
+		TimingHistogram& getStartErrors() { return startErrors; }
+		double getSleepMarginMs() const { return oversleepMs + settings.spinMs; }
+
+	private:
+		Settings settings;
+		double oversleepMs = 1.0;			// expected lateness of a sleep wakeup (adapted to each sleep)
+		TimingHistogram startErrors{ "frame start error", 0 };
+};
+
+#endif
@@ -14,6 +14,11 @@ extern unsigned short int CAMERA_BUFFERING_DELAY;
 extern int CAMERA_TOEIN_ANGLE;
 extern int CAMERA_KEYSTONING_ANGLE;
 extern bool undistort, toon;
+extern bool LATENCY_PROBE;
+extern bool SYNTHETIC_SOURCE;
+extern bool SCRIPTED_HMD;
+extern bool FAULT_INJECTION;
+extern bool BENCHMARK;
 //Globals used from Camera.cpp and App.cpp
 extern std::chrono::steady_clock::time_point camera_last_frame_request_time;
 extern std::chrono::duration< int, std::milli > camera_last_frame_display_delay;
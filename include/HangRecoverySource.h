@@ -0,0 +1,70 @@
+#ifndef HANGRECOVERYSOURCE_H
+#define HANGRECOVERYSOURCE_H
+
+// Wraps a source whose grab() may block for good (i.e. a cv::VideoCapture device whose driver stopped delivering:
+// grab() can not be interrupted, nor the capture released while it runs) so that FrameCaptureHandler can recover it.
+// grab() runs on a worker thread of the wrapped source and the capture thread waits for it. interrupt() (stall
+// watchdog, see FrameCaptureHandler::checkStall()) abandons a running grab(): the capture thread gets false at once,
+// the stuck source is left to its worker (released there whenever its grab() returns) and the next open() (handler
+// reconnection) starts over with a fresh source for the same input (CaptureSource::createFresh()).
+// Costs one thread handoff per grab.
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include "CaptureSource.h"
+
+class HangRecoverySource : public CaptureSource
+{
+	public:
+		HangRecoverySource(std::unique_ptr<CaptureSource> wrappedSource);
+		~HangRecoverySource();
+
+		virtual bool open();
+		virtual bool isOpened() const;
+		virtual void release();
+		virtual bool grab();
+		virtual bool retrieve(cv::Mat& out) { return worker->source->retrieve(out); }
+		virtual double timestamp() { return worker->source->timestamp(); }
+		virtual bool rewind() { return worker->source->rewind(); }
+		virtual void interrupt();
+		virtual std::unique_ptr<CaptureSource> createFresh() const;
+
+		virtual Capabilities getCapabilities() const { return capabilities; }
+		virtual std::string getName() const { return name; }
+		virtual double getFps() const { return fps; }
+		virtual bool getCameraParameters(aruco::CameraParameters& out) const { return worker->source->getCameraParameters(out); }
+
+		unsigned int getAbandonedGrabs() const { return abandonedGrabs; }
+
+	private:
+		// Wrapped source and its grab thread, shared with that thread (outlives this object if abandoned)
+		struct Worker
+		{
+			std::unique_ptr<CaptureSource> source;
+			std::mutex mutex;
+			std::condition_variable changed;
+			bool grabRequested = false;		// all guarded by mutex
+			bool grabbing = false;			// requested and not returned yet
+			bool grabResult = false;
+			bool abandoned = false;			// given up by interrupt(): the thread releases the source and exits
+			bool stopRequested = false;
+		};
+		static void workerMain(std::shared_ptr<Worker> worker);
+		void startWorker(std::unique_ptr<CaptureSource> source);
+		bool isAbandoned() const;
+
+		// Replaced by open() (capture thread) only after an abandon; interrupt() reads it under workerMutex
+		std::shared_ptr<Worker> worker;
+		mutable std::mutex workerMutex;
+		std::unique_ptr<CaptureSource> spare;	// fresh source for the next recovery, made while the current one is idle
+
+		// same for every fresh source: readable from any thread
+		Capabilities capabilities;
+		std::string name;
+		std::atomic<double> fps{ 0 };
+		std::atomic<unsigned int> abandonedGrabs{ 0 };
+};
+
+#endif
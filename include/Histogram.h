@@ -0,0 +1,57 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+// Fixed-bucket histogram of durations (milliseconds).
+// No allocation after construction, add() is lock-free and can be called from any thread
+// (i.e. capture thread adds while render thread reports). Percentiles are resolved to bucket width.
+
+#include <atomic>
+#include <ostream>
+#include <string>
+
+class Histogram
+{
+	public:
+		static const unsigned int BucketCount = 1000;	// last bucket collects everything above range
+
+		Histogram(const double bucketWidthMs = 0.1);	// default range: 0-100ms, 0.1ms resolution
+
+		void add(const double ms);
+		void reset();									// not atomic as a whole: concurrent adds may be lost
+
+		unsigned long long getCount() const;
+		double getMax() const { return maxMs; }
+		double getPercentile(const double p) const;		// p in [0,1], upper bound of the bucket holding it
+		unsigned long long getCountAbove(const double ms) const;	// resolved to bucket width
+
+		// One line: count, p50/p90/p99/max and samples over budget
+		void printSummary(std::ostream& out, const std::string& name, const double budgetMs) const;
+		// Every non-empty bucket as "lowerBoundMs<TAB>count" lines, preceded by a header and the summary
+		void write(std::ostream& out, const std::string& name, const double budgetMs) const;
+
+	private:
+		Histogram(const Histogram&);
+		Histogram& operator=(const Histogram&);
+
+		const double bucketWidthMs;
+		std::atomic<unsigned long long> buckets[BucketCount];
+		std::atomic<double> maxMs;
+};
+
+// A timing measure reported periodically (interval histogram, reset at each report)
+// and summarized at shutdown (total histogram, never reset).
+struct TimingHistogram
+{
+	std::string name;
+	double budgetMs;			// samples above this are counted as over budget (i.e. vsync period)
+	Histogram interval;
+	Histogram total;
+
+	TimingHistogram(const std::string& timingName, const double timingBudgetMs) : name(timingName), budgetMs(timingBudgetMs) {}
+	void add(const double ms) { interval.add(ms); total.add(ms); }
+	void report(std::ostream& out) { out << "\t"; interval.printSummary(out, name, budgetMs); interval.reset(); }
+	void write(std::ostream& out) const { total.write(out, name, budgetMs); }
+	void reset() { interval.reset(); total.reset(); }	// i.e. drop warm-up samples
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef HMD_H
+#define HMD_H
+
+// Head mounted display backend used by Rift (rendering setup, frame timing) and FrameCaptureHandler (head poses).
+// OVR C API structs are used as plain data types so that every backend speaks the same language as the SDK,
+// but only OvrHmdDevice calls into LibOVR:
+//	- OvrHmdDevice:			Oculus SDK 0.5 (physical Rift, or SDK debug DK2 if none is connected)
+//	- ScriptedHmdDevice:	no runtime needed, replays poses (see ScriptedHmd.h)
+// Tracking functions can be called from any thread, the rest from the render thread only.
+
+#include <string>
+#include <vector>
+#include "OVR.h"
+
+// Distortion mesh owned by the application (SDK mesh is copied and released right away)
+struct HmdDistortionMesh
+{
+	std::vector<ovrDistortionVertex> vertices;
+	std::vector<unsigned short> indices;
+};
+
+class HmdDevice
+{
+	public:
+		virtual ~HmdDevice() {}
+
+		// Description
+		virtual std::string getProductName() const = 0;
+		virtual ovrHmdType getType() const = 0;				// decides window layout (DK1 landscape, DK2 portrait)
+		virtual bool isSimulated() const = 0;				// true: no headset, output is shown in a window on the main screen
+		virtual ovrSizei getResolution() const = 0;
+		virtual ovrFovPort getDefaultEyeFov(const int eye) const = 0;
+		virtual ovrEyeType getEyeRenderOrder(const int index) const { return (ovrEyeType)index; }
+		virtual float getIPD() const = 0;					// meters
+		virtual double getRefreshRate() const = 0;			// Hz
+
+		// Rendering setup
+		virtual ovrSizei getFovTextureSize(const int eye, const ovrFovPort& fov) const = 0;
+		virtual ovrEyeRenderDesc getRenderDesc(const int eye, const ovrFovPort& fov) const = 0;
+		virtual void createDistortionMesh(const ovrEyeRenderDesc& renderDesc, const unsigned int distortionCaps, HmdDistortionMesh& out) const = 0;
+		virtual void getRenderScaleAndOffset(const ovrFovPort& fov, const ovrSizei& textureSize, const ovrRecti& viewport, ovrVector2f uvScaleOffset[2]) const;
+		virtual ovrMatrix4f getProjection(const ovrFovPort& fov, const float znear, const float zfar) const;	// right handed
+
+		// Tracking (thread safe)
+		virtual ovrTrackingState getTrackingState(const double absTime) = 0;			// absTime is now or in the future (prediction)
+		virtual ovrTrackingState getTrackingStateExtended(const double absTime) = 0;	// absTime can be in the past, too
+		virtual void getEyePoses(const unsigned int frameIndex, const ovrVector3f hmdToEyeViewOffset[2], ovrPosef outEyePoses[2], ovrTrackingState* outTrackingState) = 0;
+		virtual void recenterPose() = 0;
+
+		// Frame timing (render thread)
+		virtual ovrFrameTiming beginFrameTiming(const unsigned int frameIndex) = 0;
+		virtual void waitTillTime(const double absTime) = 0;
+		virtual void getEyeTimewarpMatrices(const int eye, const ovrPosef& renderPose, ovrMatrix4f twmOut[2]) = 0;
+		virtual void endFrameTiming() = 0;
+};
+
+// Oculus SDK 0.5 backend
+class OvrHmdDevice : public HmdDevice
+{
+	public:
+		// Returns nullptr if LibOVR could not be initialized or neither a Rift nor a debug DK2 could be created.
+		// Throws std::ios_base::failure if the connected Rift does not support the tracking features needed.
+		static OvrHmdDevice* create(const unsigned int ID);
+		~OvrHmdDevice();
+
+		virtual std::string getProductName() const { return hmd->ProductName; }
+		virtual ovrHmdType getType() const { return hmd->Type; }
+		virtual bool isSimulated() const { return simulated; }
+		virtual ovrSizei getResolution() const { return hmd->Resolution; }
+		virtual ovrFovPort getDefaultEyeFov(const int eye) const { return hmd->DefaultEyeFov[eye]; }
+		virtual ovrEyeType getEyeRenderOrder(const int index) const { return hmd->EyeRenderOrder[index]; }
+		virtual float getIPD() const { return ovrHmd_GetFloat(hmd, OVR_KEY_IPD, 0.064f); }
+		virtual double getRefreshRate() const;
+
+		virtual ovrSizei getFovTextureSize(const int eye, const ovrFovPort& fov) const { return ovrHmd_GetFovTextureSize(hmd, (ovrEyeType)eye, fov, 1.0f); }
+		virtual ovrEyeRenderDesc getRenderDesc(const int eye, const ovrFovPort& fov) const { return ovrHmd_GetRenderDesc(hmd, (ovrEyeType)eye, fov); }
+		virtual void createDistortionMesh(const ovrEyeRenderDesc& renderDesc, const unsigned int distortionCaps, HmdDistortionMesh& out) const;
+		virtual void getRenderScaleAndOffset(const ovrFovPort& fov, const ovrSizei& textureSize, const ovrRecti& viewport, ovrVector2f uvScaleOffset[2]) const;
+		virtual ovrMatrix4f getProjection(const ovrFovPort& fov, const float znear, const float zfar) const { return ovrMatrix4f_Projection(fov, znear, zfar, true); }
+
+		virtual ovrTrackingState getTrackingState(const double absTime) { return ovrHmd_GetTrackingState(hmd, absTime); }
+		// Version of OCULUSSDK included in this project has been tweaked to "PREDICT IN THE PAST"
+		virtual ovrTrackingState getTrackingStateExtended(const double absTime) { return ovrHmd_GetTrackingStateExtended(hmd, absTime); }
+		virtual void getEyePoses(const unsigned int frameIndex, const ovrVector3f hmdToEyeViewOffset[2], ovrPosef outEyePoses[2], ovrTrackingState* outTrackingState);
+		virtual void recenterPose() { ovrHmd_RecenterPose(hmd); }
+
+		virtual ovrFrameTiming beginFrameTiming(const unsigned int frameIndex) { return ovrHmd_BeginFrameTiming(hmd, frameIndex); }
+		virtual void waitTillTime(const double absTime) { ovr_WaitTillTime(absTime); }
+		virtual void getEyeTimewarpMatrices(const int eye, const ovrPosef& renderPose, ovrMatrix4f twmOut[2]) { ovrHmd_GetEyeTimewarpMatrices(hmd, (ovrEyeType)eye, renderPose, twmOut); }
+		virtual void endFrameTiming() { ovrHmd_EndFrameTiming(hmd); }
+
+	private:
+		OvrHmdDevice(ovrHmd handle, const bool isDebugDevice) : hmd(handle), simulated(isDebugDevice) {}
+
+		// LibOVR is initialized by the first device created and shut down with the last one
+		static bool isInitialized;
+		static unsigned short int ovr_Users;
+		static bool init();
+		static void shutdown();
+
+		ovrHmd hmd = nullptr;
+		bool simulated = false;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef IDLEWORKQUEUE_H
+#define IDLEWORKQUEUE_H
+
+// Render thread work that can run in the idle time before the timewarp point (see Rift, phase 4).
+// Jobs are posted during the frame, each with the time it is expected to take: while waiting for the timewarp
+// point, jobs are run in posting order as long as the next one fits before the deadline (a job is never split,
+// and never started if it would delay the timewarp). What is left is run by flush() at the place the work was
+// done before (App::frameRenderingQueued), so a job waits at most until the end of the frame it was posted in.
+// Render thread only. Jobs run in the middle of the Rift render target update, after the eye passes: they must not
+// change render targets or the distortion materials (eye textures, video textures and the scene are free to change).
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include "Histogram.h"
+
+class IdleWorkQueue
+{
+	public:
+		typedef std::function<void()> Job;
+
+		// name: string literal (trace event name), estimatedMs: cost declared by the poster (i.e. from a timing histogram of the same work)
+		void post(const char* name, const double estimatedMs, const Job& job);
+		// Runs jobs while they fit before the deadline, returns the time spent
+		double drainUntil(const std::chrono::steady_clock::time_point deadline);
+		// Runs all remaining jobs
+		void flush();
+
+		bool empty() const { return jobs.empty(); }
+
+		// jobs run in idle time / run by flush(), and idle time put to use
+		unsigned long long getIdleJobs() const { return idleJobs; }
+		unsigned long long getFlushedJobs() const { return flushedJobs; }
+		TimingHistogram& getIdleWorkTimes() { return idleWorkTimes; }
+
+	private:
+		struct PendingJob
+		{
+			const char* name;
+			double estimatedMs;
+			Job job;
+		};
+		void run(PendingJob& pending);
+
+		std::deque<PendingJob> jobs;
+		unsigned long long idleJobs = 0;
+		unsigned long long flushedJobs = 0;
+		TimingHistogram idleWorkTimes{ "idle work", 0 };
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef LATENCYPROBE_H
+#define LATENCYPROBE_H
+
+// Measures video latency on the real pipeline, from pixels.
+// The capture thread stamps a code in the middle of each frame (4x4 grid of black/white cells: 12 bits
+// of frame id + 4 bits of check). The probe reads back the left eye texture after it is rendered, finds
+// the cells by projecting their centres through the video plane (Scene::projectVideoImagePoint) and decodes
+// which frame is actually displayed. Grab time of that frame then gives:
+//	- grab to texture:	grab() call -> frame uploaded to the video texture (render thread)
+//	- grab to present:	grab() call -> first buffer swap showing it (pixels decoded from the eye texture)
+// Reading back the eye texture stalls the GPU, so absolute values are slightly pessimistic: use them to
+// compare builds/configurations, not as the latency users perceive. Pinhole camera model only.
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "OGRE/Ogre.h"
+#include "Camera.h"
+#include "Scene.h"
+#include "Histogram.h"
+
+class LatencyProbe : public Ogre::RenderTargetListener, public Ogre::FrameListener
+{
+	public:
+		static const unsigned int StampColumns = 4;
+		static const unsigned int StampRows = 4;
+		static const unsigned int StampIdBits = 12;		// remaining bits are the check nibble
+		static const unsigned int StampIdCount = (1 << StampIdBits) - 1;	// stamps 1..4095 (0 = nothing decoded)
+
+		// Capture side: stamp frame id into the image (in place)
+		static unsigned int stampOf(const unsigned long long frameId) { return (unsigned int)(frameId % StampIdCount) + 1; }
+		static void stamp(cv::Mat& image, const unsigned long long frameId);
+
+		// eyeTexture is the render target of the left eye camera (see Rift::getEyeTexture())
+		LatencyProbe(Ogre::Root* root, Scene* scene, Ogre::TexturePtr eyeTexture);
+		~LatencyProbe();
+
+		// Render side: call right after the frame of the left camera has been uploaded to the video texture
+		void frameUploaded(const FrameCaptureData& frame);
+
+		// Ogre::RenderTargetListener: decode the stamp once the eye texture has been rendered
+		virtual void postRenderTargetUpdate(const Ogre::RenderTargetEvent& rte);
+		// Ogre::FrameListener: buffers have been swapped, decoded frame is now presented
+		virtual bool frameEnded(const Ogre::FrameEvent& evt);
+
+		// Budgets of the histograms: one frame to the texture, two to the display (defaults: FORCE_3D_RENDERING_FPS)
+		void setFrameBudget(const double ms) { grabToTexture.budgetMs = ms; grabToPresent.budgetMs = 2 * ms; }
+
+		void report(std::ostream& out);
+		void write(std::ostream& out) const;
+
+	private:
+		int decode(const bool flipY);
+
+		Ogre::Root* mRoot = nullptr;
+		Scene* mScene = nullptr;
+		Ogre::TexturePtr mEyeTexture;
+		Ogre::RenderTarget* mEyeTarget = nullptr;
+		std::vector<unsigned char> readback;		// eye texture copy (RGBA), allocated once
+		Ogre::PixelBox readbackBox;
+
+		std::vector<double> grabTimes;				// by stamp, ovr seconds (0 = not uploaded)
+		int displayedStamp = 0;						// decoded from the last eye render
+		int presentedStamp = 0;						// last stamp whose presentation was recorded
+		bool flippedReadback = false;				// texture rows found bottom-up (switched on decode failure)
+		unsigned long long decodeFailures = 0;
+
+		TimingHistogram grabToTexture{ "grab to texture", 1000.0 / FORCE_3D_RENDERING_FPS };
+		TimingHistogram grabToPresent{ "grab to present", 2000.0 / FORCE_3D_RENDERING_FPS };
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef QUALITYGOVERNOR_H
+#define QUALITYGOVERNOR_H
+
+// Picks the eye render quality (pixel density and MSAA of the eye render textures, see Rift::setEyeRenderQuality())
+// from the frame time, so that a heavy scene costs resolution instead of missed frames.
+// Quality is a ladder of levels, from cheapest to best:
+//	- pixel density minDensity..1.0 (step densityStep), no MSAA
+//	- pixel density 1.0, MSAA 2, 4 .. maxFsaa
+//	- pixel density 1.0..maxDensity, MSAA maxFsaa
+// so that stepping down drops MSAA before resolution. Frame times are evaluated in windows of windowFrames:
+//	- p90 above lowerAbove * budgetMs: one level down
+//	- p90 below raiseBelow * budgetMs for raiseWindows windows in a row: one level up
+//	- the holdWindows windows after a change are not evaluated (new render targets, caches warming up)
+// Different thresholds for down and up, plus the calm windows needed to go up, keep quality from oscillating.
+// Render thread only.
+
+#include <vector>
+
+class QualityGovernor
+{
+	public:
+		struct Settings
+		{
+			float minDensity = 0.6f;
+			float maxDensity = 1.4f;
+			float densityStep = 0.1f;
+			unsigned int maxFsaa = 4;
+			double budgetMs = 1000.0 / 60;
+			double lowerAbove = 0.9;
+			double raiseBelow = 0.7;
+			unsigned int windowFrames = 30;
+			unsigned int raiseWindows = 3;
+			unsigned int holdWindows = 2;
+		};
+
+		struct Level
+		{
+			float pixelDensity;
+			unsigned int fsaa;
+		};
+
+		// Starts at pixel density 1.0 and maxFsaa
+		QualityGovernor(const Settings& governorSettings);
+
+		// Call once per frame with the frame time. Returns true if the level has changed.
+		bool addFrame(const double ms);
+
+		Level getLevel() const { return levels[current]; }
+		Level getBestLevel() const { return levels.back(); }
+		const Settings& getSettings() const { return settings; }
+		// Frame budget, once known (i.e. HMD refresh, after the governor had to pick the first render textures)
+		void setBudget(const double ms) { settings.budgetMs = ms; }
+
+	private:
+		Settings settings;
+		std::vector<Level> levels;			// cheapest first
+		unsigned int current = 0;
+		std::vector<double> window;			// frame times of the window being collected
+		unsigned int calmWindows = 0;		// consecutive windows below raise threshold
+		unsigned int heldWindows = 0;		// windows still to skip after a change
+};
+
+#endif
@@ -2,14 +2,28 @@
 #define RIFT_H
 
 #include <iostream>
+#include <memory>
 #include "OVR.h"
 #include "Extras/OVR_Math.h"
 #include "OGRE/Ogre.h"
+#include "Hmd.h"
+#include "Histogram.h"
+#include "IdleWorkQueue.h"
+#include "Globals.h"
 using namespace OVR;
 
-class Rift : public Ogre::RenderTargetListener
+class Rift : public Ogre::RenderTargetListener, public Ogre::RenderQueueListener
 {
 	public:
+		// How eye textures are distorted for the lenses:
+		//	Mesh	SDK distortion mesh, per vertex tan eye angles and timewarp (see DistortionMesh.h)
+		//	Lookup	mesh baked once into lookup textures, one quad per eye, timewarp per pixel
+		enum DistortionMode
+		{
+			Mesh,
+			Lookup
+		};
+
 		// Contructor initiates Rift Rendering environment, as follows:
 		//	- looks for Rift physical device (it can be FOUND or NOT FOUND)
 		//	- create a new scene under root with:
@@ -21,7 +35,10 @@ class Rift : public Ogre::RenderTargetListener
 		//			- if Rift is NOT FOUND, creates a window in the default screen
 		//		- IF renderWindow != nullptr, result of ortho camera is displayed regardless of Oculus state
 		//	- rotates the camera/meshes by 90 degrees if rotateView == true (DK2 Setup)
+		// If LibOVR cannot be initialized (no Oculus runtime), a ScriptedHmdDevice with default settings is used.
 		Rift( const unsigned int ID, Ogre::Root* const root, Ogre::RenderWindow* &renderWindow, const bool rotateView = false);
+		// Same, with an explicit HMD backend (i.e. ScriptedHmdDevice)
+		Rift( std::unique_ptr<HmdDevice> device, Ogre::Root* const root, Ogre::RenderWindow* &renderWindow, const bool rotateView = false);
 		~Rift();
 
 		// Call this if you want to manually associate a render window to the Rift
@@ -37,19 +54,44 @@ class Rift : public Ogre::RenderTargetListener
 		bool update( float dt );
 		void pauseRender(bool pauseRender) { pause = pauseRender; }
 		bool pause = false;
+		// Reprojection frame: eye textures are not rendered, the last ones are distorted again with a timewarp
+		// from their render pose to the newest one (as when paused). Applies to every frame until reset.
+		void setReprojectionFrame(const bool reproject) { reprojectionFrame = reproject; }
+		bool isReprojectionFrame() const { return reprojectionFrame; }
+		// Queue drained while waiting for the timewarp point (nullptr = plain wait). Not owned.
+		void setIdleWorkQueue(IdleWorkQueue* queue) { idleWork = queue; }
+		// Display frames presented with freshly rendered eye textures, and with reprojected ones (paused included)
+		unsigned long getRenderedFrames() const { return renderedFrames; }
+		unsigned long getReprojectedFrames() const { return reprojectedFrames; }
 
 		// Pre-render listeners (for reduced latency and time-warping)
 		virtual void preRenderTargetUpdate(const Ogre::RenderTargetEvent& rte);
 		virtual void postRenderTargetUpdate(const Ogre::RenderTargetEvent& rte);
+		virtual void preViewportUpdate(const Ogre::RenderTargetViewportEvent& evt);
+		virtual void postViewportUpdate(const Ogre::RenderTargetViewportEvent& evt);
 
 		Ogre::Quaternion getOrientation() { return mOrientation; }
 		Ogre::Vector3 getPosition() { return mPosition; }
 
+		// Smallest FOV containing both eye FOVs (tangents of half angles), widened by paddingDegrees on each side
+		ovrFovPort getCombinedEyeFov(const float paddingDegrees = 0);
+
+		// Late latch: the eye pose is sampled again after culling, right before draw submission, and only the
+		// view matrix of the eye camera is replaced (scene graph, culling and render queue are left as they are).
+		// Culling has to cover the head motion in between: eye cameras without a culling frustum get one widened by
+		// paddingDegrees (with stereo culling, pad the combined FOV instead, see getCombinedEyeFov()).
+		// Call after attachCameras() (and again if IPD changes).
+		void setLateLatch(const bool enable, const float paddingDegrees = 2.0f);
+		bool isLateLatchEnabled() const { return lateLatch; }
+		// Ogre::RenderQueueListener (eye cameras scene): late latch
+		virtual void preRenderQueues();
+		virtual void postRenderQueues();
+
 		// returns interpupillary distance in meters: (Default: 0.064m)
 		float getIPD() { return mIPD; }
 
-		// TEMP
-		ovrHmd getHandle() { return hmd; }
+		// HMD backend (tracking functions are thread safe, i.e. for capture threads)
+		HmdDevice* getHandle() { return hmd.get(); }
 
 		Ogre::SceneManager* getSceneMgr() { return mSceneMgr; }
 
@@ -59,9 +101,46 @@ class Rift : public Ogre::RenderTargetListener
 
 		Ogre::RenderWindow* createRiftDisplayWindow(Ogre::Root* const root);
 		Ogre::RenderWindow* createDebugRiftDisplayWindow(Ogre::Root* const root);
-		void createRiftDisplayScene(Ogre::Root* const root);
+		// Offscreen alternative to createRiftDisplayWindow (benchmark): same output, rendered into a texture of HMD resolution
+		Ogre::RenderTexture* createRiftDisplayTexture(Ogre::Root* const root);
+		// Render both eyes side by side into one double-width texture (one target update, one texture for both meshes)
+		// instead of one texture per eye. Call before createRiftDisplayScene().
+		void setSharedEyeTexture(const bool shared) { sharedEyeTexture = shared; }
+		bool isEyeTextureShared() const { return sharedEyeTexture; }
+		// Load/store SDK distortion meshes as files starting with filePrefix (empty: always generate). Call before createRiftDisplayScene().
+		void setDistortionMeshCache(const std::string& filePrefix) { distortionMeshCachePrefix = filePrefix; }
+		// Can be switched at any time between frames (lookup textures are baked the first time Lookup is set).
+		// lookupScale: lookup texture size relative to the eye area on the display, set before Lookup is first used
+		void setDistortionMode(const DistortionMode mode);
+		DistortionMode getDistortionMode() const { return distortionMode; }
+		void setDistortionLookupScale(const float lookupScale) { distortionLookupScale = lookupScale; }
+		// maxDensity: highest pixel density eye textures are allocated for (see setEyeRenderQuality()), fsaa: eye textures MSAA
+		void createRiftDisplayScene(Ogre::Root* const root, const float maxDensity = 1.0f, const unsigned int fsaa = 0);
+
+		// Eye render quality: pixel density (1.0 = SDK recommended texture size) and MSAA samples.
+		// Density only moves the eye viewports and the distortion UV scale/offset (cheap, can be called every frame),
+		// a new fsaa value recreates the eye textures. Call between frames.
+		void setEyeRenderQuality(const float density, const unsigned int fsaa);
+		float getPixelDensity() const { return pixelDensity; }
+		unsigned int getEyeFsaa() const { return eyeFsaa; }
 
 		Ogre::Camera* getCamera(){ return mCamera; }
+		// Texture the eye cameras are rendered to (before distortion), the same one for both eyes if shared
+		Ogre::TexturePtr getEyeTexture(const int eye){ return eye == 0 ? mLeftEyeRenderTexture : mRightEyeRenderTexture; }
+		// CPU time spent updating each eye render texture (scene culling, batching and draw submission)
+		TimingHistogram& getEyeRenderTimes(const int eye){ return eyeRenderTimes[eye]; }
+		// CPU time spent rendering both eyes (all eye render texture updates of a frame)
+		TimingHistogram& getEyePassTimes(){ return eyePassTimes; }
+		// CPU time spent setting up timewarp after the wait (eye poses sampled again, shader constants written)
+		TimingHistogram& getTimewarpSetupTimes(){ return timewarpSetupTimes; }
+		// Budget of the histograms above (defaults: FORCE_3D_RENDERING_FPS), i.e. the HMD frame budget
+		void setFrameBudget(const double ms) { eyePassTimes.budgetMs = timewarpSetupTimes.budgetMs = eyeRenderTimes[0].budgetMs = eyeRenderTimes[1].budgetMs = ms; }
+		std::string getProductName() const { return hmd->getProductName(); }
+		double getRefreshRate() const { return hmd->getRefreshRate(); }
+		// Vsync the last frame is predicted to be shown at (ovr_GetTimeInSeconds clock, from the SDK frame timing)
+		double getPredictedVsync() const { return frameTiming.NextFrameSeconds; }
+		// time the last frame spent waiting for the timewarp point (idle, not rendering)
+		double getLastWaitMs() const { return lastWaitMs; }
 
 
 		Ogre::SceneNode* mHeadNode = nullptr;
@@ -74,18 +153,15 @@ class Rift : public Ogre::RenderTargetListener
 
 		// Rift data
 		int mRiftID = 0;
-		ovrHmd hmd = nullptr;
+		std::unique_ptr<HmdDevice> hmd;
 		bool rotateView = false;
 		bool simulationMode = false;
 		float mIPD = 0.064f;
-		ovrFrameTiming frameTiming;
-		static bool isInitialized;
-		static unsigned short int ovr_Users;
+		ovrFrameTiming frameTiming = {};
 		ovrEyeType nextEyeToRender;
 		ovrEyeRenderDesc eyeRenderDesc[2];
 		ovrPosef headPose[2];
-		static void init();
-		static void shutdown();
+		void setDevice(std::unique_ptr<HmdDevice> device, const unsigned int ID);
 
 		// Oculus Rift Outer Scene (head pose)
 		//Ogre::SceneNode* mHeadNode = nullptr;
@@ -100,11 +176,57 @@ class Rift : public Ogre::RenderTargetListener
 		Ogre::MaterialPtr mMatLeft;
 		Ogre::MaterialPtr mMatRight;
 		Ogre::RenderTexture* mRenderTexture[2];
+		Ogre::Camera* mEyeCamera[2] = { nullptr, nullptr };
+		Ogre::Viewport* mEyeViewport[2] = { nullptr, nullptr };
+		bool sharedEyeTexture = false;
+		int rightEyeOffsetX = 0;			// right eye area in its texture (shared: right half)
+		std::string distortionMeshCachePrefix;
+		DistortionMode distortionMode = DistortionMode::Mesh;
+		float distortionLookupScale = 0.5f;
+		HmdDistortionMesh distortionMeshData[2];	// until lookup textures are baked
+		Ogre::SceneNode* mDistortionNode = nullptr;
+		Ogre::Entity* mDistortionMesh[2] = { nullptr, nullptr };
+		Ogre::ManualObject* mDistortionQuad[2] = { nullptr, nullptr };
+		Ogre::MaterialPtr mMatLookup[2];
+		void createDistortionLookup();
+		// Per eye distortion constants (UV scale/offset, timewarp matrices) shared by the mesh and lookup materials of the eye.
+		// Physical indices are resolved once: per frame writes are plain copies, no name lookups.
+		Ogre::GpuSharedParametersPtr mDistortionConstants[2];
+		size_t uvScaleIndex = 0;
+		size_t uvOffsetIndex = 0;
+		size_t eyeRotationStartIndex = 0;
+		size_t eyeRotationEndIndex = 0;
+		void createDistortionConstants();
+		std::chrono::steady_clock::time_point eyeViewportStart_time;
+		void applyEyePose();
+		bool reprojectionFrame = false;
+		unsigned long renderedFrames = 0;
+		unsigned long reprojectedFrames = 0;
+		bool lateLatch = false;
+		int eyeInProgress = -1;							// eye whose render target is being updated (-1: none)
+		Ogre::Camera* latchedCamera = nullptr;			// custom view matrix set until its queues are rendered
+		Ogre::Frustum* mLatchCullingFrustum[2] = { nullptr, nullptr };
+		Ogre::SceneNode* mLatchCullingNode[2] = { nullptr, nullptr };
+		void destroyLatchCulling();
+		ovrSizei recommendedTexSize[2];
+		float maxPixelDensity = 1.0f;
+		float pixelDensity = 1.0f;
+		unsigned int eyeFsaa = 0;
+		double lastWaitMs = 0;
+		IdleWorkQueue* idleWork = nullptr;
+		void createEyeTextures();
+		void attachEyeCamera(const int eye);
+		void updateEyeViewports();
+		TimingHistogram eyePassTimes{ "eye pass", 1000.0 / FORCE_3D_RENDERING_FPS };
+		TimingHistogram timewarpSetupTimes{ "timewarp setup", 1000.0 / FORCE_3D_RENDERING_FPS };
+		TimingHistogram eyeRenderTimes[2] = { { "eye RTT left", 1000.0 / FORCE_3D_RENDERING_FPS }, { "eye RTT right", 1000.0 / FORCE_3D_RENDERING_FPS } };
 
 		
 		
 		// Oculus Rift Display rendering window (displayed on Oculus)
 		Ogre::RenderWindow* mRenderWindow = nullptr;
+		Ogre::TexturePtr mDisplayTexture;				// offscreen display (see createRiftDisplayTexture)
+		Ogre::RenderTarget* mDisplayTarget = nullptr;	// the one of the two the frame is paced on
 		Ogre::Viewport* mViewport = nullptr;
 
 	
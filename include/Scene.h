@@ -1,9 +1,11 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <vector>
 #include "OGRE/Ogre.h"
 #include "OIS/OIS.h"
 #include "Globals.h"
+#include "StereoCuller.h"
 
 class Scene : public Ogre::Camera::Listener
 {
@@ -29,6 +31,23 @@ class Scene : public Ogre::Camera::Listener
 		Ogre::Camera* getRightCamera() { return mCamRight; }
 		Ogre::Camera* getGodCamera() { return mCamGod; }
 
+		// Fisheye lens the video sphere is generated from (Fisheye model only, set before setupVideo())
+		struct FisheyeLens
+		{
+			enum Projection
+			{
+				Orthographic,		// r = sin(theta)
+				Equidistant,		// r = theta_d = theta (1 + k1 theta^2 + k2 theta^4 + k3 theta^6 + k4 theta^8)
+				Equisolid,			// r = sin(theta / 2)
+				Stereographic		// r = tan(theta / 2)
+			} projection = Orthographic;
+			float fovDegrees = 180.0f;			// view inscribed in the image circle
+			float k[4] = { 0, 0, 0, 0 };		// Equidistant distortion coefficients
+			unsigned int rings = 16;			// tessellation: from the centre to the edge of the view
+			unsigned int segments = 48;			// around the centre
+		};
+		void setFisheyeLens(const FisheyeLens& lens) { fisheyeLens = lens; }
+
 		// One-call functions for SeeThrough rig setup
 		void setupVideo(const CameraModel camModelToUse, const StabilizationModel stabModelToUse, const Ogre::Vector3 eyeToCameraOffset, const float HFov, const float VFov);
 		void setupVideo(const CameraModel camModelToUse, const StabilizationModel stabModelToUse, const Ogre::Vector3 eyeToCameraOffset, const float WSensor, const float HSensor, const float FL);
@@ -38,6 +57,9 @@ class Scene : public Ogre::Camera::Listener
 		void enableVideo();
 		void disableVideo();
 		void setStabilizationMode(StabilizationModel modelToUse);
+		// Cull the scene once per frame for both eyes (see StereoCuller), given the union of the two eye FOVs (tangents).
+		// Call after setupVideo(), setIPD() and eye projections setup.
+		void enableStereoCulling(const float leftTan, const float rightTan, const float upTan, const float downTan);
 
 		// Functions for realtime runtime calibration
 		float adjustVideoDistance(const float distIncrement);
@@ -56,9 +78,31 @@ class Scene : public Ogre::Camera::Listener
 
 		// Update functions
 		void update( float dt );
+		// Video planes toe-in (degrees), and the one matching a marker at markerZ meters (false: out of the known range)
+		void setVideoToeInAngle(const float angle);
+		static bool computeVideoToeInAngle(const float markerZ, float& angle);
 		void setRiftPose( Ogre::Quaternion orientation, Ogre::Vector3 pos );
-		void setVideoImagePoseLeft(const Ogre::PixelBox &image, Ogre::Quaternion pose);
-		void setVideoImagePoseRight(const Ogre::PixelBox &image, Ogre::Quaternion pose);
+		// Video textures follow the size of the camera frames: call with the frame size before its image is written
+		// (textures are recreated only when it changes, they start at FORCE_WIDTH/HEIGHT_RESOLUTION)
+		void setVideoImageSizeLeft(const size_t width, const size_t height);
+		void setVideoImageSizeRight(const size_t width, const size_t height);
+		// textureBox: part of the video texture the image is written to (same size, region of interest of a frame as big
+		// as the texture), the rest keeps what it had. nullptr: image covers the whole texture (scaled if needed).
+		void setVideoImagePoseLeft(const Ogre::PixelBox &image, Ogre::Quaternion pose, const Ogre::Box* textureBox = nullptr);
+		void setVideoImagePoseRight(const Ogre::PixelBox &image, Ogre::Quaternion pose, const Ogre::Box* textureBox = nullptr);
+		// Dim the video image of one eye (i.e. while its camera is reconnecting and the last frame is stale)
+		void setVideoLeftDimmed(const bool dimmed);
+		void setVideoRightDimmed(const bool dimmed);
+		// Projects a point of the video image (uv in [0,1], v growing downwards like image rows) into the
+		// viewport of the eye camera (x right, y down, [0,1]). Pinhole model only: returns false otherwise.
+		bool projectVideoImagePoint(const int eye, const Ogre::Vector2& uv, Ogre::Vector2& viewportPoint);
+		// Part of the video image (uv as above) inside the eye camera frustum, widened by margin (share of the image)
+		// on each side. Pinhole model only: returns false otherwise, or if the plane is not in front of the eye.
+		// Bounds of what the eye can see for the current video plane transform, without stabilization (its rotation follows
+		// each frame, the margin has to cover it): recompute when getVideoLayoutVersion() changes.
+		bool getVisibleVideoRegion(const int eye, const float margin, Ogre::FloatRect& region);
+		// Changes every time video planes are moved, scaled or turned by calibration, FOV, IPD or toe-in
+		unsigned int getVideoLayoutVersion() const { return videoLayoutVersion; }
 		// Apply relative AR pose and save it as absolute in world coordinates
 		void setCubePosition(Ogre::Vector3 pos){ mCubeRedReference->setPosition(pos); mCubeRed->setPosition(mCubeRedReference->_getDerivedPosition()); }
 		void setCubeOrientation(Ogre::Quaternion ori){ mCubeRedReference->setOrientation(ori); mCubeRed->setOrientation(mCubeRedReference->_getDerivedOrientation()); };
@@ -166,6 +210,35 @@ class Scene : public Ogre::Camera::Listener
 		void createPinholeVideos(const float WPlane, const float HPlane, const Ogre::Vector3 offset);
 		void createFisheyeVideos(const Ogre::Vector3 offset);
 		void updateVideos();	// called only when a parameter is adjusted
+		void setVideoDimmed(Ogre::MaterialPtr& material, const bool dimmed);
+		void resizeVideoTexture(Ogre::TexturePtr& texture, const size_t width, const size_t height);
+
+		// Fisheye shader constants of a video material, resolved once to physical indices (see createFisheyeVideos())
+		struct FisheyeShaderConstants
+		{
+			Ogre::GpuProgramParametersSharedPtr params;
+			size_t dimFactor = 0;
+		};
+		FisheyeShaderConstants mLeftFisheyeConstants;
+		FisheyeShaderConstants mRightFisheyeConstants;
+		void resolveFisheyeShaderConstants(Ogre::MaterialPtr& material, FisheyeShaderConstants& constants);
+
+		// Fisheye video sphere generated from fisheyeLens: positions are static, texture coordinates (lens projection
+		// and texture calibration baked per vertex) are rewritten when the calibration changes (see writeFisheyeUVs())
+		FisheyeLens fisheyeLens;
+		std::vector<Ogre::Vector2> fisheyeLensUVs;		// lens projection of each vertex (image circle of radius 0.5)
+		Ogre::MeshPtr mLeftFisheyeMesh;
+		Ogre::MeshPtr mRightFisheyeMesh;
+		Ogre::MeshPtr createFisheyeMesh(const std::string& name);
+		void writeFisheyeUVs(Ogre::MeshPtr& mesh, const float aspectRatio, const float scale, const Ogre::Vector2& offset);
+
+		// Brightness of a video image whose camera is not delivering frames
+		float videoDimFactor = 0.35f;
+		float videoPlaneWidth = 0;		// pinhole plane mesh size (before node scaling)
+		float videoPlaneHeight = 0;
+		unsigned int videoLayoutVersion = 0;
+		bool videoLeftIsDimmed = false;
+		bool videoRightIsDimmed = false;
 
 		Ogre::Root* mRoot = nullptr;
 		OIS::Mouse* mMouse = nullptr;
@@ -174,6 +247,11 @@ class Scene : public Ogre::Camera::Listener
 
 		Ogre::Camera* mCamLeft = nullptr;
 		Ogre::Camera* mCamRight = nullptr;
+		// Stereo culling: both video planes are queued once, each eye skips the render queue group of the other one
+		StereoCuller* mStereoCuller = nullptr;
+		static const Ogre::uint8 VideoLeftQueueGroup = Ogre::RENDER_QUEUE_6;
+		static const Ogre::uint8 VideoRightQueueGroup = Ogre::RENDER_QUEUE_7;
+		void excludeVideoQueueGroups(Ogre::Camera* cam);
 		Ogre::SceneNode* mLeftStabilizationNode = nullptr;			// to this we assign one of the two nodes used for stabilization (neck or eye)
 		Ogre::SceneNode* mRightStabilizationNode = nullptr;			// to this we assign one of the two nodes used for stabilization (neck or eye)
 
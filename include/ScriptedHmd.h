@@ -0,0 +1,86 @@
+#ifndef SCRIPTEDHMD_H
+#define SCRIPTEDHMD_H
+
+// HMD backend that needs neither a headset nor the Oculus runtime (i.e. headless performance tests under Xvfb/Mesa).
+// Head poses come from a motion profile evaluated at the requested time:
+//	- Static:		head still, looking forward
+//	- Yaw:			head turning left and right (sine)
+//	- Figure8:		yaw and pitch sines (2:1), like a slow figure-eight
+//	- Trace:		pose trace replayed from a text file, looped. One sample per line:
+//					"time qw qx qy qz px py pz" (seconds from trace start, unit quaternion, meters), '#' for comments
+// Rendering setup is fixed: DK2 screen, DK2 default eye FOVs and a generated barrel distortion mesh.
+// Frame timing optionally simulates vsync (frames paced at refreshRate), otherwise frames are never throttled.
+// Timewarp matrices are identity (rendered pose is always the displayed one).
+
+#include <mutex>
+#include <vector>
+#include "OGRE/Ogre.h"
+#include "Hmd.h"
+
+class ScriptedHmdDevice : public HmdDevice
+{
+	public:
+		enum MotionProfile
+		{
+			Static,
+			Yaw,
+			Figure8,
+			Trace
+		};
+
+		struct Settings
+		{
+			MotionProfile profile = Yaw;
+			float amplitudeDeg = 30.0f;			// Yaw/Figure8 peak angle
+			float frequencyHz = 0.2f;			// Yaw/Figure8 speed
+			std::string traceFile;				// Trace profile only
+			bool simulateVsync = false;			// true: beginFrameTiming() schedules frames at refreshRate
+			double refreshRate = 75.0;
+			float ipd = 0.064f;
+		};
+
+		// Throws std::runtime_error if the trace file cannot be read (Trace profile)
+		ScriptedHmdDevice(const Settings& hmdSettings);
+
+		virtual std::string getProductName() const { return "Scripted HMD"; }
+		virtual ovrHmdType getType() const { return ovrHmd_DK2; }
+		virtual bool isSimulated() const { return true; }
+		virtual ovrSizei getResolution() const;
+		virtual ovrFovPort getDefaultEyeFov(const int eye) const;
+		virtual float getIPD() const { return settings.ipd; }
+		virtual double getRefreshRate() const { return settings.refreshRate; }
+
+		virtual ovrSizei getFovTextureSize(const int eye, const ovrFovPort& fov) const;
+		virtual ovrEyeRenderDesc getRenderDesc(const int eye, const ovrFovPort& fov) const;
+		virtual void createDistortionMesh(const ovrEyeRenderDesc& renderDesc, const unsigned int distortionCaps, HmdDistortionMesh& out) const;
+
+		virtual ovrTrackingState getTrackingState(const double absTime);
+		virtual ovrTrackingState getTrackingStateExtended(const double absTime) { return getTrackingState(absTime); }
+		virtual void getEyePoses(const unsigned int frameIndex, const ovrVector3f hmdToEyeViewOffset[2], ovrPosef outEyePoses[2], ovrTrackingState* outTrackingState);
+		virtual void recenterPose();
+
+		virtual ovrFrameTiming beginFrameTiming(const unsigned int frameIndex);
+		virtual void waitTillTime(const double absTime);
+		virtual void getEyeTimewarpMatrices(const int eye, const ovrPosef& renderPose, ovrMatrix4f twmOut[2]);
+		virtual void endFrameTiming() {}
+
+	private:
+		struct TraceSample
+		{
+			double time;
+			Ogre::Quaternion orientation;
+			Ogre::Vector3 position;
+		};
+
+		void loadTrace(const std::string& fileName);
+		void evaluate(const double t, Ogre::Quaternion& orientation, Ogre::Vector3& position) const;
+
+		Settings settings;
+		double startTime = 0;					// ovr time profiles are evaluated from
+		std::vector<TraceSample> trace;
+		std::mutex recenterMutex;
+		Ogre::Quaternion recenter = Ogre::Quaternion::IDENTITY;		// inverse yaw of the last recenterPose()
+		double nextFrameTime = 0;				// vsync simulation
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+// App logic that does not touch Ogre, run at a fixed tick and published as immutable snapshots (see [Simulation]).
+// A tick takes the new camera frames, turns detected markers into anchors for the scene and computes the video
+// toe-in correction for the marker distance. The render thread takes the latest snapshot once per frame, before
+// renderOneFrame(), and applies it in one pass (App::applySimulationSnapshot()): the frame rate does not depend on
+// the cost of a tick. Without the thread, tick() is called by the render thread itself, same snapshots.
+// Input devices and the scene graph stay on the render thread (OIS and Ogre are not thread safe).
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include "OGRE/Ogre.h"
+#include "Camera.h"
+#include "Histogram.h"
+#include "StereoDepth.h"
+
+struct MarkerAnchor
+{
+	Ogre::Vector3 position;			// in the AR reference of the left video (see Scene::setCubePosition())
+	Ogre::Quaternion orientation;
+};
+
+struct SimulationSnapshot
+{
+	unsigned long long tick = 0;
+	double time = 0;				// ovr_GetTimeInSeconds() of the tick
+
+	// Latest video pair: a new left frame with the latest right one (videoId 0 = none yet, changes with every pair)
+	unsigned long long videoId = 0;
+	FrameCaptureData videoLeft;
+	FrameCaptureData videoRight;
+
+	// Anchors of the markers of the latest frame that detected some (markersId changes with them, 0 = none yet)
+	unsigned long long markersId = 0;
+	std::vector<MarkerAnchor> markers;
+
+	// Focus depth of the camera pair in meters (0 = unknown, see StereoDepth)
+	float focusDepth = 0;
+
+	// Video toe-in correction for the focus depth, or the marker distance without it (see Scene::computeVideoToeInAngle())
+	bool videoToeIn = false;
+	float videoToeInAngle = 0;
+};
+
+class Simulation
+{
+	public:
+		// Cameras are polled with FrameCaptureHandler::get(): the simulation must be their only consumer
+		Simulation(FrameCaptureHandler* const cameraLeft, FrameCaptureHandler* const cameraRight);
+		~Simulation();
+
+		// Runs tick() on its own thread every 1/tickRate seconds until stop()
+		void start(const double tickRate);
+		void stop();
+		// Pairs are submitted to it and its focus depth drives the video toe-in (nullptr = markers only). Not owned.
+		void setStereoDepth(StereoDepth* depth) { stereoDepth = depth; }
+		bool isThreaded() const { return simulationThread.joinable(); }
+
+		// One simulation step, publishes a new snapshot (render thread only when not threaded)
+		void tick();
+		// Latest published snapshot (never null). Shared with the simulation thread: not to be modified.
+		std::shared_ptr<const SimulationSnapshot> getSnapshot() const;
+
+		// Time spent in tick() (written by the thread running it)
+		TimingHistogram& getTickTimes() { return tickTimes; }
+
+	private:
+		void threadMain(const double tickRate);
+
+		FrameCaptureHandler* mCameraLeft = nullptr;
+		FrameCaptureHandler* mCameraRight = nullptr;
+		StereoDepth* stereoDepth = nullptr;
+
+		// State of the thread running tick()
+		SimulationSnapshot state;
+		FrameCaptureData nextFrameRight;
+		TimingHistogram tickTimes{ "simulation tick", 0 };
+
+		mutable std::mutex snapshotMutex;
+		std::shared_ptr<const SimulationSnapshot> snapshot;
+		std::thread simulationThread;
+		std::atomic<bool> stopped{ true };
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef STEREOCULLER_H
+#define STEREOCULLER_H
+
+// Culls the scene once per frame for both eyes.
+// Both eye cameras cull against one frustum enclosing the two eye frusta (same FOV union, apex moved back
+// between the eyes so that it contains both). The first eye rendered in a frame walks the scene graph as usual and
+// its render queue is cached, the second eye skips scene traversal and culling (SceneManager::setFindVisibleObjects)
+// and gets its render queue emptied and the cached renderables queued back right before rendering.
+// LOD and visibility are therefore decided once for both eyes (the two images always show the same objects).
+// Anything that must differ per eye has to live in its own render queue group (see Scene video planes).
+
+#include <vector>
+#include "OGRE/Ogre.h"
+
+class StereoCuller : public Ogre::SceneManager::Listener, public Ogre::RenderQueueListener, public Ogre::Camera::Listener
+{
+	public:
+		StereoCuller(Ogre::SceneManager* sceneMgr, Ogre::Camera* camLeft, Ogre::Camera* camRight, Ogre::SceneNode* headNode);
+		~StereoCuller();
+
+		// Union of the two eye FOVs (tangents of half angles, as in ovrFovPort).
+		// Eye positions and clip distances are read from the cameras: call again if they change (i.e. IPD).
+		void setFov(const float leftTan, const float rightTan, const float upTan, const float downTan);
+
+		// Ogre::Camera::Listener
+		virtual void cameraPreRenderScene(Ogre::Camera* cam);
+		virtual void cameraPostRenderScene(Ogre::Camera* cam);
+		// Ogre::SceneManager::Listener: cache the queue filled for the first eye
+		virtual void postFindVisibleObjects(Ogre::SceneManager* source, Ogre::SceneManager::IlluminationRenderStage irs, Ogre::Viewport* v);
+		// Ogre::RenderQueueListener: queue the cached renderables (only them) for the second eye
+		virtual void preRenderQueues();
+
+	private:
+		struct QueuedRenderable
+		{
+			Ogre::Renderable* renderable;
+			Ogre::uint8 groupId;
+			Ogre::ushort priority;
+		};
+
+		void cacheRenderQueue(Ogre::RenderQueue* queue);
+
+		Ogre::SceneManager* mSceneMgr = nullptr;
+		Ogre::Camera* mCamLeft = nullptr;
+		Ogre::Camera* mCamRight = nullptr;
+		Ogre::SceneNode* mFrustumNode = nullptr;
+		Ogre::Frustum* mCullingFrustum = nullptr;
+
+		Ogre::Camera* cachedFor = nullptr;		// eye whose queue is cached (first eye of the frame), null = none
+		Ogre::Camera* replaying = nullptr;		// eye being rendered from the cache
+		std::vector<QueuedRenderable> cache;	// allocated once, reused every frame
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef STEREODEPTH_H
+#define STEREODEPTH_H
+
+// Focus depth from the camera pair (see [StereoDepth]), to converge the video where the user is looking at.
+// Pairs are handed over with submit() and matched on a background thread (latest pair only, never queued): block
+// matching (cv::StereoBM, parallelized by OpenCV) on a grey, downscaled ROI around the image centre (gaze centre:
+// there is no eye tracking). The focus depth is the median disparity of the ROI, turned into meters with the camera
+// focal length, baseline and convergence distance (toed-in cameras), and smoothed over time.
+// A result is published only if enough of the ROI matched (textureless or occluded views give none).
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <opencv2/opencv.hpp>
+#include "Histogram.h"
+
+class StereoDepth
+{
+	public:
+		struct Settings
+		{
+			double scale = 0.25;				// matching resolution relative to the camera images
+			double roiSize = 0.4;				// ROI width and height relative to the image
+			int disparities = 32;				// disparity search range at matching resolution (multiple of 16)
+			int blockSize = 11;					// matching window (odd)
+			double minValidFraction = 0.2;		// matched share of the ROI needed for a result
+			double smoothingSeconds = 0.3;		// time constant of the published depth
+			double staleSeconds = 0.5;			// no result for this long: depth is unknown again
+			// Cameras: focal length in pixels at calibrationWidth, baseline and toe-in of each camera
+			double focalPixels = 0;
+			double calibrationWidth = 0;
+			double baseline = 0.064;			// meters
+			double toeInDegrees = 0;
+		};
+
+		// Matching thread is started at once
+		StereoDepth(const Settings& depthSettings);
+		~StereoDepth();
+
+		// Latest pair to match (BGR, same size), copied: capture buffers are reused. A pair not matched yet is replaced. Any thread.
+		// valid: pixels defined in both images (see FrameCaptureHandler region of interest), empty = whole images
+		void submit(const cv::Mat& left, const cv::Mat& right, const cv::Rect& valid = cv::Rect());
+		// Smoothed focus depth in meters, false while unknown (no match yet, or only unreliable ones lately). Any thread.
+		bool getFocusDepth(float& meters) const;
+
+		// Time spent matching a pair (written by the matching thread)
+		TimingHistogram& getMatchTimes() { return matchTimes; }
+
+	private:
+		void threadMain();
+		bool match(const cv::Mat& left, const cv::Mat& right, const cv::Rect& valid, double& depth);
+
+		Settings settings;
+		cv::StereoBM matcher;
+		cv::Mat greyLeft, greyRight, smallLeft, smallRight, disparity;	// matching thread buffers, reused
+		cv::Mat matchLeft, matchRight;			// matching thread: pair being matched, swapped with the pending one
+		TimingHistogram matchTimes{ "stereo match", 0 };
+
+		mutable std::mutex mutex;
+		std::condition_variable pairSubmitted;
+		cv::Mat pendingLeft, pendingRight;		// guarded by mutex, copies of the submitted pair (memory reused)
+		bool pairPending = false;				// guarded by mutex
+		cv::Rect pendingValid;					// guarded by mutex
+		bool stopRequested = false;				// guarded by mutex
+		double focusDepth = 0;					// guarded by mutex
+		double focusTime = 0;					// guarded by mutex, ovr time of the last reliable match (0 = none)
+		std::thread matchingThread;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef STEREORECTIFICATION_H
+#define STEREORECTIFICATION_H
+
+// Joint rectification of the camera pair (see [Camera] StereoCalibration).
+// The stereo calibration file holds the extrinsics between the cameras (R, T: right camera from left camera, as
+// given by cv::stereoCalibrate, T in meters). Rectification (cv::stereoRectify) turns both cameras into parallel
+// ones with the same intrinsics: rows of the two images are aligned, toe-in and keystoning are gone.
+// Undistortion and rectification are one remap per frame, with tables computed once at startup.
+
+#include <memory>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include <aruco.h>
+
+// Remap tables of one camera, for cv::remap() (fixed point: CV_16SC2 + CV_16UC1)
+struct RemapTables
+{
+	cv::Mat map1, map2;
+	cv::Size size;			// image size the tables are for
+	// what they are computed from (cv::initUndistortRectifyMap), at that size: kept to rebuild them for another one
+	cv::Mat cameraMatrix, distortion, rectification, newCameraMatrix;
+};
+
+class StereoRectification
+{
+	public:
+		// Reads the extrinsics and computes both tables. Returns nullptr if the file is missing or either
+		// camera is not calibrated. Throws std::runtime_error if the file is there but unreadable, or if the two
+		// cameras are calibrated at different image sizes (one rectification is computed for both).
+		static std::shared_ptr<StereoRectification> load(const std::string& fileName, const aruco::CameraParameters& left, const aruco::CameraParameters& right);
+
+		std::shared_ptr<const RemapTables> getTables(const int eye) const { return tables[eye]; }
+		// Camera parameters of the rectified images (no distortion): marker detection, depth and video plane FOV use these
+		const aruco::CameraParameters& getRectifiedParameters(const int eye) const { return rectified[eye]; }
+		double getBaseline() const { return baseline; }		// meters
+
+	private:
+		StereoRectification() {}
+
+		std::shared_ptr<const RemapTables> tables[2];
+		aruco::CameraParameters rectified[2];
+		double baseline = 0;
+};
+
+// Tables for undistortion only (no rectification), for a camera without stereo calibration
+std::shared_ptr<const RemapTables> createUndistortTables(const aruco::CameraParameters& camera);
+// Same tables for images of another size (same field of view: intrinsics scaled as aruco::CameraParameters::resize())
+std::shared_ptr<const RemapTables> resizeRemapTables(const RemapTables& tables, const cv::Size& size);
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef SYNTHETICSOURCE_H
+#define SYNTHETICSOURCE_H
+
+// Procedural video source with the same grab()/retrieve() contract as cv::VideoCapture.
+// Frames are generated at the configured rate (grab() blocks until the next frame is due, like a device),
+// so the whole capture, processing, AR and upload path can be exercised and benchmarked without cameras.
+// Features:
+//	- moving patterns (colour bars, checkerboard, gradient) so that motion and upload are realistic
+//	- frame counter printed in the top-left corner
+//	- ArUco markers at scripted poses (projected with the source intrinsics, detectable by aruco::MarkerDetector)
+//	- random timing jitter added to frame delivery
+//	- 8 bit BGR, BGRA or grayscale output
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <aruco.h>
+#include "CaptureSource.h"
+
+class SyntheticSource : public CaptureSource
+{
+	public:
+		enum Pattern
+		{
+			ColourBars,
+			Checkerboard,
+			Gradient
+		};
+
+		// Marker moving on a scripted trajectory (camera reference: x right, y down, z forward, meters)
+		struct Marker
+		{
+			int id = 0;
+			float size = 0.1f;							// side length in meters (as passed to the detector)
+			cv::Point3f position = cv::Point3f(0.0f, 0.0f, 0.5f);
+			cv::Point3f amplitude = cv::Point3f(0.05f, 0.0f, 0.0f);	// position oscillation around position
+			float yawAmplitudeDeg = 20.0f;				// rotation oscillation around marker vertical axis
+			float frequencyHz = 0.25f;
+		};
+
+		struct Settings
+		{
+			int width = 1280;
+			int height = 720;
+			double fps = 30;
+			int pixelType = CV_8UC3;					// CV_8UC3 (BGR), CV_8UC4 (BGRA) or CV_8UC1
+			Pattern pattern = Checkerboard;
+			float patternSpeed = 120.0f;				// pixels per second
+			bool drawFrameCounter = true;
+			std::vector<Marker> markers;
+			double jitterMs = 0;						// each frame is delivered up to jitterMs late (uniform)
+			double hfovDeg = 90;						// horizontal field of view of the simulated lens (intrinsics)
+			std::string name = "synthetic";
+		};
+
+		SyntheticSource() {}
+		explicit SyntheticSource(const Settings& sourceSettings) : settings(sourceSettings) {}
+
+		// CaptureSource (and cv::VideoCapture-like) interface
+		virtual bool open();
+		virtual bool isOpened() const { return opened; }
+		virtual void release() { opened = false; }
+		virtual bool grab();
+		virtual bool retrieve(cv::Mat& out);
+		bool read(cv::Mat& out) { return grab() && retrieve(out); }
+		double get(const int propId) const;
+
+		virtual std::unique_ptr<CaptureSource> createFresh() const { return std::unique_ptr<CaptureSource>(new SyntheticSource(settings)); }
+
+		virtual Capabilities getCapabilities() const;
+		virtual std::string getName() const { return settings.name; }
+		virtual double getFps() const { return settings.fps; }
+		// Pinhole intrinsics of the simulated lens (no distortion), usable for AR detection
+		virtual bool getCameraParameters(aruco::CameraParameters& out) const;
+
+		void setSettings(const Settings& sourceSettings) { settings = sourceSettings; }
+		const Settings& getSettings() const { return settings; }
+
+	private:
+		void renderPattern(cv::Mat& image, const double t) const;
+		void renderMarker(cv::Mat& image, const Marker& marker, const double t) const;
+
+		Settings settings;
+		bool opened = false;
+		unsigned long long frameCount = 0;
+		std::chrono::steady_clock::time_point start_time;
+		std::chrono::steady_clock::time_point nextFrame_time;
+		double grabbedTime = 0;						// seconds since open() of the grabbed frame
+		std::mt19937 random;
+		cv::Mat cameraMatrix;
+		std::vector<cv::Mat> markerImages;			// marker bitmaps with white quiet zone, generated on open()
+		cv::Mat rendered;							// BGR render buffer for BGRA and grey output (see retrieve())
+};
+
+#endif
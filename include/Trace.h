@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Lightweight per-stage latency tracing.
+// Each thread records scoped events (name, begin, end, optional frame id) into its own fixed-size ring
+// buffer: recording never locks and never allocates (only the first event of a thread registers its ring).
+// Rings can be exported at any time, from any thread, as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// Old events are overwritten when a ring is full, so an export always holds the most recent history.
+//
+// Usage:
+//	TRACE_THREAD_NAME("Capture 0");			// once per thread, optional
+//	{ TRACE_SCOPE("grab"); videoCapture.grab(); }
+//	{ TRACE_SCOPE_ID("publish", frameId); set(captured); }
+//
+// Build with OGREOCULUSAPP_TRACING defined (CMake option ENABLE_TRACING) to enable it:
+// otherwise macros expand to nothing and Trace functions are empty inline stubs.
+
+#include <string>
+
+namespace Trace
+{
+#ifdef OGREOCULUSAPP_TRACING
+
+	// Microseconds since the first call (steady clock)
+	double now();
+
+	// Records a complete event on the calling thread ring. Name must be a string literal (pointer is stored).
+	void record(const char* name, const double beginUs, const double endUs, const unsigned long long id);
+
+	void setThreadName(const std::string& name);
+
+	// Writes all rings to a Chrome trace JSON file. Returns false if the file could not be written.
+	bool exportChromeJson(const std::string& fileName);
+
+	// Records the enclosing scope
+	class Scope
+	{
+		public:
+			Scope(const char* eventName, const unsigned long long eventId = 0) : name(eventName), id(eventId), begin(now()) {}
+			~Scope() { record(name, begin, now(), id); }
+		private:
+			const char* name;
+			const unsigned long long id;
+			const double begin;
+	};
+
+	#define TRACE_CONCAT_INNER(a, b) a##b
+	#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+	#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name)
+	#define TRACE_SCOPE_ID(name, id) Trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name, id)
+	#define TRACE_THREAD_NAME(name) Trace::setThreadName(name)
+
+#else
+
+	inline double now() { return 0; }
+	inline void record(const char*, const double, const double, const unsigned long long) {}
+	inline void setThreadName(const std::string&) {}
+	inline bool exportChromeJson(const std::string&) { return false; }
+
+	#define TRACE_SCOPE(name)
+	#define TRACE_SCOPE_ID(name, id)
+	#define TRACE_THREAD_NAME(name)
+
+#endif
+}
+
+#endif
@@ -0,0 +1,38 @@
+#version 130
+
+// Same result as OculusDistortionVertex/Fragment, with the mesh baked into two lookup textures:
+// tan eye angles, vignette and timewarp factor are read per pixel, timewarp is applied here.
+uniform sampler2D diffuseMap;
+uniform sampler2D lookupRG;		// tan eye angles: red channel (xy), green channel (zw)
+uniform sampler2D lookupB;		// tan eye angles: blue channel (xy), vignette (z), timewarp factor (w)
+
+uniform vec2 eyeToSourceUVScale;
+uniform vec2 eyeToSourceUVOffset;
+uniform mat4 eyeRotationStart;
+uniform mat4 eyeRotationEnd;
+
+vec2 timewarpTexCoord( vec2 texCoord, mat4 rotMat )
+{
+	vec3 transformed =  (rotMat * vec4( texCoord.xy, 1, 1) ).xyz;
+	
+	vec2 flattened = transformed.xy / transformed.z;
+	
+	return eyeToSourceUVScale * flattened + eyeToSourceUVOffset;
+}
+
+void main(void)
+{
+	vec4 tanEyeAnglesRG = texture2D(lookupRG, gl_TexCoord[0].xy);
+	vec4 tanEyeAnglesB = texture2D(lookupB, gl_TexCoord[0].xy);
+
+	// TIMEWARPING (lerp() between eye start and end matrices by timewarp factor)
+	float timewarpLerpFactor = tanEyeAnglesB.w;
+	mat4 lerpedEyeRot = eyeRotationStart * (1 - timewarpLerpFactor) + eyeRotationEnd * timewarpLerpFactor;
+
+	float red = texture2D(diffuseMap, timewarpTexCoord( tanEyeAnglesRG.xy, lerpedEyeRot )).r;
+	float green = texture2D(diffuseMap, timewarpTexCoord( tanEyeAnglesRG.zw, lerpedEyeRot )).g;
+	float blue = texture2D(diffuseMap, timewarpTexCoord( tanEyeAnglesB.xy, lerpedEyeRot )).b;
+
+	// Multiply fragment colour by vignette factor
+	gl_FragColor = vec4( red, green, blue, 1.0 ) * tanEyeAnglesB.z;
+}
@@ -0,0 +1,14 @@
+#version 130
+
+// Values automatically defined by Ogre/OpenGL:
+attribute vec4 vertex;
+attribute vec2 uv0;			// Lookup texture coordinates (quad covering the distortion mesh area)
+
+// Load in values defined in the material:
+uniform mat4 worldViewProj;
+
+void main(void)
+{
+	gl_TexCoord[0] = vec4( uv0, 0.0, 0.0 );
+	gl_Position = worldViewProj * vertex;
+}
@@ -2,7 +2,7 @@
 
 // Values automatically defined by Ogre/OpenGL:
 attribute vec4 vertex;
-attribute vec2 uv0;			// Red channel
+attribute vec2 uv0;			// Red channel (quantized tan eye angles, see tanEyeAngleScale)
 attribute vec2 uv1;			// Green channel
 attribute vec2 uv2;			// Blue channel
 attribute vec4 colour;		// Vertex Colour (here: x=y=z=vignette, w=timewarp)
@@ -11,6 +11,7 @@ attribute vec4 colour;		// Vertex Colour (here: x=y=z=vignette, w=timewarp)
 uniform mat4 worldViewProj;
 uniform vec2 eyeToSourceUVScale;
 uniform vec2 eyeToSourceUVOffset;
+uniform float tanEyeAngleScale;		// uv0..uv2 are 16-bit integers: this turns them back into tan eye angles
 uniform mat4 eyeRotationStart;
 uniform mat4 eyeRotationEnd;
 
@@ -18,7 +19,7 @@ varying vec4 gl_FrontColor;
 
 vec2 timewarpTexCoord( vec2 texCoord, mat4 rotMat )
 {
-	vec3 transformed =  (rotMat * vec4( texCoord.xy, 1, 1) ).xyz;
+	vec3 transformed =  (rotMat * vec4( texCoord.xy * tanEyeAngleScale, 1, 1) ).xyz;
 	
 	vec2 flattened = transformed.xy / transformed.z;
 	
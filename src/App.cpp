@@ -1,23 +1,8 @@
 #include "App.h"
 #include <chrono>
 #include <thread>
-
-void frames_per_second(double delay)
-{
-	static int num_frame = 0;
-	static int time = 0;
-
-	num_frame++;
-	time += delay;
-	std::cout<<delay<<std::endl;
-	if (time >= 1000)
-	{
-		std::cout << "\tFPS:" << num_frame << std::endl;
-		num_frame = 0;
-		time = 0;
-	}
-
-}
+#include <fstream>
+#include <cstdio>
 
 //Globals used only in App.cpp
 std::chrono::steady_clock::time_point ogre_last_frame_displayed_time = std::chrono::steady_clock::now();
@@ -96,6 +81,12 @@ App::~App()
 {
 	std::cout << "Deleting Ogre application." << std::endl;
 
+	writeTimingHistograms();
+	if (mSimulation) delete mSimulation;		// stops polling the cameras
+	if (mStereoDepth) delete mStereoDepth;
+	if (mLatencyProbe) delete mLatencyProbe;
+	if (mQualityGovernor) delete mQualityGovernor;
+	if (mFramePacer) delete mFramePacer;
 	quitCameras();
 	quitRift();
 
@@ -119,9 +110,69 @@ void App::loadConfig(const std::string& configurationFilesPath)
 	// Overwrite default parameters values
 	CAMERA_BUFFERING_DELAY = mConfig->getValueAsInt("Camera/BufferingDelay");
 	ROTATE_VIEW = mConfig->getValueAsBool("Oculus/RotateView");
+	if (mConfig->getKeyExists("Oculus/SharedEyeTexture")) sharedEyeTexture = mConfig->getValueAsBool("Oculus/SharedEyeTexture");
+	if (mConfig->getKeyExists("Oculus/StereoCulling")) stereoCulling = mConfig->getValueAsBool("Oculus/StereoCulling");
+	if (mConfig->getKeyExists("Oculus/DistortionMeshCache")) distortionMeshCache = mConfig->getValueAsString("Oculus/DistortionMeshCache");
+	if (mConfig->getKeyExists("Oculus/Reprojection")) reprojection = mConfig->getValueAsBool("Oculus/Reprojection");
+	if (mConfig->getKeyExists("Oculus/LateLatch")) lateLatch = mConfig->getValueAsBool("Oculus/LateLatch");
+	if (mConfig->getKeyExists("Oculus/LateLatchPadding")) lateLatchPadding = mConfig->getValueAsReal("Oculus/LateLatchPadding");
+	if (mConfig->getKeyExists("Oculus/DistortionMode")) distortionLookup = (mConfig->getValueAsString("Oculus/DistortionMode") == "lookup");
+	if (mConfig->getKeyExists("Oculus/DistortionLookupScale")) distortionLookupScale = mConfig->getValueAsReal("Oculus/DistortionLookupScale");
 	CAMERA_TOEIN_ANGLE = mConfig->getValueAsInt("Camera/CameraToeInAngle");
 	std::cout<<"ANGOLOOOO"<<CAMERA_TOEIN_ANGLE<<std::endl;
 	CAMERA_KEYSTONING_ANGLE = mConfig->getValueAsInt("Camera/CameraKeystoningAngle");
+	if (mConfig->getKeyExists("Statistics/ReportInterval")) timingReportInterval = mConfig->getValueAsInt("Statistics/ReportInterval");
+	if (mConfig->getKeyExists("Statistics/HistogramsFile")) timingHistogramsFile = mConfig->getValueAsString("Statistics/HistogramsFile");
+	if (mConfig->getKeyExists("Pacing/Mode"))
+	{
+		std::string pacing = mConfig->getValueAsString("Pacing/Mode");
+		framePacing = pacing == "fixed" ? FixedRate : (pacing == "off" ? NoPacing : VsyncPacing);
+	}
+	if (mConfig->getKeyExists("Pacing/VsyncInterval")) pacerSettings.vsyncInterval = mConfig->getValueAsInt("Pacing/VsyncInterval");
+	if (mConfig->getKeyExists("Pacing/SpinMs")) pacerSettings.spinMs = mConfig->getValueAsReal("Pacing/SpinMs");
+	if (mConfig->getKeyExists("Pacing/StartOffsetMs")) pacerSettings.startOffsetMs = mConfig->getValueAsReal("Pacing/StartOffsetMs");
+	if (mConfig->getKeyExists("Pacing/VSync")) vsync = mConfig->getValueAsBool("Pacing/VSync");
+	if (mConfig->getKeyExists("Simulation/Thread")) simulationThread = mConfig->getValueAsBool("Simulation/Thread");
+	if (mConfig->getKeyExists("Simulation/TickRate")) simulationTickRate = mConfig->getValueAsReal("Simulation/TickRate");
+	if (mConfig->getKeyExists("StereoDepth/Enabled")) stereoDepthEnabled = mConfig->getValueAsBool("StereoDepth/Enabled");
+	if (mConfig->getKeyExists("StereoDepth/Scale")) stereoDepthSettings.scale = mConfig->getValueAsReal("StereoDepth/Scale");
+	if (mConfig->getKeyExists("StereoDepth/RoiSize")) stereoDepthSettings.roiSize = mConfig->getValueAsReal("StereoDepth/RoiSize");
+	if (mConfig->getKeyExists("StereoDepth/Disparities")) stereoDepthSettings.disparities = mConfig->getValueAsInt("StereoDepth/Disparities");
+	if (mConfig->getKeyExists("StereoDepth/BlockSize")) stereoDepthSettings.blockSize = mConfig->getValueAsInt("StereoDepth/BlockSize");
+	if (mConfig->getKeyExists("StereoDepth/SmoothingSeconds")) stereoDepthSettings.smoothingSeconds = mConfig->getValueAsReal("StereoDepth/SmoothingSeconds");
+	if (mConfig->getKeyExists("Camera/RegionOfInterest")) videoRegionOfInterest = mConfig->getValueAsBool("Camera/RegionOfInterest");
+	if (mConfig->getKeyExists("Camera/RegionOfInterestMargin")) videoRegionMargin = mConfig->getValueAsReal("Camera/RegionOfInterestMargin");
+	if (mConfig->getKeyExists("Fisheye/Projection"))
+	{
+		std::string projection = mConfig->getValueAsString("Fisheye/Projection");
+		if (projection == "equidistant") fisheyeLens.projection = Scene::FisheyeLens::Equidistant;
+		else if (projection == "equisolid") fisheyeLens.projection = Scene::FisheyeLens::Equisolid;
+		else if (projection == "stereographic") fisheyeLens.projection = Scene::FisheyeLens::Stereographic;
+		else fisheyeLens.projection = Scene::FisheyeLens::Orthographic;
+	}
+	if (mConfig->getKeyExists("Fisheye/Fov")) fisheyeLens.fovDegrees = mConfig->getValueAsReal("Fisheye/Fov");
+	if (mConfig->getKeyExists("Fisheye/K1")) fisheyeLens.k[0] = mConfig->getValueAsReal("Fisheye/K1");
+	if (mConfig->getKeyExists("Fisheye/K2")) fisheyeLens.k[1] = mConfig->getValueAsReal("Fisheye/K2");
+	if (mConfig->getKeyExists("Fisheye/K3")) fisheyeLens.k[2] = mConfig->getValueAsReal("Fisheye/K3");
+	if (mConfig->getKeyExists("Fisheye/K4")) fisheyeLens.k[3] = mConfig->getValueAsReal("Fisheye/K4");
+	if (mConfig->getKeyExists("Fisheye/Rings")) fisheyeLens.rings = mConfig->getValueAsInt("Fisheye/Rings");
+	if (mConfig->getKeyExists("Fisheye/Segments")) fisheyeLens.segments = mConfig->getValueAsInt("Fisheye/Segments");
+	if (mConfig->getKeyExists("Benchmark/Frames")) benchmarkFrames = mConfig->getValueAsInt("Benchmark/Frames");
+	if (mConfig->getKeyExists("Benchmark/WarmupFrames")) benchmarkWarmupFrames = mConfig->getValueAsInt("Benchmark/WarmupFrames");
+	if (mConfig->getKeyExists("Benchmark/ReportFile")) benchmarkReportFile = mConfig->getValueAsString("Benchmark/ReportFile");
+#ifdef _DEBUG
+	qualitySettings.maxFsaa = 0;
+#endif
+	if (mConfig->getKeyExists("Quality/Adaptive")) adaptiveQuality = mConfig->getValueAsBool("Quality/Adaptive");
+	if (mConfig->getKeyExists("Quality/MinDensity")) qualitySettings.minDensity = mConfig->getValueAsReal("Quality/MinDensity");
+	if (mConfig->getKeyExists("Quality/MaxDensity")) qualitySettings.maxDensity = mConfig->getValueAsReal("Quality/MaxDensity");
+	if (mConfig->getKeyExists("Quality/DensityStep")) qualitySettings.densityStep = mConfig->getValueAsReal("Quality/DensityStep");
+	if (mConfig->getKeyExists("Quality/MSAA")) qualitySettings.maxFsaa = mConfig->getValueAsInt("Quality/MSAA");
+	if (mConfig->getKeyExists("Quality/BudgetMs"))
+	{
+		qualitySettings.budgetMs = mConfig->getValueAsReal("Quality/BudgetMs");
+		qualityBudgetSet = true;
+	}
 	if (CAMERA_TOEIN_ANGLE < 0 || CAMERA_TOEIN_ANGLE >= 90) CAMERA_TOEIN_ANGLE = 0;
 
 }
@@ -144,6 +195,16 @@ void App::initWindows()
 
 	loadOgreWindows();
 
+	if (BENCHMARK)
+	{
+		// Nothing on screen: a hidden window owns the GL context, the Rift output goes to a texture
+		Ogre::NameValuePairList miscParams;
+		miscParams["hidden"] = "true";
+		mContextWindow = mRoot->createRenderWindow("Oculus Rift Benchmark", 64, 64, false, &miscParams);
+		mRiftViewTexture = mRift->createRiftDisplayTexture(mRoot);
+		return;
+	}
+
 	mRiftViewWindow = mRift->createRiftDisplayWindow(mRoot);
 #ifdef _DEBUG
 	mDebugRiftViewWindow = mRift->createDebugRiftDisplayWindow(mRoot);
@@ -152,7 +213,8 @@ void App::initWindows()
 
 void App::initIO()
 {
-	initOIS();
+	// no window to take input from in benchmark mode
+	if (!BENCHMARK) initOIS();
 }
 
 void App::initResources()
@@ -166,42 +228,76 @@ void App::initResources()
 void App::initScenes()
 {
 	// Create Rift inner scene (for stereo vision and lens distortion)
-	mRift->createRiftDisplayScene(mRoot);
+	// Eye textures: the latency probe reads the left eye texture as a whole (no shared texture)
+	mRift->setSharedEyeTexture(sharedEyeTexture && !LATENCY_PROBE);
+	mRift->setDistortionMeshCache(distortionMeshCache);
+	mRift->setDistortionLookupScale(distortionLookupScale);
+	mRift->setDistortionMode(distortionLookup ? Rift::DistortionMode::Lookup : Rift::DistortionMode::Mesh);
+	mRift->setIdleWorkQueue(&mIdleWork);
+	// adaptive quality is off for measurement runs (latency probe reads the whole eye texture, benchmarks compare fixed quality)
+	if (adaptiveQuality && !LATENCY_PROBE && !BENCHMARK)
+	{
+		mQualityGovernor = new QualityGovernor(qualitySettings);
+		mRift->createRiftDisplayScene(mRoot, mQualityGovernor->getBestLevel().pixelDensity, mQualityGovernor->getLevel().fsaa);
+	}
+	else
+	{
+		mRift->createRiftDisplayScene(mRoot, 1.0f, qualitySettings.maxFsaa);
+	}
 
 	// Create Ogre main scene
 	mScene = new Scene(mRoot, mMouse, mKeyboard);
+	mScene->setFisheyeLens(fisheyeLens);		// used by the Fisheye camera model only
 	//if (mOverlaySystem)	mScene->getSceneMgr()->addRenderQueueListener(mOverlaySystem);	//Only Ogre main scene will render overlays!
-	try
+	if (mStereoRectification)
 	{
-		// try first to load HFOV/VFOV values (higher priority)
-		mScene->setupVideo(Scene::CameraModel::Pinhole, Scene::StabilizationModel::Eye, Ogre::Vector3::ZERO, mConfig->getValueAsReal("Camera/HFOV"), mConfig->getValueAsReal("Camera/VFOV"));
+		// rectified images have the focal length picked by cv::stereoRectify (alpha 0: cropped to valid pixels), not the one
+		// of the configured camera: the plane FOV comes from it (principal point taken as centred, as the plane is)
+		const aruco::CameraParameters& rectified = mStereoRectification->getRectifiedParameters(0);
+		float hFov = 2 * std::atan(rectified.CamSize.width / (2 * rectified.CameraMatrix.at<float>(0, 0))) * 180 / Ogre::Math::PI;
+		float vFov = 2 * std::atan(rectified.CamSize.height / (2 * rectified.CameraMatrix.at<float>(1, 1))) * 180 / Ogre::Math::PI;
+		std::cout << "Video planes from the rectified cameras: " << hFov << "x" << vFov << " degrees." << std::endl;
+		mScene->setupVideo(Scene::CameraModel::Pinhole, Scene::StabilizationModel::Eye, Ogre::Vector3::ZERO, hFov, vFov);
 	}
-	catch (Ogre::Exception &e)
+	else
 	{
-		// in case one of these parameters is not found in configuration file or is invalid...
-		if (e.getNumber() == Ogre::Exception::ERR_ITEM_NOT_FOUND || e.getNumber() == Ogre::Exception::ERR_INVALIDPARAMS)
+		try
+		{
+			// try first to load HFOV/VFOV values (higher priority)
+			mScene->setupVideo(Scene::CameraModel::Pinhole, Scene::StabilizationModel::Eye, Ogre::Vector3::ZERO, mConfig->getValueAsReal("Camera/HFOV"), mConfig->getValueAsReal("Camera/VFOV"));
+		}
+		catch (Ogre::Exception &e)
 		{
-			try
+			// in case one of these parameters is not found in configuration file or is invalid...
+			if (e.getNumber() == Ogre::Exception::ERR_ITEM_NOT_FOUND || e.getNumber() == Ogre::Exception::ERR_INVALIDPARAMS)
 			{
-				// ..try to load other parameters (these are preferred, but lower priority since not everyone know these)
-				mScene->setupVideo(Scene::CameraModel::Pinhole, Scene::StabilizationModel::Eye, Ogre::Vector3::ZERO, mConfig->getValueAsReal("Camera/SensorWidth"), mConfig->getValueAsReal("Camera/SensorHeight"), mConfig->getValueAsReal("Camera/FocalLenght"));
+				try
+				{
+					// ..try to load other parameters (these are preferred, but lower priority since not everyone know these)
+					mScene->setupVideo(Scene::CameraModel::Pinhole, Scene::StabilizationModel::Eye, Ogre::Vector3::ZERO, mConfig->getValueAsReal("Camera/SensorWidth"), mConfig->getValueAsReal("Camera/SensorHeight"), mConfig->getValueAsReal("Camera/FocalLenght"));
+				}
+				catch (Ogre::Exception &e)
+				{
+					// if another exception is thrown (any), forward
+					throw e;
+				}
 			}
-			catch (Ogre::Exception &e)
+			// if another exception is thrown, forward
+			else
 			{
-				// if another exception is thrown (any), forward
 				throw e;
 			}
 		}
-		// if another exception is thrown, forward
-		else
-		{
-			throw e;
-		}
 	}
 	
 	// Setup Ogre main scene in respect to Oculus parameters
 	mScene->setIPD(mRift->getIPD());												// adjust IPD
 	mRift->setCameraMatrices(mScene->getLeftCamera(), mScene->getRightCamera());	// adjust matrices
+	if (stereoCulling)
+	{
+		ovrFovPort combinedFov = mRift->getCombinedEyeFov(lateLatch ? lateLatchPadding : 0.0f);
+		mScene->enableStereoCulling(combinedFov.LeftTan, combinedFov.RightTan, combinedFov.UpTan, combinedFov.DownTan);
+	}
 	mScene->setVideoLeftTextureCalibrationAspectRatio(1.77778f);
 
 	// DEBUG
@@ -215,9 +311,11 @@ void App::initViewports()
 	// Link Ogre stereo cameras to Oculus distortion meshes
 	// (to be rendered into Oculus window through Oculus ortho camera)
 	mRift->attachCameras(mScene->getLeftCamera(), mScene->getRightCamera());
+	if (lateLatch) mRift->setLateLatch(true, lateLatchPadding);
 
-	// Link orthographic inner scene Oculus camera to Oculus rendering window
-	Ogre::Viewport* oculusView = mRiftViewWindow->addViewport(mRift->getCamera());
+	// Link orthographic inner scene Oculus camera to Oculus rendering window (or its offscreen texture)
+	Ogre::RenderTarget* riftViewTarget = mRiftViewTexture ? (Ogre::RenderTarget*)mRiftViewTexture : mRiftViewWindow;
+	Ogre::Viewport* oculusView = riftViewTarget->addViewport(mRift->getCamera());
 	oculusView->setBackgroundColour(Ogre::ColourValue::Black);
 	oculusView->setOverlaysEnabled(true);
 
@@ -229,6 +327,14 @@ void App::initViewports()
 		oculusDebugView->setOverlaysEnabled(true);
 	}
 
+	// Video latency measurement (listens to the left eye texture, after Rift)
+	if (LATENCY_PROBE)
+	{
+		mLatencyProbe = new LatencyProbe(mRoot, mScene, mRift->getEyeTexture(0));
+		if (mCameraLeft) mCameraLeft->setFrameStamping(true);
+		if (mCameraRight) mCameraRight->setFrameStamping(true);
+	}
+
 	// Link other Ogre cameras to debug windows
 	if (mLeftEyeViewWindow)
 	{
@@ -264,7 +370,8 @@ void App::start()
 
 
 	// TIME VARIABLES FOR MANUAL RENDERING TIME
-	int fps = FORCE_3D_RENDERING_FPS;
+	// benchmark measures how fast frames can be rendered
+	int fps = (BENCHMARK || framePacing != FixedRate) ? 0 : FORCE_3D_RENDERING_FPS;
 	std::chrono::duration< double, std::micro > frame_delay;
 	if(fps<=0) frame_delay = std::chrono::duration< double, std::micro >::zero();
 	else frame_delay = std::chrono::microseconds(1000000/fps);
@@ -275,9 +382,52 @@ void App::start()
     std::chrono::duration< double, std::micro > needed_sleep_delay = std::chrono::duration< double, std::micro >::zero();
     // Save this moment as the application start time (to sync other concurrent threads)
 	loopStart_time = std::chrono::steady_clock::now();
-	// Initialize fps count
-	std::chrono::steady_clock::time_point currentSecondStart_time = loopStart_time;
-	unsigned int currentSecondNumFramesRendered = 0;
+	// Initialize timing report
+	std::chrono::steady_clock::time_point lastReport_time = loopStart_time;
+	std::chrono::steady_clock::time_point lastRenderStart_time = loopStart_time;
+	bool firstFrame = true;
+	// Benchmark: video is started right away, frames are counted once it streams
+	unsigned int benchmarkFrame = 0;
+	std::chrono::steady_clock::time_point benchmarkStart_time = loopStart_time;
+	if (BENCHMARK)
+	{
+		bool accepted = true;
+		if (mCameraLeft) accepted = mCameraLeft->startCapture() && accepted;
+		if (mCameraRight) accepted = mCameraRight->startCapture() && accepted;
+		if (accepted)
+			seethroughPending = true;
+		std::cout << "Benchmark: " << benchmarkWarmupFrames << " warm-up frames, " << benchmarkFrames << " measured frames." << std::endl;
+	}
+
+	// FRAME PACING: on the HMD refresh, so that frames start at the same phase of every vsync
+	double frameBudgetMs = 1000.0 / FORCE_3D_RENDERING_FPS;
+	if (framePacing != FixedRate)
+	{
+		pacerSettings.refreshRate = mRift->getRefreshRate();
+		frameBudgetMs = 1000.0 / pacerSettings.refreshRate;
+	}
+	if (framePacing == VsyncPacing && !BENCHMARK)
+	{
+		mFramePacer = new FramePacer(pacerSettings);
+		frameBudgetMs = mFramePacer->getFramePeriodMs();
+		std::cout << "Frame pacing: " << pacerSettings.refreshRate / pacerSettings.vsyncInterval << " fps, on the HMD vsync." << std::endl;
+	}
+	renderFrameTimes.budgetMs = frameBudgetMs;
+	uploadTimes.budgetMs = frameBudgetMs;
+	mRift->setFrameBudget(frameBudgetMs);
+	if (mLatencyProbe) mLatencyProbe->setFrameBudget(frameBudgetMs);
+	// adaptive quality keeps frames within the same budget, unless one is configured
+	if (mQualityGovernor && !qualityBudgetSet)
+		mQualityGovernor->setBudget(frameBudgetMs);
+	if (mQualityGovernor)
+		std::cout << "Adaptive quality: " << mQualityGovernor->getSettings().budgetMs << " ms frame budget." << std::endl;
+
+	TRACE_THREAD_NAME("Render");
+	if (simulationThread)
+	{
+		mSimulation->start(simulationTickRate);
+		std::cout << "Simulation thread: " << simulationTickRate << " ticks per second." << std::endl;
+	}
 
 	// START MANUAL RENDERING!
 	// This allows us to control when each frame is rendered (limiting frame rate)
@@ -287,8 +437,79 @@ void App::start()
 		Ogre::WindowEventUtilities::messagePump();
 
     	//if (mWindow->isClosed()) return false;
-		if (!mRoot->renderOneFrame()) mShutdown = true;
-		currentSecondNumFramesRendered++;
+		// frame time is measured between consecutive frame starts (what the user actually sees)
+		std::chrono::steady_clock::time_point renderStart_time = std::chrono::steady_clock::now();
+		if (!firstFrame) renderFrameTimes.add(std::chrono::duration< double, std::milli >(renderStart_time - lastRenderStart_time).count());
+		lastRenderStart_time = renderStart_time;
+		firstFrame = false;
+
+		// SIMULATION: latest snapshot applied in one pass (ticked here when it has no thread of its own)
+		if (!mSimulation->isThreaded()) mSimulation->tick();
+		applySimulationSnapshot();
+
+		// IDLE WORK: video upload queued for the wait before the timewarp point (flushed in frameRenderingQueued()
+		// if it does not fit). Estimate: twice the p90 upload time, so that a slow upload does not delay the timewarp.
+		if (mVideoSnapshot)
+		{
+			double uploadEstimateMs = uploadTimes.total.getCount() > 0 ? 2 * uploadTimes.total.getPercentile(0.9) : 2.0;
+			mIdleWork.post("video upload", uploadEstimateMs, [this]() { updateVideoTextures(); });
+		}
+		{
+			TRACE_SCOPE("renderOneFrame");
+			if (!mRoot->renderOneFrame()) mShutdown = true;
+		}
+
+		// REGION OF INTEREST: video planes were moved (calibration, FOV, IPD, toe-in), tell cameras what is visible now
+		// (after rendering: node transforms are up to date)
+		if (videoRegionOfInterest && mScene->getVideoLayoutVersion() != appliedVideoLayout)
+			updateVideoRegions();
+
+		// busy time of the frame (render, minus the wait for the timewarp point)
+		double busyMs = std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - renderStart_time).count() - mRift->getLastWaitMs();
+		bool reprojectedFrame = mRift->isReprojectionFrame();
+
+		// REPROJECTION: a rendered frame that missed the budget delivered late, so the next display frame does not
+		// render the scene again but re-presents the last eye images, timewarped to the newest pose (no judder on
+		// sustained overload: the scene is rendered every other display frame, every frame shows the current pose)
+		// Off for measurement runs (they need every frame rendered).
+		if (reprojection && !BENCHMARK && !LATENCY_PROBE)
+			mRift->setReprojectionFrame(!reprojectedFrame && busyMs > frameBudgetMs);
+
+		// ADAPTIVE QUALITY: busy time of rendered frames decides eye texture quality
+		if (mQualityGovernor && !reprojectedFrame)
+		{
+			if (mQualityGovernor->addFrame(busyMs))
+			{
+				QualityGovernor::Level level = mQualityGovernor->getLevel();
+				mRift->setEyeRenderQuality(level.pixelDensity, level.fsaa);
+				std::cout << "Eye render quality: pixel density " << level.pixelDensity << ", MSAA " << level.fsaa << std::endl;
+			}
+		}
+
+		// BENCHMARK: drop warm-up samples, stop after the measured frames and report
+		if (BENCHMARK && !seethroughPending)
+		{
+			benchmarkFrame++;
+			if (benchmarkFrame == benchmarkWarmupFrames)
+			{
+				renderFrameTimes.reset();
+				uploadTimes.reset();
+				mIdleWork.getIdleWorkTimes().reset();
+				mRift->getEyePassTimes().reset();
+				mRift->getTimewarpSetupTimes().reset();
+				mRift->getEyeRenderTimes(0).reset();
+				mRift->getEyeRenderTimes(1).reset();
+				if (mCameraLeft) mCameraLeft->getGrabIntervals().reset();
+				if (mCameraRight) mCameraRight->getGrabIntervals().reset();
+				firstFrame = true;
+				benchmarkStart_time = std::chrono::steady_clock::now();
+			}
+			else if (benchmarkFrame >= benchmarkWarmupFrames + benchmarkFrames)
+			{
+				writeBenchmarkReport(std::chrono::duration< double >(std::chrono::steady_clock::now() - benchmarkStart_time).count());
+				mShutdown = true;
+			}
+		}
 		//if (mPause)
 			//mScene->getSceneMgr()->_pauseRendering();
 
@@ -316,6 +537,8 @@ void App::start()
 				//sleep(fps/1000000); // this would be ok if we ignored computation time and wakeup_jitter
 			#endif			
 		}
+		// VSYNC PACING: sleep/spin to the vsync the last frame is predicted to be shown at
+		if (mFramePacer) mFramePacer->waitForFrameStart(mRift->getPredictedVsync());
 		//BEGIN: save now() as the time loop begins
 		frameStart_time = std::chrono::steady_clock::now();
 		//compute the jitter as the time it took this thread to wake-up since the time it had to wake up (in ideal world, wake_jitter would be 0...)
@@ -327,13 +550,12 @@ void App::start()
 				//cout<< "there was a wakeup jitter of : "<<std::chrono::duration_cast<std::chrono::microseconds>(wakeup_jitter).count()<<endl;				// computed jitter
 
 
-		// DISPLAY FPS
-		if(std::chrono::steady_clock::now() > currentSecondStart_time + std::chrono::seconds(1))
+		// DISPLAY TIMING REPORT (percentiles catch the hitches an average FPS would hide)
+		// (printed in the next wait before the timewarp point, if it fits)
+		if (timingReportInterval > 0 && std::chrono::steady_clock::now() > lastReport_time + std::chrono::seconds(timingReportInterval))
 		{
-			
-			std::cout << "\tFPS:" << currentSecondNumFramesRendered << std::endl;
-			currentSecondNumFramesRendered = 0;
-			currentSecondStart_time = currentSecondStart_time + std::chrono::seconds(1);
+			mIdleWork.post("timing report", 1.0, [this]() { printTimingReport(); });
+			lastReport_time = std::chrono::steady_clock::now();
 		}
 		
 	}
@@ -387,12 +609,9 @@ void App::initOgre()
 	Ogre::ConfigOptionMap cfgMap = pRS->getConfigOptions();
 	// Modify them
 	cfgMap["Full Screen"].currentValue = "No";
-	cfgMap["VSync"].currentValue = "Yes";
-	#ifdef _DEBUG
-		cfgMap["FSAA"].currentValue = "0";
-	#else
-		cfgMap["FSAA"].currentValue = "8";
-	#endif
+	cfgMap["VSync"].currentValue = (vsync && !BENCHMARK) ? "Yes" : "No";	// benchmark must not be throttled by the display
+	// the window only shows the distortion meshes: antialiasing is done on eye textures (see [Quality] MSAA)
+	cfgMap["FSAA"].currentValue = "0";
 	cfgMap["Video Mode"].currentValue = "1200 x 800";
 	// Set them back into the RenderSystem
 	for(Ogre::ConfigOptionMap::iterator iter = cfgMap.begin(); iter != cfgMap.end(); iter++) pRS->setConfigOption(iter->first, iter->second.currentValue);
@@ -638,7 +857,10 @@ void App::initRift()
 	try {
 		// This class implements a custom C++ Class version of RIFT C API
 		//Rift::init();		//OPTIONAL: automatically called by Rift constructor, if necessary
-		mRift = new Rift( 0, mRoot, mRiftViewWindow /*if null, Rift creates the window*/, ROTATE_VIEW );
+		if (SCRIPTED_HMD)
+			mRift = new Rift( std::unique_ptr<HmdDevice>(new ScriptedHmdDevice(loadScriptedHmdSettings())), mRoot, mRiftViewWindow, ROTATE_VIEW );
+		else
+			mRift = new Rift( 0, mRoot, mRiftViewWindow /*if null, Rift creates the window*/, ROTATE_VIEW );
 	}
 	catch (const std::ios_base::failure& e) {
 		std::cout << ">> " << e.what() << std::endl;
@@ -646,6 +868,44 @@ void App::initRift()
 		mRift = NULL;
 		mShutdown = true;
 	}
+	catch (const std::runtime_error& e) {
+		// i.e. scripted HMD pose trace not found
+		std::cout << ">> " << e.what() << std::endl;
+		mRift = NULL;
+		mShutdown = true;
+	}
+}
+
+// Scripted HMD settings from [ScriptedHmd] section (every key is optional)
+ScriptedHmdDevice::Settings App::loadScriptedHmdSettings()
+{
+	ScriptedHmdDevice::Settings settings;
+	if (mConfig->getKeyExists("ScriptedHmd/Profile"))
+	{
+		std::string profile = mConfig->getValueAsString("ScriptedHmd/Profile");
+		if (profile == "Static") settings.profile = ScriptedHmdDevice::Static;
+		else if (profile == "Figure8") settings.profile = ScriptedHmdDevice::Figure8;
+		else if (profile == "Trace") settings.profile = ScriptedHmdDevice::Trace;
+		else settings.profile = ScriptedHmdDevice::Yaw;
+	}
+	if (mConfig->getKeyExists("ScriptedHmd/TraceFile")) settings.traceFile = mConfig->getValueAsString("ScriptedHmd/TraceFile");
+	if (mConfig->getKeyExists("ScriptedHmd/Amplitude")) settings.amplitudeDeg = mConfig->getValueAsReal("ScriptedHmd/Amplitude");
+	if (mConfig->getKeyExists("ScriptedHmd/Frequency")) settings.frequencyHz = mConfig->getValueAsReal("ScriptedHmd/Frequency");
+	if (mConfig->getKeyExists("ScriptedHmd/SimulateVsync")) settings.simulateVsync = mConfig->getValueAsBool("ScriptedHmd/SimulateVsync");
+	if (mConfig->getKeyExists("ScriptedHmd/RefreshRate")) settings.refreshRate = mConfig->getValueAsReal("ScriptedHmd/RefreshRate");
+	return settings;
+}
+
+FaultInjectingSource::Settings App::loadFaultInjectionSettings()
+{
+	FaultInjectingSource::Settings settings;
+	if (mConfig->getKeyExists("FaultInjection/DropoutInterval")) settings.dropoutIntervalSeconds = mConfig->getValueAsReal("FaultInjection/DropoutInterval");
+	if (mConfig->getKeyExists("FaultInjection/DropoutFrames")) settings.dropoutFrames = mConfig->getValueAsInt("FaultInjection/DropoutFrames");
+	if (mConfig->getKeyExists("FaultInjection/FailedReopens")) settings.failedReopens = mConfig->getValueAsInt("FaultInjection/FailedReopens");
+	if (mConfig->getKeyExists("FaultInjection/HangInterval")) settings.hangIntervalSeconds = mConfig->getValueAsReal("FaultInjection/HangInterval");
+	if (mConfig->getKeyExists("FaultInjection/HangSeconds")) settings.hangSeconds = mConfig->getValueAsReal("FaultInjection/HangSeconds");
+	if (mConfig->getKeyExists("FaultInjection/HangsLikeDevice")) settings.hangsLikeDevice = mConfig->getValueAsBool("FaultInjection/HangsLikeDevice");
+	return settings;
 }
 
 void App::quitRift()
@@ -663,19 +923,281 @@ void App::initCameras()
 {
 	//std::string videoFile = "thcrossing1.mp4";
 	//mCameraLeft = new FrameCaptureHandler(videoFile, mRift, false);
-	mCameraLeft = new FrameCaptureHandler(0, mRift, true, loopStart_time, 25);	//device_id, mRift, ARenable, starttimereference, fps
-	mCameraRight = new FrameCaptureHandler(1, mRift, false, loopStart_time, 25);
+	if (SYNTHETIC_SOURCE)
+	{
+		SyntheticSource::Settings left = loadSyntheticSettings("synthetic left");
+		SyntheticSource::Settings right = loadSyntheticSettings("synthetic right");
+		mCameraLeft = new FrameCaptureHandler(left, mRift, true, loopStart_time, (unsigned short int)left.fps);
+		mCameraRight = new FrameCaptureHandler(right, mRift, false, loopStart_time, (unsigned short int)right.fps);
+	}
+	else
+	{
+		mCameraLeft = new FrameCaptureHandler(0, mRift, true, loopStart_time, 25);	//device_id, mRift, ARenable, starttimereference, fps
+		mCameraRight = new FrameCaptureHandler(1, mRift, false, loopStart_time, 25);
+
+		// joint undistortion and rectification of the pair, if the extrinsics between the cameras are known
+		if (mConfig->getKeyExists("Camera/StereoCalibration"))
+			mStereoRectification = StereoRectification::load(mConfig->getValueAsString("Camera/StereoCalibration"), mCameraLeft->videoCaptureParams, mCameraRight->videoCaptureParams);
+		if (mStereoRectification)
+		{
+			mCameraLeft->setRectification(mStereoRectification->getTables(0), mStereoRectification->getRectifiedParameters(0));
+			mCameraRight->setRectification(mStereoRectification->getTables(1), mStereoRectification->getRectifiedParameters(1));
+			// rectified images are those of parallel cameras: no toe-in nor keystoning left to correct in the scene
+			CAMERA_TOEIN_ANGLE = 0;
+			CAMERA_KEYSTONING_ANGLE = 0;
+			std::cout << "Cameras rectified: baseline " << mStereoRectification->getBaseline() * 1000 << " mm." << std::endl;
+		}
+	}
+	// scheduled dropouts and hangs, to exercise failure detection and reconnection
+	if (FAULT_INJECTION)
+	{
+		FaultInjectingSource::Settings faults = loadFaultInjectionSettings();
+		mCameraLeft->setFaultInjection(faults);
+		mCameraRight->setFaultInjection(faults);
+	}
+	// optional reconnection policy (handler defaults are used otherwise)
+	if (mConfig->getKeyExists("Camera/ReconnectAfterFailures") || mConfig->getKeyExists("Camera/ReconnectTimeout"))
+	{
+		unsigned int failures = mConfig->getKeyExists("Camera/ReconnectAfterFailures") ? mConfig->getValueAsInt("Camera/ReconnectAfterFailures") : 0;
+		unsigned int timeout = mConfig->getKeyExists("Camera/ReconnectTimeout") ? mConfig->getValueAsInt("Camera/ReconnectTimeout") : 0;
+		mCameraLeft->setReconnectPolicy(failures, timeout);
+		mCameraRight->setReconnectPolicy(failures, timeout);
+	}
 	/*
 	FrameCaptureData emptyFrame;
 	emptyFrame.image = cv::Mat(cv::Scalar(0.0f, 0.0f, 0.0f, 1.0f));
 	emptyFrame.pose = Ogre::Quaternion::IDENTITY;
 	*/
+	// the simulation is the only consumer of camera frames (see Simulation)
+	mSimulation = new Simulation(mCameraLeft, mCameraRight);
+
+	// focus depth from the camera pair drives the video toe-in (needs the focal length from the camera calibration)
+	if (stereoDepthEnabled)
+	{
+		if (mCameraLeft->videoCaptureParams.isValid())
+		{
+			// frames are undistorted (and rectified): their focal length
+			stereoDepthSettings.focalPixels = mCameraLeft->videoCaptureParamsUndistorted.CameraMatrix.at<float>(0, 0);
+			stereoDepthSettings.calibrationWidth = mCameraLeft->videoCaptureParamsUndistorted.CamSize.width;
+			// cameras are placed at the IPD (see [Camera] ICD), unless the stereo calibration tells
+			stereoDepthSettings.baseline = mStereoRectification ? mStereoRectification->getBaseline() : mRift->getIPD();
+			stereoDepthSettings.toeInDegrees = CAMERA_TOEIN_ANGLE;
+			mStereoDepth = new StereoDepth(stereoDepthSettings);
+			mSimulation->setStereoDepth(mStereoDepth);
+		}
+		else std::cout << "Stereo depth disabled: left camera is not calibrated." << std::endl;
+	}
+
+	if (BENCHMARK) return;	// no preview windows (and no highgui event processing) while measuring
 	std::string window_name_left = "Video stream left";
 	cv::namedWindow(window_name_left, CV_WINDOW_AUTOSIZE);
 	std::string window_name_right = "Video stream right";
 	cv::namedWindow(window_name_right, CV_WINDOW_AUTOSIZE);
 }
 
+// Synthetic video source settings from [Synthetic] section (every key is optional)
+SyntheticSource::Settings App::loadSyntheticSettings(const std::string& name)
+{
+	SyntheticSource::Settings settings;
+	settings.name = name;
+	if (mConfig->getKeyExists("Synthetic/Width")) settings.width = mConfig->getValueAsInt("Synthetic/Width");
+	if (mConfig->getKeyExists("Synthetic/Height")) settings.height = mConfig->getValueAsInt("Synthetic/Height");
+	if (mConfig->getKeyExists("Synthetic/Fps")) settings.fps = mConfig->getValueAsInt("Synthetic/Fps");
+	if (mConfig->getKeyExists("Synthetic/JitterMs")) settings.jitterMs = mConfig->getValueAsReal("Synthetic/JitterMs");
+	if (mConfig->getKeyExists("Synthetic/HFOV")) settings.hfovDeg = mConfig->getValueAsReal("Synthetic/HFOV");
+	if (mConfig->getKeyExists("Synthetic/FrameCounter")) settings.drawFrameCounter = mConfig->getValueAsBool("Synthetic/FrameCounter");
+	if (mConfig->getKeyExists("Synthetic/Format"))
+	{
+		std::string format = mConfig->getValueAsString("Synthetic/Format");
+		if (format == "BGRA") settings.pixelType = CV_8UC4;
+		else if (format == "GRAY") settings.pixelType = CV_8UC1;
+		else settings.pixelType = CV_8UC3;
+	}
+	if (mConfig->getKeyExists("Synthetic/Pattern"))
+	{
+		std::string pattern = mConfig->getValueAsString("Synthetic/Pattern");
+		if (pattern == "ColourBars") settings.pattern = SyntheticSource::ColourBars;
+		else if (pattern == "Gradient") settings.pattern = SyntheticSource::Gradient;
+		else settings.pattern = SyntheticSource::Checkerboard;
+	}
+	// markers 0..n-1 side by side, each one moving with a different phase speed
+	int markers = mConfig->getKeyExists("Synthetic/Markers") ? mConfig->getValueAsInt("Synthetic/Markers") : 1;
+	for (int i = 0; i < markers; i++)
+	{
+		SyntheticSource::Marker marker;
+		marker.id = i;
+		marker.position.x = (i - (markers - 1) * 0.5f) * 0.15f;
+		marker.frequencyHz = 0.25f + 0.1f * i;
+		settings.markers.push_back(marker);
+	}
+	return settings;
+}
+
+void App::printTimingReport()
+{
+	std::cout << "Timing (last " << timingReportInterval << "s):" << std::endl;
+	renderFrameTimes.report(std::cout);
+	if (mSimulation->isThreaded()) mSimulation->getTickTimes().report(std::cout);
+	std::cout << "Frames: " << mRift->getRenderedFrames() << " rendered, " << mRift->getReprojectedFrames() << " reprojected" << std::endl;
+	std::cout << "Idle work jobs: " << mIdleWork.getIdleJobs() << " in the timewarp wait, " << mIdleWork.getFlushedJobs() << " flushed" << std::endl;
+	mIdleWork.getIdleWorkTimes().report(std::cout);
+	if (mFramePacer) mFramePacer->getStartErrors().report(std::cout);
+	if (seethroughEnabled)
+	{
+		uploadTimes.report(std::cout);
+		if (mStereoDepth) mStereoDepth->getMatchTimes().report(std::cout);
+		if (mCameraLeft) mCameraLeft->getGrabIntervals().report(std::cout);
+		if (mCameraRight) mCameraRight->getGrabIntervals().report(std::cout);
+		if (mLatencyProbe) mLatencyProbe->report(std::cout);
+		printCameraStats();
+	}
+}
+
+void App::writeTimingHistograms()
+{
+	if (timingHistogramsFile.empty()) return;
+	std::ofstream out(timingHistogramsFile.c_str());
+	if (!out)
+	{
+		std::cout << "Could not write timing histograms to " << timingHistogramsFile << std::endl;
+		return;
+	}
+	renderFrameTimes.write(out);
+	uploadTimes.write(out);
+	mIdleWork.getIdleWorkTimes().write(out);
+	if (mSimulation && mSimulation->isThreaded()) mSimulation->getTickTimes().write(out);
+	if (mStereoDepth) mStereoDepth->getMatchTimes().write(out);
+	if (mFramePacer) mFramePacer->getStartErrors().write(out);
+	if (mCameraLeft) mCameraLeft->getGrabIntervals().write(out);
+	if (mCameraRight) mCameraRight->getGrabIntervals().write(out);
+	if (mLatencyProbe) mLatencyProbe->write(out);
+	std::cout << "Timing histograms saved to " << timingHistogramsFile << std::endl;
+}
+
+// JSON string literal (quoted and escaped): names may be file paths, i.e. with backslashes
+static std::string jsonString(const std::string& text)
+{
+	std::string quoted = "\"";
+	for (const char c : text)
+	{
+		switch (c)
+		{
+		case '"':	quoted += "\\\""; break;
+		case '\\':	quoted += "\\\\"; break;
+		case '\n':	quoted += "\\n"; break;
+		case '\r':	quoted += "\\r"; break;
+		case '\t':	quoted += "\\t"; break;
+		default:
+			if ((unsigned char)c < 0x20)
+			{
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int)(unsigned char)c);
+				quoted += escaped;
+			}
+			else quoted += c;
+			break;
+		}
+	}
+	return quoted + "\"";
+}
+
+// JSON object with the total histogram of a timing (milliseconds)
+static void writeJsonTiming(std::ostream& out, const TimingHistogram& timing)
+{
+	out << "{ \"count\": " << timing.total.getCount()
+		<< ", \"p50\": " << timing.total.getPercentile(0.5)
+		<< ", \"p90\": " << timing.total.getPercentile(0.9)
+		<< ", \"p99\": " << timing.total.getPercentile(0.99)
+		<< ", \"max\": " << timing.total.getMax()
+		<< ", \"budget\": " << timing.budgetMs
+		<< ", \"overBudget\": " << (timing.budgetMs > 0 ? timing.total.getCountAbove(timing.budgetMs) : 0) << " }";
+}
+
+// Machine readable benchmark result (one JSON object), to compare rendering cost across commits
+void App::writeBenchmarkReport(const double measuredSeconds)
+{
+	std::ofstream out(benchmarkReportFile.c_str());
+	if (!out)
+	{
+		std::cout << "Could not write benchmark report to " << benchmarkReportFile << std::endl;
+		return;
+	}
+	const Ogre::RenderSystemCapabilities* caps = mRoot->getRenderSystem()->getCapabilities();
+	Ogre::TexturePtr eyeTexture = mRift->getEyeTexture(0);
+
+	out << "{" << std::endl;
+	out << "\t\"renderer\": " << jsonString(caps ? caps->getDeviceName() : std::string()) << "," << std::endl;
+	out << "\t\"hmd\": " << jsonString(mRift->getProductName()) << "," << std::endl;
+	out << "\t\"eyeTexture\": [" << eyeTexture->getWidth() << ", " << eyeTexture->getHeight() << "]," << std::endl;
+	out << "\t\"pixelDensity\": " << mRift->getPixelDensity() << "," << std::endl;
+	out << "\t\"msaa\": " << mRift->getEyeFsaa() << "," << std::endl;
+	out << "\t\"stereoCulling\": " << (stereoCulling ? "true" : "false") << "," << std::endl;
+	out << "\t\"lateLatch\": " << (mRift->isLateLatchEnabled() ? "true" : "false") << "," << std::endl;
+	out << "\t\"sharedEyeTexture\": " << (mRift->isEyeTextureShared() ? "true" : "false") << "," << std::endl;
+	out << "\t\"distortion\": " << jsonString(mRift->getDistortionMode() == Rift::DistortionMode::Lookup ? "lookup" : "mesh") << "," << std::endl;
+	out << "\t\"display\": [" << mRiftViewTexture->getWidth() << ", " << mRiftViewTexture->getHeight() << "]," << std::endl;
+	out << "\t\"video\": " << (seethroughEnabled ? "true" : "false") << "," << std::endl;
+	out << "\t\"warmupFrames\": " << benchmarkWarmupFrames << "," << std::endl;
+	out << "\t\"frames\": " << benchmarkFrames << "," << std::endl;
+	out << "\t\"seconds\": " << measuredSeconds << "," << std::endl;
+	out << "\t\"fps\": " << (measuredSeconds > 0 ? benchmarkFrames / measuredSeconds : 0) << "," << std::endl;
+	out << "\t\"renderedFrames\": " << mRift->getRenderedFrames() << "," << std::endl;
+	out << "\t\"reprojectedFrames\": " << mRift->getReprojectedFrames() << "," << std::endl;
+	out << "\t\"frameTime\": "; writeJsonTiming(out, renderFrameTimes); out << "," << std::endl;
+	out << "\t\"eyePass\": "; writeJsonTiming(out, mRift->getEyePassTimes()); out << "," << std::endl;
+	out << "\t\"timewarpSetup\": "; writeJsonTiming(out, mRift->getTimewarpSetupTimes()); out << "," << std::endl;
+	out << "\t\"eyeRenderLeft\": "; writeJsonTiming(out, mRift->getEyeRenderTimes(0)); out << "," << std::endl;
+	out << "\t\"eyeRenderRight\": "; writeJsonTiming(out, mRift->getEyeRenderTimes(1)); out << "," << std::endl;
+	out << "\t\"upload\": "; writeJsonTiming(out, uploadTimes); out << "," << std::endl;
+	out << "\t\"idleJobs\": " << mIdleWork.getIdleJobs() << "," << std::endl;
+	out << "\t\"flushedJobs\": " << mIdleWork.getFlushedJobs() << "," << std::endl;
+	out << "\t\"idleWork\": "; writeJsonTiming(out, mIdleWork.getIdleWorkTimes()); out << "," << std::endl;
+	out << "\t\"cameras\": [" << std::endl;
+	FrameCaptureHandler* cameras[2] = { mCameraLeft, mCameraRight };
+	bool first = true;
+	for (int i = 0; i < 2; i++)
+	{
+		if (!cameras[i]) continue;
+		FrameCaptureStats stats = cameras[i]->getStats();
+		if (!first) out << "," << std::endl;
+		first = false;
+		out << "\t\t{ \"name\": " << jsonString(cameras[i]->getSourceName())
+			<< ", \"captured\": " << stats.captured
+			<< ", \"captureRate\": " << stats.captureRate
+			<< ", \"consumed\": " << stats.consumed
+			<< ", \"consumeRate\": " << stats.consumeRate
+			<< ", \"dropped\": " << stats.overwritten
+			<< ", \"failed\": " << stats.failed
+			<< ", \"interval\": ";
+		writeJsonTiming(out, cameras[i]->getGrabIntervals());
+		out << " }";
+	}
+	out << std::endl << "\t]" << std::endl;
+	out << "}" << std::endl;
+	std::cout << "Benchmark report saved to " << benchmarkReportFile << std::endl;
+}
+
+void App::printCameraStats()
+{
+	FrameCaptureHandler* cameras[2] = { mCameraLeft, mCameraRight };
+	const char* names[2] = { "Left", "Right" };
+	for (int i = 0; i < 2; i++)
+	{
+		if (!cameras[i]) continue;
+		FrameCaptureStats stats = cameras[i]->getStats();
+		std::cout << "\tCamera " << names[i] << ": "
+			<< "captured " << stats.captured << " (" << stats.captureRate << " fps), "
+			<< "consumed " << stats.consumed << " (" << stats.consumeRate << " fps), "
+			<< "dropped " << stats.overwritten << " (" << stats.dropRatio * 100 << "%), "
+			<< "failed " << stats.failed << ", "
+			<< "stalls " << stats.stalls << ", "
+			<< "reconnects " << stats.reconnects << "/" << stats.reconnectAttempts << std::endl;
+		// injected faults, to check against what was detected and recovered above
+		if (const FaultInjectingSource::Counters* faults = cameras[i]->getInjectedFaults())
+			std::cout << "\t\tinjected: dropouts " << faults->dropouts << ", hangs " << faults->hangs << ", failed opens " << faults->failedOpens << std::endl;
+	}
+}
+
 void App::quitCameras()
 {
 	mScene->disableVideo();
@@ -685,6 +1207,110 @@ void App::quitCameras()
 	if (mCameraRight) delete mCameraRight;
 }
 
+// Applies the latest simulation snapshot to the scene, in one pass before the frame is rendered:
+// marker anchors and video toe-in right away, the new video pair is uploaded by updateVideoTextures().
+void App::applySimulationSnapshot()
+{
+	TRACE_SCOPE("apply snapshot");
+	std::shared_ptr<const SimulationSnapshot> snapshot = mSimulation->getSnapshot();
+
+	// MARKER DETECTED POSE SET!!
+	if (snapshot->markersId != appliedMarkersId)
+	{
+		for (unsigned int i = 0; i < snapshot->markers.size(); i++)
+		{
+			const MarkerAnchor& anchor = snapshot->markers[i];
+			cout << "cube position/orientation " << i << " set to " << -anchor.position.x << "," << anchor.position.y << "," << -anchor.position.z << endl;
+			mScene->setCubePosition(anchor.position);
+			mScene->setCubeOrientation(anchor.orientation);
+		}
+		appliedMarkersId = snapshot->markersId;
+	}
+	if (snapshot->videoToeIn) mScene->setVideoToeInAngle(snapshot->videoToeInAngle);
+
+	if (snapshot->videoId != appliedVideoId)
+	{
+		mVideoSnapshot = snapshot;
+		appliedVideoId = snapshot->videoId;
+	}
+}
+
+// Pixels of a video frame to upload: its region of interest, written to the same box of the video texture (textures
+// have the size of the frames, see Scene::setVideoImageSizeLeft/Right). Returns false (pixels: whole frame) if all of it was processed.
+static bool getVideoUploadBoxes(const ImageCaptureData& image, Ogre::PixelBox& pixels, Ogre::Box& textureBox)
+{
+	const cv::Mat& rgb = image.rgb;
+	cv::Rect roi = image.roi & cv::Rect(0, 0, rgb.cols, rgb.rows);
+	if (roi.area() == 0 || roi.size() == rgb.size())
+	{
+		pixels = Ogre::PixelBox(rgb.cols, rgb.rows, 1, Ogre::PF_R8G8B8, (void*)rgb.ptr<uchar>(0));
+		return false;
+	}
+	// box starts at the region origin, rows keep the stride of the whole frame
+	pixels = Ogre::PixelBox(roi.width, roi.height, 1, Ogre::PF_R8G8B8, (void*)rgb.ptr<uchar>(roi.y, roi.x));
+	pixels.rowPitch = rgb.step / rgb.elemSize();
+	pixels.slicePitch = pixels.rowPitch * roi.height;
+	textureBox = Ogre::Box(roi.x, roi.y, roi.x + roi.width, roi.y + roi.height);
+	return true;
+}
+
+// Sends each camera the part of its image the eye can see (see [Camera] RegionOfInterest)
+void App::updateVideoRegions()
+{
+	appliedVideoLayout = mScene->getVideoLayoutVersion();
+	FrameCaptureHandler* cameras[2] = { mCameraLeft, mCameraRight };
+	for (int eye = 0; eye < 2; eye++)
+	{
+		if (!cameras[eye]) continue;
+		Ogre::FloatRect region;
+		if (!mScene->getVisibleVideoRegion(eye, videoRegionMargin, region)) region = Ogre::FloatRect(0, 0, 1, 1);	// whole image
+		cameras[eye]->setRegionOfInterest(cv::Rect_<float>(region.left, region.top, region.width(), region.height()));
+	}
+}
+
+// Uploads the video pair of the last applied snapshot (if not uploaded yet) to the video textures.
+// Posted every frame as an idle work job: runs in the wait before the timewarp point if it fits, so the eyes of the
+// next frame find the video already uploaded, or in frameRenderingQueued() otherwise (as before).
+void App::updateVideoTextures()
+{
+	if (!mVideoSnapshot) return;
+	std::shared_ptr<const SimulationSnapshot> snapshot = mVideoSnapshot;
+	mVideoSnapshot.reset();
+	const FrameCaptureData& frameLeft = snapshot->videoLeft;
+	const FrameCaptureData& frameRight = snapshot->videoRight;
+
+	// N.B. each camera will try to keep capturing in sync with specified startCapture_time, then they return the result as soon as possible: a new left frame is uploaded with the latest right one
+	//std::cout << "sending new image to the scene..." << std::endl;
+	{
+		TRACE_SCOPE_ID("upload left", frameLeft.id);
+		std::chrono::steady_clock::time_point uploadStart_time = std::chrono::steady_clock::now();
+		Ogre::PixelBox pixelBoxLeft;
+		Ogre::Box textureBoxLeft;
+		mScene->setVideoImageSizeLeft(frameLeft.image.rgb.cols, frameLeft.image.rgb.rows);
+		bool regionLeft = getVideoUploadBoxes(frameLeft.image, pixelBoxLeft, textureBoxLeft);
+		mScene->setVideoImagePoseLeft(pixelBoxLeft, Ogre::Quaternion(frameLeft.image.orientation[0], frameLeft.image.orientation[1], frameLeft.image.orientation[2], frameLeft.image.orientation[3]), regionLeft ? &textureBoxLeft : nullptr);
+		uploadTimes.add(std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - uploadStart_time).count());
+		if (mLatencyProbe) mLatencyProbe->frameUploaded(frameLeft);
+	}
+	if (!BENCHMARK) cv::imshow("Video stream left", frameLeft.image.rgb);
+
+	// right camera may not have delivered its first frame yet
+	if (!frameRight.image.rgb.empty())
+	{
+		TRACE_SCOPE_ID("upload right", frameRight.id);
+		std::chrono::steady_clock::time_point uploadStart_time = std::chrono::steady_clock::now();
+		Ogre::PixelBox pixelBoxRight;
+		Ogre::Box textureBoxRight;
+		mScene->setVideoImageSizeRight(frameRight.image.rgb.cols, frameRight.image.rgb.rows);
+		bool regionRight = getVideoUploadBoxes(frameRight.image, pixelBoxRight, textureBoxRight);
+		mScene->setVideoImagePoseRight(pixelBoxRight, Ogre::Quaternion(frameRight.image.orientation[0], frameRight.image.orientation[1], frameRight.image.orientation[2], frameRight.image.orientation[3]), regionRight ? &textureBoxRight : nullptr);
+		uploadTimes.add(std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - uploadStart_time).count());
+		if (!BENCHMARK) cv::imshow("Video stream right", frameRight.image.rgb);
+	}
+	//std::cout << "image sent!\nImage plane updated!" << std::endl;
+	if (!BENCHMARK) cv::waitKey(1);
+}
+
 ////////////////////////////////////////////////////////////
 // Handle Rendering (Ogre::FrameListener)
 ////////////////////////////////////////////////////////////
@@ -710,66 +1336,44 @@ bool App::frameRenderingQueued(const Ogre::FrameEvent& evt)
 		//}
 	}
 	//std::cout << "Updating frame..." << std::endl;
-	
-	// [CAMERA] UPDATE
-	// update real cameras information and sends it to Scene (Texture of pictures planes/shapes)
-	if (mCameraLeft && !imageLeftReady && mCameraLeft->get(nextFrameLeft))		// if camera is initialized AND there is a new frame
-	{
-		//std::cout << "Set new left image..." << std::endl;
-		//cv::imshow("CameraDebugLeft", nextFrameLeft.image);
-		//cv::waitKey(1);
-			
-		//std::cout << "converting from cv::Mat to Ogre::PixelBox..." << std::endl;
-		mOgrePixelBoxLeft = Ogre::PixelBox(nextFrameLeft.image.rgb.cols, nextFrameLeft.image.rgb.rows, 1, Ogre::PF_R8G8B8, nextFrameLeft.image.rgb.ptr<uchar>(0));
-
-		// DO NOT SET ANYTHING IN THE SCENE YET!
-		imageLeftReady = true;
-	}
-	
-	if (mCameraRight && !imageRightReady && mCameraRight->get(nextFrameRight))	// if camera is initialized AND there is a new frame
-	{
-		//std::cout << "Set new right image..." << std::endl;
-		//cv::imshow("CameraDebugRight", nextFrameRight.image);
-		//cv::waitKey(1);
-
-		//std::cout << "converting from cv::Mat to Ogre::PixelBox..." << std::endl;
-		mOgrePixelBoxRight = Ogre::PixelBox(nextFrameRight.image.rgb.cols, nextFrameRight.image.rgb.rows, 1, Ogre::PF_R8G8B8, nextFrameRight.image.rgb.ptr<uchar>(0));
 
-		// DO NOT SET ANYTHING IN THE SCENE YET!
-		imageRightReady = true;
-	}
-	
-	// N.B. each camera will try to keep capturing in sync with specified startCapture_time, then they return the result as soon as possible, so only thing to do is wait that both frames are available
-	if (imageLeftReady)
+	// [CAMERA] STATE
+	// see-through was requested: switch video on as soon as both cameras delivered their first frame
+	// (a handler becomes Streaming only after its first frame has been published)
+	if (seethroughPending)
 	{
-		//std::cout << "sending new image to the scene..." << std::endl;
-		mScene->setVideoImagePoseLeft(mOgrePixelBoxLeft, Ogre::Quaternion(nextFrameLeft.image.orientation[0], nextFrameLeft.image.orientation[1], nextFrameLeft.image.orientation[2], nextFrameLeft.image.orientation[3]) );
-		//std::cout << "image sent!\nImage plane updated!" << std::endl;
-		
-		// MARKER DETECTED POSE SET!!
-		for (unsigned int i = 0; i < nextFrameLeft.markers.size(); i++)
+		bool leftFailed = mCameraLeft && mCameraLeft->getState() == FrameCaptureHandler::Failed;
+		bool rightFailed = mCameraRight && mCameraRight->getState() == FrameCaptureHandler::Failed;
+		bool leftReady = !mCameraLeft || mCameraLeft->getState() == FrameCaptureHandler::Streaming;
+		bool rightReady = !mCameraRight || mCameraRight->getState() == FrameCaptureHandler::Streaming;
+		if (leftFailed || rightFailed)
+		{
+			std::cout << "Could not start see-through: a camera failed to open." << std::endl;
+			if (mCameraLeft) mCameraLeft->stopCapture();
+			if (mCameraRight) mCameraRight->stopCapture();
+			seethroughPending = false;
+		}
+		else if (leftReady && rightReady)
 		{
-			cout << "cube position/orientation " << i << " set to " << -nextFrameLeft.markers[i].position[0] << "," << nextFrameLeft.markers[i].position[1] << "," << -nextFrameLeft.markers[i].position[2] << endl;
-			mScene->setCubePosition(Ogre::Vector3(nextFrameLeft.markers[i].position[0], nextFrameLeft.markers[i].position[1], nextFrameLeft.markers[i].position[2]));
-			mScene->setCubeOrientation(Ogre::Quaternion(nextFrameLeft.markers[i].orientation[0], nextFrameLeft.markers[i].orientation[1], nextFrameLeft.markers[i].orientation[2], nextFrameLeft.markers[i].orientation[3]));
+			mScene->enableVideo();
+			seethroughEnabled = true;
+			seethroughPending = false;
 		}
-		
-		cv::imshow("Video stream left", nextFrameLeft.image.rgb);
-
-		//std::cout << "Set new right image..." << std::endl;
-		//cv::imshow("CameraDebugRight", nextFrameRight.image);
-		//cv::waitKey(1);
+	}
+	// a camera that lost its device (or is stuck in grab(), see the stall watchdog) keeps showing its last frame,
+	// dimmed, until it is back
+	bool leftStalled = mCameraLeft && mCameraLeft->checkStall();
+	bool rightStalled = mCameraRight && mCameraRight->checkStall();
+	if (seethroughEnabled)
+	{
+		mScene->setVideoLeftDimmed(mCameraLeft && (leftStalled || mCameraLeft->getState() == FrameCaptureHandler::Reconnecting));
+		mScene->setVideoRightDimmed(mCameraRight && (rightStalled || mCameraRight->getState() == FrameCaptureHandler::Reconnecting));
+	}
 
-		//std::cout << "sending new image to the scene..." << std::endl;
-		mScene->setVideoImagePoseRight(mOgrePixelBoxRight, Ogre::Quaternion(nextFrameRight.image.orientation[0], nextFrameRight.image.orientation[1], nextFrameRight.image.orientation[2], nextFrameRight.image.orientation[3]));
-		//std::cout << "image sent!\nImage plane updated!" << std::endl;
-		cv::imshow("Video stream right", nextFrameRight.image.rgb);
-		cv::waitKey(1);
+	// [CAMERA] UPDATE
+	// queued render thread work not done while waiting for the timewarp point (i.e. video upload, see updateVideoTextures())
+	mIdleWork.flush();
 
-		imageLeftReady = false;
-		imageRightReady = false;
-	}
-	
 	/* KEPT FOR PERSONAL REFERENCE
 	// [ARUCO] UPDATE
 	// undistort images from real cameras and use them for AR
@@ -795,13 +1399,13 @@ bool App::frameRenderingQueued(const Ogre::FrameEvent& evt)
 	*/
 
 	// [OIS] UPDATE
-	// update standard input devices state
-	mKeyboard->capture();
-	mMouse->capture();
+	// update standard input devices state (none in benchmark mode)
+	if (mKeyboard) mKeyboard->capture();
+	if (mMouse) mMouse->capture();
 
 	// [OGRE] UPDATE
-	// perform any other update that regards the Scene only (ex. Physics calculations)
-	mScene->update( evt.timeSinceLastFrame );
+	// scene logic runs in the simulation (see Simulation), its snapshot is applied before the frame is rendered
+	//mScene->update( evt.timeSinceLastFrame );
 	//mTrayMgr->frameRenderingQueued(evt);
 
 
@@ -813,7 +1417,7 @@ bool App::frameRenderingQueued(const Ogre::FrameEvent& evt)
 
 
 	//exit if key ESCAPE pressed
-	if(mKeyboard->isKeyDown(OIS::KC_ESCAPE))
+	if(mKeyboard && mKeyboard->isKeyDown(OIS::KC_ESCAPE))
 		return false;
 
 	return true; 
@@ -846,7 +1450,8 @@ bool App::keyPressed( const OIS::KeyEvent& e )
 		keyLayout = LagAdjust;
 		break;
 	case OIS::KC_K:
-		keyLayout = KeystoningAdjust;
+		if (mStereoRectification) std::cout << "Keystoning is corrected by the camera rectification." << std::endl;
+		else keyLayout = KeystoningAdjust;
 		break;
 	case OIS::KC_Z:
 		keyLayout = ZPPlaneAdjust;
@@ -1036,23 +1641,57 @@ bool App::keyReleased( const OIS::KeyEvent& e )
 	case OIS::KC_T:
 		
 		// T Button (Through): toggle REAL CAMERA images in the scene
-		if (seethroughEnabled)
+		// Cameras are opened/closed on their own threads: video is enabled in frameRenderingQueued()
+		// only when both first frames have arrived, so the render loop never waits for devices.
+		if (seethroughEnabled || seethroughPending)
 		{
+			mScene->setVideoLeftDimmed(false);
+			mScene->setVideoRightDimmed(false);
 			mScene->disableVideo();
 			if (mCameraLeft) mCameraLeft->stopCapture();
 			if (mCameraRight) mCameraRight->stopCapture();
 			seethroughEnabled = false;
+			seethroughPending = false;
 		}
 		else
 		{
-			if (mCameraLeft) mCameraLeft->startCapture();
-			if (mCameraRight) mCameraRight->startCapture();
-			mScene->enableVideo();
-			seethroughEnabled = true;
+			bool accepted = true;
+			if (mCameraLeft) accepted = mCameraLeft->startCapture() && accepted;
+			if (mCameraRight) accepted = mCameraRight->startCapture() && accepted;
+			if (accepted)
+				seethroughPending = true;
+			else
+				std::cout << "Cameras are still stopping, press T again in a moment." << std::endl;
 		}
 
 		break;
 
+	case OIS::KC_H:
+
+		// H Button (Hot-unplug): simulate a lost device on the selected eye camera (10 failed grabs, then 5 failed reopens)
+		if (eyeSelected == Left && mCameraLeft) mCameraLeft->injectGrabFailures(15);
+		else if (eyeSelected == Right && mCameraRight) mCameraRight->injectGrabFailures(15);
+		break;
+
+	case OIS::KC_J:
+
+		// J Button (JSON trace): dump the latest trace events of all threads (open with chrome://tracing or ui.perfetto.dev)
+		if (Trace::exportChromeJson("trace.json"))
+			std::cout << "Trace saved to trace.json" << std::endl;
+		else
+			std::cout << "Trace not saved (tracing disabled at build time, or file not writable)." << std::endl;
+		break;
+
+	case OIS::KC_M:
+
+		// M Button (Mode): switch lens distortion between mesh and lookup textures (compare them in the timing report)
+		if (mRift->getDistortionMode() == Rift::DistortionMode::Mesh)
+			mRift->setDistortionMode(Rift::DistortionMode::Lookup);
+		else
+			mRift->setDistortionMode(Rift::DistortionMode::Mesh);
+		std::cout << "Distortion: " << (mRift->getDistortionMode() == Rift::DistortionMode::Lookup ? "lookup textures" : "mesh") << std::endl;
+		break;
+
 	case OIS::KC_S:
 
 		// S Button (Stabilization): switch between Head or Eye image stabilization
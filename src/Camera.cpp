@@ -1,5 +1,8 @@
 #include "Camera.h"
+#include "Trace.h"
+#include "LatencyProbe.h"
 #include <opencv2/gpu/gpu.hpp>
+#include <cmath>
 //using namespace cv;
 
 string type2str(int type) {
@@ -64,17 +67,71 @@ void FrameCaptureHandler::shutdownCuda()
 	}
 }
 
-FrameCaptureHandler::FrameCaptureHandler(const unsigned int input_device, Rift* const input_headset, const bool enable_AR,  const std::chrono::steady_clock::time_point syncStart_time, const unsigned short int desiredFps) : headset(input_headset), deviceId(input_device), arEnabled(enable_AR), captureStart_time(syncStart_time), fps(desiredFps)
+FrameCaptureHandler::FrameCaptureHandler(const unsigned int input_device, Rift* const input_headset, const bool enable_AR,  const std::chrono::steady_clock::time_point syncStart_time, const unsigned short int desiredFps) : headset(input_headset), arEnabled(enable_AR), captureStart_time(syncStart_time), fps(desiredFps)
 {
-	fromFile = false;
+	grabIntervals.budgetMs = fps > 0 ? 1500.0 / fps : 0;	// a frame missed on schedule
 
 	// save handle for headset (from which poses are read)
 	hmd = headset->getHandle();
 
+	// camera calibration file is mandatory for devices
+	// a device can hang in grab() for good: see HangRecoverySource
+	initSource(std::unique_ptr<CaptureSource>(new HangRecoverySource(std::unique_ptr<CaptureSource>(new DeviceCaptureSource(input_device, fps)))), input_device);
+}
+
+FrameCaptureHandler::FrameCaptureHandler(const string& input_file, Rift* const input_headset, const bool enable_AR,  const std::chrono::steady_clock::time_point syncStart_time, const unsigned short int desiredFps) : headset(input_headset), arEnabled(enable_AR), captureStart_time(syncStart_time), fps(desiredFps)
+{
+	grabIntervals.budgetMs = fps > 0 ? 1500.0 / fps : 0;	// a frame missed on schedule
+
+	// save handle for headset (from which poses are read)
+	hmd = headset->getHandle();
+
+	// calibration is needed only to detect markers
+	initSource(std::unique_ptr<CaptureSource>(new FileCaptureSource(input_file)), arEnabled ? 0 : -1);
+}
+
+FrameCaptureHandler::FrameCaptureHandler(const SyntheticSource::Settings& input_synthetic, Rift* const input_headset, const bool enable_AR, const std::chrono::steady_clock::time_point syncStart_time, const unsigned short int desiredFps) : headset(input_headset), arEnabled(enable_AR), captureStart_time(syncStart_time), fps(desiredFps)
+{
+	grabIntervals.budgetMs = fps > 0 ? 1500.0 / fps : 0;	// a frame missed on schedule
+
+	// save handle for headset (from which poses are read)
+	hmd = headset->getHandle();
+
+	// no calibration file: the synthetic lens is an ideal pinhole
+	initSource(std::unique_ptr<CaptureSource>(new SyntheticSource(input_synthetic)), -1);
+}
+
+FrameCaptureHandler::FrameCaptureHandler(std::unique_ptr<CaptureSource> input_source, Rift* const input_headset, const bool enable_AR, const std::chrono::steady_clock::time_point syncStart_time, const unsigned short int desiredFps) : headset(input_headset), arEnabled(enable_AR), captureStart_time(syncStart_time), fps(desiredFps)
+{
+	grabIntervals.budgetMs = fps > 0 ? 1500.0 / fps : 0;	// a frame missed on schedule
+
+	// save handle for headset (from which poses are read)
+	hmd = headset->getHandle();
+
+	initSource(std::move(input_source), -1);
+}
+
+void FrameCaptureHandler::initSource(std::unique_ptr<CaptureSource> newSource, const int calibrationId)
+{
+	source = std::move(newSource);
+	injectedFaults.reset();
+	grabIntervals.name = "capture interval " + source->getName();
+
+	if (source->getCameraParameters(videoCaptureParams))
+	{
+		videoCaptureParamsUndistorted = videoCaptureParams;
+		remapTables.reset();		// ideal lens: nothing to undistort
+	}
+	else if (calibrationId >= 0)
+		loadCalibration(calibrationId);
+}
+
+void FrameCaptureHandler::loadCalibration(const int calibrationId)
+{
 	// find and read camera calibration file
 	try {
 		char calibration_file_name_buffer[30];
-		sprintf(calibration_file_name_buffer, "camera%d_intrinsics.yml", deviceId);
+		sprintf(calibration_file_name_buffer, "camera%d_intrinsics.yml", calibrationId);
 		videoCaptureParams.readFromXMLFile(std::string(calibration_file_name_buffer));
 	}
 	catch (std::exception &ex) {
@@ -85,93 +142,101 @@ FrameCaptureHandler::FrameCaptureHandler(const unsigned int input_device, Rift*
 	// make the undistorted version of camera parameters (null distortion matrix)
 	videoCaptureParamsUndistorted = videoCaptureParams;
 	videoCaptureParamsUndistorted.Distorsion = cv::Mat::zeros(4, 1, CV_32F);
+	// undistortion tables are computed once, not at every frame
+	remapTables = createUndistortTables(videoCaptureParams);
 }
 
-FrameCaptureHandler::FrameCaptureHandler(const string& input_file, Rift* const input_headset, const bool enable_AR,  const std::chrono::steady_clock::time_point syncStart_time, const unsigned short int desiredFps) : headset(input_headset), filePath(input_file), arEnabled(enable_AR), captureStart_time(syncStart_time), fps(desiredFps)
+FrameCaptureHandler::~FrameCaptureHandler()
 {
-	fromFile = true;
+	// Only place where the caller blocks on the capture thread (application shutdown)
+	stopCapture();
+	if (captureThread.joinable()) captureThread.join();
+}
 
-	// save handle for headset (from which poses are read)
-	hmd = headset->getHandle();
+// Request the capture thread to open the device and start capturing (non-blocking)
+bool FrameCaptureHandler::startCapture()
+{
+	CaptureState current = state;
+	if (current == Opening || current == Streaming || current == Reconnecting)
+		return true;		// already running
+	if (current == Stopping)
+		return false;		// device is still being released by the previous capture thread
 
-	if(arEnabled)
-	{
-		// find and read camera calibration file
-		try {
-			char calibration_file_name_buffer[30];
-			sprintf(calibration_file_name_buffer, "camera%d_intrinsics.yml", deviceId);
-			videoCaptureParams.readFromXMLFile(std::string(calibration_file_name_buffer));
-		}
-		catch (std::exception &ex) {
-			cerr << ex.what() << endl;
-			throw std::runtime_error("File not found or error in loading camera parameters for .yml file");
-		}
+	// Stopped or Failed: previous thread (if any) has already left, so joining it is immediate
+	if (captureThread.joinable()) captureThread.join();
 
-		// make the undistorted version of camera parameters (null distortion matrix)
-		videoCaptureParamsUndistorted = videoCaptureParams;
-		videoCaptureParamsUndistorted.Distorsion = cv::Mat::zeros(4, 1, CV_32F);		
+	// Init Cuda for elaboration
+	if (!cudaAcquired)
+	{
+		initCuda();
+		cudaAcquired = true;
 	}
 
+	hasFrame = false;
+	aspectRatio = 0;
+	resetStats();
+	stopped = false;
+	state = Opening;
+	captureThread = std::thread(&FrameCaptureHandler::captureThreadMain, this);
+	return true;
 }
 
-// Spawn capture thread and return webcam aspect ratio (width over height)
-float FrameCaptureHandler::startCapture()
+// Capture thread body: all blocking device I/O is done here, never on the render thread
+void FrameCaptureHandler::captureThreadMain()
 {
-	// Init Cuda for elaboration
-	initCuda();
+	TRACE_THREAD_NAME("Capture " + source->getName());
+	if (!openDevice())
+	{
+		source->release();
+		// Opening -> Failed (if a stop was requested meanwhile, just end up Stopped)
+		CaptureState expected = Opening;
+		if (!state.compare_exchange_strong(expected, Failed)) state = Stopped;
+		return;
+	}
 
-	// Init device for capture
-	if(fromFile)
+	// Opening -> Streaming, unless a stop was requested while the device was opening
+	CaptureState expected = Opening;
+	if (state.compare_exchange_strong(expected, Streaming))
 	{
-		videoCapture.open(filePath);
-		videoCapture.set(CV_CAP_PROP_FOCUS, 0);
-		videoCapture.set(CV_CAP_PROP_FRAME_WIDTH, 1800);
-		videoCapture.set(CV_CAP_PROP_FRAME_HEIGHT, 900);
-		videoCapture.set(CV_CAP_PROP_FPS, 10);
+		std::cout << "Capture loop for "<< source->getName() <<" started." << std::endl;
+		captureLoop();
 	}
-	else
+
+	source->release();
+	state = Stopped;
+}
+
+// Init device for capture and publish the first frame (called from the capture thread)
+bool FrameCaptureHandler::openDevice()
+{
+	if (source->open() && videoCaptureParams.isValid())
 	{
-		videoCapture.open(deviceId);
-		std::cout << "Camera " << deviceId << " parameters: " << std::endl
+		std::cout << source->getName() << " parameters: " << std::endl
 			<< "  K = " << videoCaptureParams.CameraMatrix << std::endl
 			<< "  D = " << videoCaptureParams.Distorsion.t() << std::endl;
 			//<< "  rms = " << rms << "\n\n";
-		videoCapture.set(CV_CAP_PROP_FOURCC, CV_FOURCC('H', '2', '6', '4'));
-		//videoCapture.set(CV_CAP_PROP_FOURCC, CV_FOURCC('M', 'J', 'P', 'G'));
-		videoCapture.set(CV_CAP_PROP_FRAME_WIDTH, FORCE_WIDTH_RESOLUTION);
-		videoCapture.set(CV_CAP_PROP_FRAME_HEIGHT, FORCE_HEIGHT_RESOLUTION);
-		videoCapture.set(CV_CAP_PROP_FPS, fps);		// in future: leave OpenCV to request to device frames as fast as he can (it minimizes delay and not support all range of FPSs)
-													// the variable "fps" will still be used to sync the grab() calls, even though in future releases grab() should be called repeatedly and then take from those a subset dependent on FPS
-		//videoCapture.set(CV_CAP_PROP_FOCUS, 0);
-		//videoCapture.set(CV_CAP_PROP_EXPOSURE, ??);
 	}
-	
-	if (!videoCapture.isOpened() || !videoCapture.read(frame.image.rgb))
+
+	FrameCaptureData first;
+	first.grabTime = ovr_GetTimeInSeconds();
+	Ogre::Quaternion noRotation = Ogre::Quaternion::IDENTITY;
+	first.image.orientation[0] = noRotation.w;
+	first.image.orientation[1] = noRotation.x;
+	first.image.orientation[2] = noRotation.y;
+	first.image.orientation[3] = noRotation.z;
+	if (!source->isOpened() || !source->grab() || !retrieveFrame(first.image.rgb))
 	{
-		std::cout << "Could not open video source! Could not retrieve first frame!";
-		opening_failed = true;
-		stopped = true;
+		std::cout << "Could not open video source! Could not retrieve first frame!" << std::endl;
+		return false;
 	}
-	else
-	{
-		aspectRatio = (float)frame.image.rgb.cols / (float)frame.image.rgb.rows;
+	first.retrieveTime = ovr_GetTimeInSeconds();
+	first.image.roi = cv::Rect(0, 0, first.image.rgb.cols, first.image.rgb.rows);
+	framesCaptured++;
 
-		stopped = false;
-		opening_failed = false;
-
-		if(fromFile)
-		{
-			captureThread = std::thread(&FrameCaptureHandler::fromFileLoop, this);
-			std::cout << "Capture loop for file "<< filePath <<" started." << std::endl;
-		}
-		else
-		{
-			captureThread = std::thread(&FrameCaptureHandler::captureLoop, this);
-			std::cout << "Capture loop for camera "<< deviceId <<" started." << std::endl;			
-		}
-
-	}
-	return aspectRatio;
+	aspectRatio = (float)first.image.rgb.cols / (float)first.image.rgb.rows;
+	// first frame is published right away: its arrival is what switches the handler to Streaming
+	set(first);
+	return true;
 }
 
 /*
@@ -192,20 +257,70 @@ while True:
 */
 
 
-void FrameCaptureHandler::stopCapture() {
-	if (!stopped)
+// Close and reopen the device after a failure, with exponential backoff (called from the capture thread)
+// Returns true when streaming again, false if a stop was requested in the meantime.
+bool FrameCaptureHandler::reconnect()
+{
+	CaptureState expected = Streaming;
+	if (!state.compare_exchange_strong(expected, Reconnecting)) return false;
+
+	std::cout << source->getName() << " lost. Reconnecting..." << std::endl;
+	std::chrono::steady_clock::time_point downStart_time = std::chrono::steady_clock::now();
+	std::chrono::milliseconds backoff = reconnectInitialBackoff;
+	bool reconnected = false;
+
+	while (!stopped)
 	{
-		stopped = true;
-		hasFrame = false;
-		aspectRatio = 0;
-		cameraCaptureRealDelayMs = 0;
-		cameraCaptureManualDelayMs = 0;
-		if (!opening_failed)
+		source->release();
+		reconnectAttempts++;
+
+		// injected failures also make reopening fail, so that backoff can be exercised
+		unsigned int pendingFailures = injectedGrabFailures;
+		bool injected = pendingFailures > 0 && injectedGrabFailures.compare_exchange_strong(pendingFailures, pendingFailures - 1);
+		if (!injected && openDevice())
 		{
-			captureThread.join();
-			videoCapture.release();
+			reconnected = true;
+			break;
 		}
+
+		// sleep in small slices so that a stop request is served quickly
+		std::chrono::steady_clock::time_point wakeup_time = std::chrono::steady_clock::now() + backoff;
+		while (!stopped && std::chrono::steady_clock::now() < wakeup_time)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		backoff = std::min(backoff * 2, reconnectMaxBackoff);
+	}
+
+	downtimeMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - downStart_time).count();
+	if (!reconnected) return false;
+
+	// Reconnecting -> Streaming, unless a stop was requested right now
+	expected = Reconnecting;
+	if (!state.compare_exchange_strong(expected, Streaming)) return false;
+	reconnectCount++;
+	std::cout << source->getName() << " reconnected after " << reconnectAttempts << " total attempts." << std::endl;
+	return true;
+}
+
+void FrameCaptureHandler::setReconnectPolicy(const unsigned int maxConsecutiveFailures, const unsigned int timeoutMs)
+{
+	if (maxConsecutiveFailures > 0) reconnectAfterFailures = maxConsecutiveFailures;
+	if (timeoutMs > 0) reconnectTimeout = std::chrono::milliseconds(timeoutMs);
+}
+
+// Request the capture thread to stop (non-blocking): the device is released by the thread itself
+void FrameCaptureHandler::stopCapture() {
+	stopped = true;		// harmless if no thread is running (startCapture() resets it)
+	CaptureState current = state;
+	while ((current == Opening || current == Streaming || current == Reconnecting) && !state.compare_exchange_weak(current, Stopping)) {}
+	if (current == Failed) state.compare_exchange_strong(current, Stopped);
+	hasFrame = false;
+	aspectRatio = 0;
+	cameraCaptureRealDelayMs = 0;
+	cameraCaptureManualDelayMs = 0;
+	if (cudaAcquired)
+	{
 		shutdownCuda();
+		cudaAcquired = false;
 	}
 }
 
@@ -213,7 +328,12 @@ void FrameCaptureHandler::stopCapture() {
 // it is not clear whether types manage copy internally in a good way (like cv:Mat does)
 void FrameCaptureHandler::set(const FrameCaptureData & newFrame) {
 	std::lock_guard<std::mutex> guard(mutex);
+	if (hasFrame) framesOverwritten++;		// previous frame was never consumed
 	frame = newFrame;
+	frame.id = ++lastFrameId;
+	if (stampFrames) LatencyProbe::stamp(frame.image.rgb, frame.id);
+	frame.publishTime = ovr_GetTimeInSeconds();
+	framesPublished++;
 	hasFrame = true;
 }
 
@@ -229,30 +349,153 @@ bool FrameCaptureHandler::get(FrameCaptureData & out) {
 	std::lock_guard<std::mutex> guard(mutex);
 	out = frame;
 	hasFrame = false;
+	framesConsumed++;
 	return true;
 }
 
+// Called by startCapture() only, while no capture thread is running
+void FrameCaptureHandler::resetStats()
+{
+	framesCaptured = 0;
+	framesPublished = 0;
+	framesConsumed = 0;
+	framesOverwritten = 0;
+	framesFailed = 0;
+	reconnectAttempts = 0;
+	reconnectCount = 0;
+	stallCount = 0;
+	downtimeMicros = 0;
+	lastFrameId = 0;
+	statsStartTime = ovr_GetTimeInSeconds();
+}
+
+FrameCaptureStats FrameCaptureHandler::getStats() const
+{
+	// each counter is read atomically: the snapshot as a whole may be off by a frame, never torn
+	FrameCaptureStats stats;
+	stats.captured = framesCaptured;
+	stats.published = framesPublished;
+	stats.consumed = framesConsumed;
+	stats.overwritten = framesOverwritten;
+	stats.failed = framesFailed;
+	stats.reconnectAttempts = reconnectAttempts;
+	stats.reconnects = reconnectCount;
+	stats.stalls = stallCount;
+	stats.downtimeMs = downtimeMicros / 1000.0;
+
+	double start = statsStartTime;
+	if (start > 0) stats.elapsedSeconds = ovr_GetTimeInSeconds() - start;
+	if (stats.elapsedSeconds > 0)
+	{
+		stats.captureRate = stats.captured / stats.elapsedSeconds;
+		stats.publishRate = stats.published / stats.elapsedSeconds;
+		stats.consumeRate = stats.consumed / stats.elapsedSeconds;
+	}
+	if (stats.published > 0) stats.dropRatio = (double)stats.overwritten / (double)stats.published;
+	return stats;
+}
+
 bool FrameCaptureHandler::setCaptureSource(const unsigned int newDeviceNumber)
 {
-	if (stopped)
-	{	
-		deviceId = newDeviceNumber;
-		fromFile = false;
+	return setCaptureSource(std::unique_ptr<CaptureSource>(new HangRecoverySource(std::unique_ptr<CaptureSource>(new DeviceCaptureSource(newDeviceNumber, fps)))));
+}
+bool FrameCaptureHandler::setCaptureSource(const string& newFilePath)
+{
+	return setCaptureSource(std::unique_ptr<CaptureSource>(new FileCaptureSource(newFilePath)));
+}
+bool FrameCaptureHandler::setCaptureSource(const SyntheticSource::Settings& newSettings)
+{
+	return setCaptureSource(std::unique_ptr<CaptureSource>(new SyntheticSource(newSettings)));
+}
+bool FrameCaptureHandler::setCaptureSource(std::unique_ptr<CaptureSource> newSource)
+{
+	if (state == Stopped || state == Failed)
+	{
+		// previous thread (if any) has already left: it must not see the old source deleted under it
+		if (captureThread.joinable()) captureThread.join();
+		initSource(std::move(newSource), -1);
 		return true;
 	}
 	else return false;
 }
-bool FrameCaptureHandler::setCaptureSource(const string& newFilePath)
+
+bool FrameCaptureHandler::setFaultInjection(const FaultInjectingSource::Settings& faults)
 {
-	if (stopped)
-	{	
-		filePath = newFilePath;
-		fromFile = true;
+	if (state == Stopped || state == Failed)
+	{
+		if (captureThread.joinable()) captureThread.join();
+		// camera parameters and undistortion tables stay those of the wrapped source
+		FaultInjectingSource* faultInjection = new FaultInjectingSource(std::move(source), faults);
+		injectedFaults = faultInjection->getCounters();
+		source.reset(faultInjection);
+		// hangs nothing can interrupt: only abandoning the source recovers (as for devices)
+		if (faults.hangsLikeDevice) source.reset(new HangRecoverySource(std::move(source)));
 		return true;
 	}
 	else return false;
 }
 
+bool FrameCaptureHandler::checkStall()
+{
+	double since = grabStartTime;
+	if (state != Streaming || since == 0) return false;
+	if (ovr_GetTimeInSeconds() - since < std::chrono::duration< double >(reconnectTimeout).count()) return false;
+
+	// report (and interrupt) each stalled grab once
+	if (stalledGrabTime != since)
+	{
+		stalledGrabTime = since;
+		stallCount++;
+		std::cout << source->getName() << " stalled in grab(). Interrupting..." << std::endl;
+		source->interrupt();
+	}
+	return true;
+}
+
+bool FrameCaptureHandler::setRectification(const std::shared_ptr<const RemapTables>& tables, const aruco::CameraParameters& rectifiedParameters)
+{
+	if (state == Stopped || state == Failed)
+	{
+		if (captureThread.joinable()) captureThread.join();
+		remapTables = tables;
+		videoCaptureParamsUndistorted = rectifiedParameters;
+		return true;
+	}
+	else return false;
+}
+
+void FrameCaptureHandler::setRegionOfInterest(const cv::Rect_<float>& region)
+{
+	std::lock_guard<std::mutex> guard(regionMutex);
+	regionOfInterest = region;
+}
+
+cv::Rect FrameCaptureHandler::getRegionOfInterest(const cv::Size& imageSize) const
+{
+	cv::Rect_<float> region;
+	{
+		std::lock_guard<std::mutex> guard(regionMutex);
+		region = regionOfInterest;
+	}
+	// outwards to whole pixels, inside the image (an empty region means nothing is shown: keep the whole image)
+	int left = (int)std::floor(region.x * imageSize.width);
+	int top = (int)std::floor(region.y * imageSize.height);
+	int right = (int)std::ceil((region.x + region.width) * imageSize.width);
+	int bottom = (int)std::ceil((region.y + region.height) * imageSize.height);
+	cv::Rect roi = cv::Rect(left, top, right - left, bottom - top) & cv::Rect(0, 0, imageSize.width, imageSize.height);
+	if (roi.area() == 0) roi = cv::Rect(0, 0, imageSize.width, imageSize.height);
+	return roi;
+}
+
+bool FrameCaptureHandler::retrieveFrame(cv::Mat& out)
+{
+	bool retrieved = source->retrieve(out);
+	// the rest of the pipeline (and texture upload) works on 8 bit BGR
+	if (retrieved && out.type() == CV_8UC4) cv::cvtColor(out, out, CV_BGRA2BGR);
+	else if (retrieved && out.type() == CV_8UC1) cv::cvtColor(out, out, CV_GRAY2BGR);
+	return retrieved;
+}
+
 /*
 void FrameCaptureHandler::getCameraParameters(aruco::CameraParameters& outParameters)
 {
@@ -267,53 +510,29 @@ double FrameCaptureHandler::adjustManualCaptureDelay(const short int adjustValue
 {
 	if (currentCompensationMode == Precise_manual)
 	{
-		// set manual delay compensation
-		cameraCaptureManualDelayMs += adjustValue;
-		if (cameraCaptureManualDelayMs > 200) cameraCaptureManualDelayMs = 50;
-		else if (cameraCaptureManualDelayMs < 0) cameraCaptureManualDelayMs = 0;
+		// set manual delay compensation (one store: the capture thread never sees an unclamped value)
+		double delayMs = cameraCaptureManualDelayMs + adjustValue;
+		if (delayMs > 200) delayMs = 50;
+		else if (delayMs < 0) delayMs = 0;
+		cameraCaptureManualDelayMs = delayMs;
 	}
 	return cameraCaptureManualDelayMs;
 }
 
-void FrameCaptureHandler::fromFileLoop() {
-
-	Ogre::Quaternion noRotation = Ogre::Quaternion::IDENTITY;
-	FrameCaptureData captured; // cpudst is the cv::Mat in FrameCaptureData struct
-
-	while (!stopped)
-	{
-		// grab a new frame
-		if (videoCapture.grab())	// grabs a frame without decoding it
-		{
-
-			cv::Mat distorted;
-			// if frame is valid, decode and save it
-			videoCapture.retrieve(distorted);
-			// No orientation info is saved for the image
-			captured.image.orientation[0] = noRotation.x;
-			captured.image.orientation[1] = noRotation.y;
-			captured.image.orientation[2] = noRotation.z;
-			captured.image.orientation[3] = noRotation.w;
-			captured.image.rgb = distorted;
-			cout<<"CAPTURED "<<videoCapture.get(CV_CAP_PROP_FPS)<<endl;
-			set(captured);
-		}
-
-
-	}
-}
-
 void FrameCaptureHandler::captureLoop() {
 
-	cv::gpu::CudaMem src_image_pagelocked_buffer(cv::Size(FORCE_WIDTH_RESOLUTION, FORCE_HEIGHT_RESOLUTION), CV_8UC3);	//page locked buffer in RAM ready for asynchronous transfer to GPU (same color code and resolution as image!)
-	cv::gpu::CudaMem dst_image_pagelocked_buffer(cv::Size(FORCE_WIDTH_RESOLUTION, FORCE_HEIGHT_RESOLUTION), CV_8UC3);
-	cv::Mat cpusrc = src_image_pagelocked_buffer;
-	cv::Mat fx = dst_image_pagelocked_buffer;
+	//page locked buffers in RAM ready for asynchronous transfer to GPU (same color code and resolution as image!):
+	//filterSourceBuffer and filterOutputBuffer, allocated with the first frame and again if the source delivers another size
+	cv::Mat cpusrc;
+	cv::Mat fx = filterOutputBuffer;
 	cv::gpu::Stream image_processing_pipeline;
 	cv::gpu::GpuMat gpusrc, gpudst;
 	FrameCaptureData captured; // cpudst is the cv::Mat in FrameCaptureData struct
 	aruco::MarkerDetector videoMarkerDetector;
 	std::vector<aruco::Marker> markers;
+	aruco::CameraParameters roiCameraParams;	// videoCaptureParamsUndistorted as seen from the region of interest
+	cv::Rect roiCameraParamsFor;
+	std::shared_ptr<const RemapTables> frameRemapTables = remapTables;	// remapTables, or the same for the frame size
 
 	Ogre::Quaternion noRotation = Ogre::Quaternion::IDENTITY;
 	captured.image.orientation[0] = noRotation.x;
@@ -321,11 +540,16 @@ void FrameCaptureHandler::captureLoop() {
 	captured.image.orientation[2] = noRotation.z;
 	captured.image.orientation[3] = noRotation.w;
 
+	// What the source can do decides pacing and timestamping below
+	const CaptureSource::Capabilities capabilities = source->getCapabilities();
+
 	// TIME VARIABLES FOR MANUAL CAPTURING TIME
 	//int fps = 30;		// FPS is set in constructor
+	// sources that do not pace themselves (files) are played at handler fps, or at their own rate if none was given
+	double scheduleFps = (fps > 0 || capabilities.selfPaced) ? fps : source->getFps();
 	std::chrono::duration< double, std::micro > frame_delay;
-	if(fps<=0) frame_delay = std::chrono::duration< double, std::micro >::zero();
-	else frame_delay = std::chrono::microseconds(1000000/fps);
+	if(scheduleFps<=0) frame_delay = std::chrono::duration< double, std::micro >::zero();
+	else frame_delay = std::chrono::duration< double, std::micro >(1000000.0/scheduleFps);
     // Time structures for jitter/delay removal
     std::chrono::steady_clock::time_point frameStart_time;
     std::chrono::steady_clock::time_point frameEnd_time;
@@ -334,6 +558,11 @@ void FrameCaptureHandler::captureLoop() {
     std::chrono::duration< double, std::micro > needed_sleep_delay = std::chrono::duration< double, std::micro >::zero();
     std::chrono::duration< double, std::micro > computation_delay = std::chrono::duration< double, std::micro >::zero();
 
+	// Failure detection (see reconnect())
+	unsigned int consecutiveGrabFailures = 0;
+	std::chrono::steady_clock::time_point lastGrab_time = std::chrono::steady_clock::now();
+	bool firstGrab = true;
+
 	// START CAPTURE LOOP!
 	frameStart_time = captureStart_time;	// force start capture time (first loop won't make sense but the following loops will stay in sync)
 	while (!stopped) {
@@ -351,8 +580,10 @@ void FrameCaptureHandler::captureLoop() {
 		// so "cameraCaptureDelayMs" is used to predict a PAST pose relative to this moment
 		// LOCAL OCULUSSDK HAS BEEN TWEAKED TO "PREDICT IN THE PAST" (extension of: ovrHmd_GetTrackingState)
 		double ovrTimestamp = ovr_GetTimeInSeconds();	// very precise timing! - more than ovr_GetTimeInMilliseconds()
+		double poseTimestamp = 0;						// time the tracking state below refers to
 		ovrTrackingState tracking;
-		switch (currentCompensationMode)
+		// recorded frames were not taken now: head pose at grab time has nothing to do with them
+		switch (capabilities.liveCapture ? currentCompensationMode.load() : None)
 		{
 		case None:
 			// No orientation info is saved for the image
@@ -360,20 +591,24 @@ void FrameCaptureHandler::captureLoop() {
 			captured.image.orientation[1] = noRotation.y;
 			captured.image.orientation[2] = noRotation.z;
 			captured.image.orientation[3] = noRotation.w;
+			captured.poseTime = 0;
 			break;
 		case Approximate:
 			// Just save pose for the image before grabbing a new frame
-			tracking = ovrHmd_GetTrackingState(hmd, ovrTimestamp);
+			poseTimestamp = ovrTimestamp;
+			tracking = hmd->getTrackingState(poseTimestamp);
 			break;
 		case Precise_manual:
 			// Save the pose keeping count of grab() call delay (manually set)
 			// Version of OCULUSSDK included in this project has been tweaked to "PREDICT IN THE PAST"
-			tracking = ovrHmd_GetTrackingStateExtended(hmd, (ovrTimestamp - (cameraCaptureManualDelayMs/1000) ));	// Function wants double in seconds
+			poseTimestamp = ovrTimestamp - (cameraCaptureManualDelayMs/1000);	// Function wants double in seconds
+			tracking = hmd->getTrackingStateExtended(poseTimestamp);
 			break;
 		case Precise_auto:
 			// Save the pose keeping count of grab() call delay (automatically computed)
 			// Version of OCULUSSDK included in this project has been tweaked to "PREDICT IN THE PAST"
-			tracking = ovrHmd_GetTrackingStateExtended(hmd, (ovrTimestamp - (cameraCaptureRealDelayMs/1000) ));		// Function wants double in seconds
+			poseTimestamp = ovrTimestamp - (cameraCaptureRealDelayMs/1000);		// Function wants double in seconds
+			tracking = hmd->getTrackingStateExtended(poseTimestamp);
 			break;
 		default:
 			// If something goes wrong in mode selection, disable compensation.
@@ -381,13 +616,41 @@ void FrameCaptureHandler::captureLoop() {
 			break;
 		}
 				
-		// grab a new frame
-		if (videoCapture.grab())	// grabs a frame without decoding it
+		// grab a new frame (or simulate a device hiccup, if failures were injected)
+		captured.grabTime = ovrTimestamp;
+		bool grabbed;
+		unsigned int pendingFailures = injectedGrabFailures;
+		if (pendingFailures > 0 && injectedGrabFailures.compare_exchange_strong(pendingFailures, pendingFailures - 1))
+			grabbed = false;
+		else
+		{
+			TRACE_SCOPE("grab");
+			grabStartTime = ovrTimestamp;		// watched by checkStall()
+			grabbed = source->grab();	// grabs a frame without decoding it
+			grabStartTime = 0;
+			if (!grabbed && capabilities.finite)
+				grabbed = source->rewind();	// end of stream: play it again
+		}
+		// if frame is valid, decode it: a frame that can not be decoded is a failed grab as well (nothing is published)
+		cv::Mat distorted;
+		if (grabbed)
 		{
-			if (currentCompensationMode == Precise_auto)
+			TRACE_SCOPE("retrieve");
+			grabbed = retrieveFrame(distorted) && !distorted.empty();
+		}
+
+		if (grabbed)
+		{
+			std::chrono::steady_clock::time_point grab_time = std::chrono::steady_clock::now();
+			if (!firstGrab) grabIntervals.add(std::chrono::duration< double, std::milli >(grab_time - lastGrab_time).count());
+			firstGrab = false;
+			consecutiveGrabFailures = 0;
+			lastGrab_time = grab_time;
+
+			if (capabilities.liveCapture && currentCompensationMode == Precise_auto)
 			{
 				// try to real timestamp when frame was captured by device
-				double realTimestamp = videoCapture.get(CV_CAP_PROP_POS_MSEC);
+				double realTimestamp = capabilities.deviceTimestamps ? source->timestamp() : -1;
 				if (realTimestamp != -1)
 				{
 					// compute grab() call delay compensation
@@ -420,19 +683,46 @@ void FrameCaptureHandler::captureLoop() {
 			
 			
 
-			cv::Mat distorted, undistorted;
-			// if frame is valid, decode and save it
-			videoCapture.retrieve(distorted);
+			cv::Mat undistorted;
+			captured.retrieveTime = ovr_GetTimeInSeconds();
+			framesCaptured++;
 			// USE THIS LINE TO UNDERSTAND WHICH IMAGE TYPE IS RETURNED BY YOUR videoCapture
 			//std::cout<< type2str(distorted.type()) <<std::endl;
 			// THEN USE THIS TYPE FOR ANY OPERATION ON THE RETRIEVED IMAGE
 
-			// perform undistortion (with parameters of the camera)
-			if(undistort)
-				cv::undistort(distorted, undistorted, videoCaptureParams.CameraMatrix, videoCaptureParams.Distorsion);
+			// only the region of interest is processed from here on (pixels outside it are not shown)
+			const cv::Rect roi = getRegionOfInterest(distorted.size());
+			captured.image.roi = roi;
+
+			// perform undistortion (with parameters of the camera), and rectification if the pair is calibrated:
+			// one remap with the tables computed at startup (rebuilt once, scaled, if images are not of the calibration size)
+			// Tables map every destination pixel, so the region of interest is remapped alone with the same result.
+			if(undistort && frameRemapTables)
+			{
+				TRACE_SCOPE("undistort");
+				if (frameRemapTables->size != distorted.size())
+				{
+					std::cout << source->getName() << ": " << distorted.cols << "x" << distorted.rows << " frames, calibrated at "
+						<< remapTables->size.width << "x" << remapTables->size.height << ". Undistortion tables scaled." << std::endl;
+					frameRemapTables = resizeRemapTables(*remapTables, distorted.size());
+				}
+				undistorted.create(distorted.size(), distorted.type());
+				cv::Mat undistortedRoi = undistorted(roi);
+				cv::remap(distorted, undistortedRoi, frameRemapTables->map1(roi), frameRemapTables->map2(roi), cv::INTER_LINEAR);
+			}
 			else
 				undistorted = distorted;
 
+			// page locked buffers follow the frame size (a source may not deliver FORCE_WIDTH/HEIGHT_RESOLUTION frames)
+			if (filterOutputBuffer.size() != undistorted.size())
+			{
+				// create() would free the output buffer under frames already published from it: a reference is kept
+				if (!filterOutputBuffer.empty()) retiredFilterBuffers.push_back(filterOutputBuffer);
+				filterSourceBuffer.create(undistorted.rows, undistorted.cols, CV_8UC3);
+				filterOutputBuffer.create(undistorted.rows, undistorted.cols, CV_8UC3);
+				fx = filterOutputBuffer;
+			}
+
 			cpusrc = undistorted;
 			// GPU ASYNC OPERATIONS
 			// -------------------------------
@@ -440,7 +730,8 @@ void FrameCaptureHandler::captureLoop() {
 			bool toonActive = toon;
 			if(toonActive)
 			{
-				image_processing_pipeline.enqueueUpload(cpusrc, gpusrc);
+				TRACE_SCOPE("filter enqueue");
+				image_processing_pipeline.enqueueUpload(cpusrc(roi), gpusrc);
 				// Other elaboration on image
 				// - - - PUT IT HERE! - - -
 				// TOON in GPU - from: https://github.com/BloodAxe/OpenCV-Tutorial/blob/master/OpenCV%20Tutorial/CartoonFilter.cpp
@@ -453,8 +744,9 @@ void FrameCaptureHandler::captureLoop() {
 			    cv::gpu::cvtColor(edges, edgesBgr, cv::COLOR_GRAY2BGR);
 			    cv::gpu::cvtColor(bgr_a, bgr, cv::COLOR_BGRA2BGR);			// hack: I need the BGR version from alpha result
 			    cv::gpu::subtract(bgr, edgesBgr, gpudst);					// gpudst = bgr - edgesBgr;
-				// Download final result image to ram
-				image_processing_pipeline.enqueueDownload(gpudst, fx);
+				// Download final result image to ram (in place of the region of interest)
+				cv::Mat fxRoi = fx(roi);
+				image_processing_pipeline.enqueueDownload(gpudst, fxRoi);
 			}
 
 			// CPU SYNC OPERATIONS
@@ -462,10 +754,25 @@ void FrameCaptureHandler::captureLoop() {
 			// AR detection operation
 			if (arEnabled)
 			{
+				TRACE_SCOPE("aruco");
 				// clear previously captured markers
 				captured.markers.clear();
-				// detect markers in the image
-				videoMarkerDetector.detect(undistorted, markers, videoCaptureParamsUndistorted, 0.1f);	//need marker size in meters
+				// detect markers in the region of interest (principal point moved to its origin, poses are the same)
+				if (roiCameraParamsFor != roi)
+				{
+					// (resized to the image first: aruco would scale parameters of another size to the region instead)
+					roiCameraParams = videoCaptureParamsUndistorted;
+					if (roiCameraParams.isValid())
+					{
+						roiCameraParams.CameraMatrix = videoCaptureParamsUndistorted.CameraMatrix.clone();
+						roiCameraParams.resize(undistorted.size());
+						roiCameraParams.CameraMatrix.at<float>(0, 2) -= (float)roi.x;
+						roiCameraParams.CameraMatrix.at<float>(1, 2) -= (float)roi.y;
+						roiCameraParams.CamSize = roi.size();
+					}
+					roiCameraParamsFor = roi;
+				}
+				videoMarkerDetector.detect(undistorted(roi), markers, roiCameraParams, 0.1f);	//need marker size in meters
 				// show nodes for detected markers
 				for (unsigned int i = 0; i<markers.size(); i++) {
 					ARCaptureData new_marker;
@@ -475,7 +782,7 @@ void FrameCaptureHandler::captureLoop() {
 				}
 			}
 			// finally save pose as well (previously computed)
-			if (currentCompensationMode != None)
+			if (capabilities.liveCapture && currentCompensationMode != None)
 			{
 				if (tracking.StatusFlags & (ovrStatus_OrientationTracked | ovrStatus_PositionTracked)) {
 					Posef pose = tracking.HeadPose.ThePose;		// The cpp compatibility layer is used to convert ovrPosef to Posef (see OVR_Math.h)
@@ -484,6 +791,7 @@ void FrameCaptureHandler::captureLoop() {
 					captured.image.orientation[1] = pose.Rotation.x;
 					captured.image.orientation[2] = pose.Rotation.y;
 					captured.image.orientation[3] = pose.Rotation.z;
+					captured.poseTime = poseTimestamp;
 				}
 				else
 				{
@@ -509,7 +817,10 @@ void FrameCaptureHandler::captureLoop() {
 		    */
 
 			// wait for gpu pipeline to end
-			image_processing_pipeline.waitForCompletion();
+			{
+				TRACE_SCOPE("filter wait");
+				image_processing_pipeline.waitForCompletion();
+			}
 			// -------------------------------					
 
 			// show image with or without fx?
@@ -518,7 +829,10 @@ void FrameCaptureHandler::captureLoop() {
 			else
 				captured.image.rgb = undistorted;
 			// set the new capture as available (result of both gpu/cpu operations)
-			set(captured);
+			{
+				TRACE_SCOPE_ID("publish", framesPublished + 1);
+				set(captured);
+			}
 			//std::cout << "Frame retrieved from " << deviceId << "." << std::endl;
 
 			//std::cout.precision(20);
@@ -526,7 +840,22 @@ void FrameCaptureHandler::captureLoop() {
 		}
 		else
 		{
-			std::cout << "FAILED to retrieve frame from "<< deviceId <<"." << std::endl;
+			framesFailed++;
+			// print only the first failure of a streak, the rest is counted
+			if (consecutiveGrabFailures == 0) std::cout << "FAILED to retrieve frame from "<< source->getName() <<"." << std::endl;
+			consecutiveGrabFailures++;
+
+			// device is gone or stuck: close and reopen it (renderer keeps showing the last good frame)
+			if (consecutiveGrabFailures >= reconnectAfterFailures || std::chrono::steady_clock::now() - lastGrab_time > reconnectTimeout)
+			{
+				if (!reconnect()) break;	// stop was requested while reconnecting
+				consecutiveGrabFailures = 0;
+				lastGrab_time = std::chrono::steady_clock::now();
+				// restart schedule from now, the time spent reconnecting must not be "recovered"
+				frameStart_time = lastGrab_time;
+				wakeup_jitter = std::chrono::duration< double, std::micro >::zero();
+				continue;
+			}
 		}
 
 
@@ -541,13 +870,13 @@ void FrameCaptureHandler::captureLoop() {
 		needed_sleep_delay = frame_delay - computation_delay - wakeup_jitter;
 				//cout<< "new nominal wake-up delay: "<<std::chrono::duration_cast<std::chrono::microseconds>(needed_sleep_delay).count()<<endl;
 				//cout<<"------"<<endl;
-		if(needed_sleep_delay.count()<0)	//the loop is late on time schedule -> change behaviour to keep in sync with captureStart_time: the closest frameStart_time on schedule will be chosen as the new one 
+		if(needed_sleep_delay.count()<0 && frame_delay.count()>0)	//the loop is late on time schedule -> change behaviour to keep in sync with captureStart_time: the closest frameStart_time on schedule will be chosen as the new one 
 		{
 			lateOnSchedule = true;
 			// Reset variables for sleep (thread will continue running with no sleep to help recover the time lost)
 			needed_sleep_delay = std::chrono::duration< double, std::micro >::zero();
 			wakeup_jitter = std::chrono::duration< double, std::micro >::zero();
-			std::cout<<"Warning: camera "<<deviceId<<" capture was late on schedule. It took more than "<<(1000000/fps)<<" microseconds to execute."<<std::endl;
+			std::cout<<"Warning: "<<source->getName()<<" capture was late on schedule. It took more than "<<(long)frame_delay.count()<<" microseconds to execute."<<std::endl;
 			// Compute run-out skew of the thread in respect to schedule frequency (it will be the difference between the last frameEnd_time and the closest oldest frameStart_time on the ideal schedule)
 			int skew_micros = std::chrono::duration_cast<std::chrono::milliseconds>(computation_delay).count() % std::chrono::duration_cast<std::chrono::milliseconds>(frame_delay).count();
 			std::chrono::duration< double, std::micro > skew = std::chrono::microseconds(skew_micros);
@@ -579,6 +908,9 @@ void FrameCaptureHandler::captureLoop() {
 			// -  This thread needs all the time possible: if we put it to sleep, it will never wake up at the exact time he should, so some time will always be wasted (wakeup_jitter)
 			// If the thread has free time, it will try to call the grab() again, which will return with the right frequency. This is different from Ogre, which will always try to 
 			// render more and more frames indefinitely, which is useless and consumpt a lot of cpu cycles!!
+			// Sources that are not paced by themselves (files, image sequences) DO need the sleep, or they would be played as fast as they decode.
+			if (!capabilities.selfPaced && needed_sleep_delay.count() > 0)
+				std::this_thread::sleep_for(needed_sleep_delay);
 			
 			/*
 			#if OGRE_PLATFORM == OGRE_PLATFORM_WIN32
@@ -0,0 +1,96 @@
+#include "CaptureSource.h"
+#include "Globals.h"
+#include <cstdio>
+
+////////////////////////////////////////////////
+// Camera device
+////////////////////////////////////////////////
+bool DeviceCaptureSource::open()
+{
+	if (!videoCapture.open(deviceId)) return false;
+	videoCapture.set(CV_CAP_PROP_FOURCC, CV_FOURCC('H', '2', '6', '4'));
+	//videoCapture.set(CV_CAP_PROP_FOURCC, CV_FOURCC('M', 'J', 'P', 'G'));
+	videoCapture.set(CV_CAP_PROP_FRAME_WIDTH, FORCE_WIDTH_RESOLUTION);
+	videoCapture.set(CV_CAP_PROP_FRAME_HEIGHT, FORCE_HEIGHT_RESOLUTION);
+	videoCapture.set(CV_CAP_PROP_FPS, fps);		// in future: leave OpenCV to request to device frames as fast as he can (it minimizes delay and not support all range of FPSs)
+												// the variable "fps" will still be used to sync the grab() calls, even though in future releases grab() should be called repeatedly and then take from those a subset dependent on FPS
+	//videoCapture.set(CV_CAP_PROP_FOCUS, 0);
+	//videoCapture.set(CV_CAP_PROP_EXPOSURE, ??);
+	return true;
+}
+
+CaptureSource::Capabilities DeviceCaptureSource::getCapabilities() const
+{
+	Capabilities capabilities;
+	capabilities.selfPaced = true;			// OpenCV ALREADY controls FPS when opening device and blocks grab() until a frame is there
+	capabilities.liveCapture = true;
+	capabilities.deviceTimestamps = true;	// if the backend does not support it, timestamp() returns -1 and Precise_auto degrades to manual
+	return capabilities;
+}
+
+////////////////////////////////////////////////
+// Video file
+////////////////////////////////////////////////
+bool FileCaptureSource::open()
+{
+	if (!videoCapture.open(filePath)) return false;
+	fps = videoCapture.get(CV_CAP_PROP_FPS);
+	return true;
+}
+
+CaptureSource::Capabilities FileCaptureSource::getCapabilities() const
+{
+	Capabilities capabilities;
+	capabilities.finite = true;
+	return capabilities;
+}
+
+////////////////////////////////////////////////
+// Image sequence
+////////////////////////////////////////////////
+std::string ImageSequenceCaptureSource::fileName(const unsigned int index) const
+{
+	char buffer[512];
+	snprintf(buffer, sizeof(buffer), pattern.c_str(), index);
+	return std::string(buffer);
+}
+
+bool ImageSequenceCaptureSource::open()
+{
+	// sequence must have at least its first image
+	grabbed = cv::imread(fileName(firstIndex));
+	if (grabbed.empty()) return false;
+	nextIndex = firstIndex;
+	opened = true;
+	return true;
+}
+
+bool ImageSequenceCaptureSource::grab()
+{
+	if (!opened) return false;
+	grabbed = cv::imread(fileName(nextIndex));
+	if (grabbed.empty()) return false;		// end of sequence (or missing image)
+	nextIndex++;
+	return true;
+}
+
+bool ImageSequenceCaptureSource::retrieve(cv::Mat& out)
+{
+	if (grabbed.empty()) return false;
+	out = grabbed;
+	return true;
+}
+
+bool ImageSequenceCaptureSource::rewind()
+{
+	if (!opened) return false;
+	nextIndex = firstIndex;
+	return grab();
+}
+
+CaptureSource::Capabilities ImageSequenceCaptureSource::getCapabilities() const
+{
+	Capabilities capabilities;
+	capabilities.finite = true;
+	return capabilities;
+}
@@ -0,0 +1,265 @@
+#include "DistortionMesh.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	// Bump when the file layout (or ovrDistortionVertex) changes: old files are then ignored
+	const uint32_t CacheFileVersion = 1;
+	const char CacheFileMagic[4] = { 'O', 'D', 'M', 'C' };
+
+	struct PackedVertex
+	{
+		float x, y;
+		short tanEyeAngles[3][2];
+		Ogre::RGBA colour;
+	};
+	static_assert(sizeof(PackedVertex) == PackedDistortionVertexSize, "PackedVertex layout does not match its vertex declaration");
+
+	uint64_t fnv1a(const std::string& text)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for (unsigned char c : text)
+		{
+			hash ^= c;
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	short quantize(const float value, const float scale)
+	{
+		return (short)Ogre::Math::Clamp(std::floor(value / scale + 0.5f), -32767.0f, 32767.0f);
+	}
+}
+
+std::string DistortionMeshCache::makeKey(const HmdDevice& hmd, const int eye, const ovrEyeRenderDesc& renderDesc, const unsigned int distortionCaps)
+{
+	std::ostringstream key;
+	key << std::setprecision(9)
+		<< "v" << CacheFileVersion << "/" << sizeof(ovrDistortionVertex)
+		<< "|" << hmd.getProductName() << "|" << hmd.getType()
+		<< "|" << hmd.getResolution().w << "x" << hmd.getResolution().h
+		<< "|eye " << eye
+		<< "|fov " << renderDesc.Fov.LeftTan << " " << renderDesc.Fov.RightTan << " " << renderDesc.Fov.UpTan << " " << renderDesc.Fov.DownTan
+		<< "|caps " << distortionCaps
+		<< "|viewport " << renderDesc.DistortedViewport.Pos.x << " " << renderDesc.DistortedViewport.Pos.y << " " << renderDesc.DistortedViewport.Size.w << " " << renderDesc.DistortedViewport.Size.h
+		<< "|ppt " << renderDesc.PixelsPerTanAngleAtCenter.x << " " << renderDesc.PixelsPerTanAngleAtCenter.y;
+	return key.str();
+}
+
+std::string DistortionMeshCache::getFileName(const std::string& key) const
+{
+	std::ostringstream name;
+	name << prefix << std::hex << std::setw(16) << std::setfill('0') << fnv1a(key) << ".bin";
+	return name.str();
+}
+
+bool DistortionMeshCache::load(const std::string& key, HmdDistortionMesh& out) const
+{
+	out.vertices.clear();
+	out.indices.clear();
+	if (!isEnabled()) return false;
+
+	std::ifstream file(getFileName(key), std::ios::binary);
+	if (!file) return false;
+
+	char magic[4];
+	uint32_t version = 0, keyLength = 0, vertexCount = 0, indexCount = 0;
+	file.read(magic, sizeof(magic));
+	file.read((char*)&version, sizeof(version));
+	file.read((char*)&keyLength, sizeof(keyLength));
+	if (!file || !std::equal(magic, magic + 4, CacheFileMagic) || version != CacheFileVersion || keyLength != key.size()) return false;
+
+	// the whole key is stored: a hash collision in the file name is not a wrong mesh
+	std::string storedKey(keyLength, '\0');
+	file.read(&storedKey[0], keyLength);
+	file.read((char*)&vertexCount, sizeof(vertexCount));
+	file.read((char*)&indexCount, sizeof(indexCount));
+	if (!file || storedKey != key || vertexCount == 0 || indexCount == 0) return false;
+
+	out.vertices.resize(vertexCount);
+	out.indices.resize(indexCount);
+	file.read((char*)out.vertices.data(), vertexCount * sizeof(ovrDistortionVertex));
+	file.read((char*)out.indices.data(), indexCount * sizeof(unsigned short));
+	if (!file)
+	{
+		out.vertices.clear();
+		out.indices.clear();
+		return false;
+	}
+	return true;
+}
+
+void DistortionMeshCache::save(const std::string& key, const HmdDistortionMesh& mesh) const
+{
+	if (!isEnabled() || mesh.vertices.empty() || mesh.indices.empty()) return;
+
+	std::ofstream file(getFileName(key), std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "Distortion mesh cache: cannot write " << getFileName(key) << std::endl;
+		return;
+	}
+	uint32_t keyLength = (uint32_t)key.size();
+	uint32_t vertexCount = (uint32_t)mesh.vertices.size();
+	uint32_t indexCount = (uint32_t)mesh.indices.size();
+	file.write(CacheFileMagic, sizeof(CacheFileMagic));
+	file.write((const char*)&CacheFileVersion, sizeof(CacheFileVersion));
+	file.write((const char*)&keyLength, sizeof(keyLength));
+	file.write(key.data(), keyLength);
+	file.write((const char*)&vertexCount, sizeof(vertexCount));
+	file.write((const char*)&indexCount, sizeof(indexCount));
+	file.write((const char*)mesh.vertices.data(), vertexCount * sizeof(ovrDistortionVertex));
+	file.write((const char*)mesh.indices.data(), indexCount * sizeof(unsigned short));
+}
+
+Ogre::MeshPtr createPackedDistortionMesh(const std::string& name, const HmdDistortionMesh& meshData, const std::string& materialName, float& tanEyeAngleScale)
+{
+	const size_t vertexCount = meshData.vertices.size();
+	if (vertexCount == 0 || vertexCount > 65536)
+		OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Distortion mesh " + name + " has " + Ogre::StringConverter::toString(vertexCount) + " vertices (1 to 65536 supported)", "createPackedDistortionMesh");
+
+	// quantization step: the largest tan angle of the mesh maps to the largest short
+	float maxTan = 0;
+	Ogre::AxisAlignedBox bounds;
+	for (const ovrDistortionVertex& v : meshData.vertices)
+	{
+		maxTan = std::max(maxTan, std::max(std::abs(v.TanEyeAnglesR.x), std::abs(v.TanEyeAnglesR.y)));
+		maxTan = std::max(maxTan, std::max(std::abs(v.TanEyeAnglesG.x), std::abs(v.TanEyeAnglesG.y)));
+		maxTan = std::max(maxTan, std::max(std::abs(v.TanEyeAnglesB.x), std::abs(v.TanEyeAnglesB.y)));
+		bounds.merge(Ogre::Vector3(v.ScreenPosNDC.x, v.ScreenPosNDC.y, -0.01f));
+		bounds.merge(Ogre::Vector3(v.ScreenPosNDC.x, v.ScreenPosNDC.y, 0.01f));
+	}
+	tanEyeAngleScale = maxTan > 0 ? maxTan / 32767.0f : 1.0f;
+
+	// interleave
+	Ogre::VertexElementType colourType = Ogre::VertexElement::getBestColourVertexElementType();
+	std::vector<PackedVertex> packed(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const ovrDistortionVertex& v = meshData.vertices[i];
+		const ovrVector2f* tanEyeAngles[3] = { &v.TanEyeAnglesR, &v.TanEyeAnglesG, &v.TanEyeAnglesB };
+		packed[i].x = v.ScreenPosNDC.x;
+		packed[i].y = v.ScreenPosNDC.y;
+		for (int c = 0; c < 3; c++)
+		{
+			packed[i].tanEyeAngles[c][0] = quantize(tanEyeAngles[c]->x, tanEyeAngleScale);
+			packed[i].tanEyeAngles[c][1] = quantize(tanEyeAngles[c]->y, tanEyeAngleScale);
+		}
+		float vig = std::max(v.VignetteFactor, 0.0f);
+		float tw = std::max(v.TimeWarpFactor, 0.0f);
+		packed[i].colour = Ogre::VertexElement::convertColourValue(Ogre::ColourValue(vig, vig, vig, tw), colourType);
+	}
+
+	Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().createManual(name, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+	Ogre::SubMesh* subMesh = mesh->createSubMesh();
+	subMesh->useSharedVertices = false;
+	subMesh->operationType = Ogre::RenderOperation::OT_TRIANGLE_LIST;
+	subMesh->setMaterialName(materialName);
+
+	// one static buffer, attributes in the order of PackedVertex
+	subMesh->vertexData = new Ogre::VertexData();
+	subMesh->vertexData->vertexStart = 0;
+	subMesh->vertexData->vertexCount = vertexCount;
+	Ogre::VertexDeclaration* decl = subMesh->vertexData->vertexDeclaration;
+	size_t offset = 0;
+	offset += decl->addElement(0, offset, Ogre::VET_FLOAT2, Ogre::VES_POSITION).getSize();
+	for (unsigned short uv = 0; uv < 3; uv++)
+		offset += decl->addElement(0, offset, Ogre::VET_SHORT2, Ogre::VES_TEXTURE_COORDINATES, uv).getSize();
+	offset += decl->addElement(0, offset, colourType, Ogre::VES_DIFFUSE).getSize();
+
+	Ogre::HardwareVertexBufferSharedPtr vertexBuffer = Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
+		offset, vertexCount, Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+	vertexBuffer->writeData(0, vertexBuffer->getSizeInBytes(), packed.data(), true);
+	subMesh->vertexData->vertexBufferBinding->setBinding(0, vertexBuffer);
+
+	Ogre::HardwareIndexBufferSharedPtr indexBuffer = Ogre::HardwareBufferManager::getSingleton().createIndexBuffer(
+		Ogre::HardwareIndexBuffer::IT_16BIT, meshData.indices.size(), Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+	indexBuffer->writeData(0, indexBuffer->getSizeInBytes(), meshData.indices.data(), true);
+	subMesh->indexData->indexBuffer = indexBuffer;
+	subMesh->indexData->indexStart = 0;
+	subMesh->indexData->indexCount = meshData.indices.size();
+
+	mesh->_setBounds(bounds);
+	mesh->_setBoundingSphereRadius(std::max(bounds.getMinimum().length(), bounds.getMaximum().length()));
+	mesh->load();
+	return mesh;
+}
+
+void bakeDistortionLookup(const std::string& name, const HmdDistortionMesh& meshData, const unsigned int width, const unsigned int height, Ogre::TexturePtr lookup[2], Ogre::Vector4& ndcBounds)
+{
+	if (meshData.vertices.empty() || width == 0 || height == 0)
+		OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Cannot bake distortion lookup " + name + " (empty mesh or size)", "bakeDistortionLookup");
+
+	float minX = meshData.vertices[0].ScreenPosNDC.x, maxX = minX;
+	float minY = meshData.vertices[0].ScreenPosNDC.y, maxY = minY;
+	for (const ovrDistortionVertex& v : meshData.vertices)
+	{
+		minX = std::min(minX, v.ScreenPosNDC.x);
+		maxX = std::max(maxX, v.ScreenPosNDC.x);
+		minY = std::min(minY, v.ScreenPosNDC.y);
+		maxY = std::max(maxY, v.ScreenPosNDC.y);
+	}
+	ndcBounds = Ogre::Vector4(minX, minY, maxX, maxY);
+
+	// texel (0,0) is the top left corner of the bounds, texel centres at integer coordinates
+	std::vector<float> texels[2] = { std::vector<float>(width * height * 4, 0.0f), std::vector<float>(width * height * 4, 0.0f) };
+	const float scaleX = width / (maxX - minX);
+	const float scaleY = height / (maxY - minY);
+	const float epsilon = 1e-5f;		// texel centres on shared edges are written by both triangles (same values)
+	for (size_t t = 0; t + 2 < meshData.indices.size(); t += 3)
+	{
+		const ovrDistortionVertex* v[3] = { &meshData.vertices[meshData.indices[t]], &meshData.vertices[meshData.indices[t + 1]], &meshData.vertices[meshData.indices[t + 2]] };
+		float px[3], py[3];
+		for (int k = 0; k < 3; k++)
+		{
+			px[k] = (v[k]->ScreenPosNDC.x - minX) * scaleX - 0.5f;
+			py[k] = (maxY - v[k]->ScreenPosNDC.y) * scaleY - 0.5f;
+		}
+		float area = (px[1] - px[0]) * (py[2] - py[0]) - (px[2] - px[0]) * (py[1] - py[0]);
+		if (std::abs(area) < 1e-12f) continue;
+
+		int x0 = std::max(0, (int)std::ceil(std::min(px[0], std::min(px[1], px[2]))));
+		int x1 = std::min((int)width - 1, (int)std::floor(std::max(px[0], std::max(px[1], px[2]))));
+		int y0 = std::max(0, (int)std::ceil(std::min(py[0], std::min(py[1], py[2]))));
+		int y1 = std::min((int)height - 1, (int)std::floor(std::max(py[0], std::max(py[1], py[2]))));
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				// barycentric weights (linear interpolation across the triangle, as the rasterizer does for the mesh)
+				float w0 = ((px[1] - x) * (py[2] - y) - (px[2] - x) * (py[1] - y)) / area;
+				float w1 = ((px[2] - x) * (py[0] - y) - (px[0] - x) * (py[2] - y)) / area;
+				float w2 = 1.0f - w0 - w1;
+				if (w0 < -epsilon || w1 < -epsilon || w2 < -epsilon) continue;
+
+				float* rg = &texels[0][(y * width + x) * 4];
+				float* b = &texels[1][(y * width + x) * 4];
+				rg[0] = w0 * v[0]->TanEyeAnglesR.x + w1 * v[1]->TanEyeAnglesR.x + w2 * v[2]->TanEyeAnglesR.x;
+				rg[1] = w0 * v[0]->TanEyeAnglesR.y + w1 * v[1]->TanEyeAnglesR.y + w2 * v[2]->TanEyeAnglesR.y;
+				rg[2] = w0 * v[0]->TanEyeAnglesG.x + w1 * v[1]->TanEyeAnglesG.x + w2 * v[2]->TanEyeAnglesG.x;
+				rg[3] = w0 * v[0]->TanEyeAnglesG.y + w1 * v[1]->TanEyeAnglesG.y + w2 * v[2]->TanEyeAnglesG.y;
+				b[0] = w0 * v[0]->TanEyeAnglesB.x + w1 * v[1]->TanEyeAnglesB.x + w2 * v[2]->TanEyeAnglesB.x;
+				b[1] = w0 * v[0]->TanEyeAnglesB.y + w1 * v[1]->TanEyeAnglesB.y + w2 * v[2]->TanEyeAnglesB.y;
+				b[2] = std::max(w0 * v[0]->VignetteFactor + w1 * v[1]->VignetteFactor + w2 * v[2]->VignetteFactor, 0.0f);
+				b[3] = std::max(w0 * v[0]->TimeWarpFactor + w1 * v[1]->TimeWarpFactor + w2 * v[2]->TimeWarpFactor, 0.0f);
+			}
+		}
+	}
+
+	// half floats: converted by the upload
+	const char* suffix[2] = { "RG", "B" };
+	for (int i = 0; i < 2; i++)
+	{
+		lookup[i] = Ogre::TextureManager::getSingleton().createManual(name + suffix[i], Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
+			Ogre::TEX_TYPE_2D, width, height, 0, Ogre::PF_FLOAT16_RGBA, Ogre::TU_STATIC_WRITE_ONLY);
+		Ogre::PixelBox box(width, height, 1, Ogre::PF_FLOAT32_RGBA, texels[i].data());
+		lookup[i]->getBuffer()->blitFromMemory(box);
+	}
+}
@@ -0,0 +1,80 @@
+#include "FaultInjectingSource.h"
+#include <iostream>
+
+namespace
+{
+	std::chrono::steady_clock::duration seconds(const double value)
+	{
+		return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration< double >(value));
+	}
+}
+
+bool FaultInjectingSource::open()
+{
+	// reopening right after a dropout fails a few times, as an unplugged device would (exercises backoff)
+	if (pendingFailedOpens > 0)
+	{
+		pendingFailedOpens--;
+		counters->failedOpens++;
+		return false;
+	}
+	if (!inner->open()) return false;
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	nextDropout_time = now + seconds(settings.dropoutIntervalSeconds);
+	nextHang_time = now + seconds(settings.hangIntervalSeconds);
+	pendingDropoutFrames = 0;
+	return true;
+}
+
+bool FaultInjectingSource::grab()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	if (pendingDropoutFrames == 0 && settings.dropoutIntervalSeconds > 0 && settings.dropoutFrames > 0 && now >= nextDropout_time)
+	{
+		std::cout << "Fault injection: " << getName() << " drops out." << std::endl;
+		counters->dropouts++;
+		pendingDropoutFrames = settings.dropoutFrames;
+		pendingFailedOpens = settings.failedReopens;
+		nextDropout_time = now + seconds(settings.dropoutIntervalSeconds);
+	}
+	if (pendingDropoutFrames > 0)
+	{
+		pendingDropoutFrames--;
+		return false;
+	}
+
+	if (settings.hangIntervalSeconds > 0 && now >= nextHang_time)
+	{
+		std::cout << "Fault injection: " << getName() << " hangs in grab()." << std::endl;
+		counters->hangs++;
+		std::unique_lock<std::mutex> lock(mutex);
+		hanging = true;
+		interrupted.wait_for(lock, std::chrono::duration< double >(settings.hangSeconds), [this]() { return interruptRequested; });
+		bool wasInterrupted = interruptRequested;
+		hanging = false;
+		interruptRequested = false;
+		nextHang_time = std::chrono::steady_clock::now() + seconds(settings.hangIntervalSeconds);
+		if (wasInterrupted) return false;
+	}
+
+	return inner->grab();
+}
+
+void FaultInjectingSource::interrupt()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		if (hanging && !settings.hangsLikeDevice) interruptRequested = true;
+	}
+	interrupted.notify_all();
+	inner->interrupt();
+}
+
+std::unique_ptr<CaptureSource> FaultInjectingSource::createFresh() const
+{
+	std::unique_ptr<CaptureSource> freshInner = inner->createFresh();
+	if (!freshInner) return nullptr;
+	return std::unique_ptr<CaptureSource>(new FaultInjectingSource(std::move(freshInner), settings, counters));
+}
@@ -0,0 +1,39 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "OVR.h"
+#include "Trace.h"
+
+FramePacer::FramePacer(const Settings& pacerSettings) : settings(pacerSettings)
+{
+	if (settings.refreshRate <= 0) settings.refreshRate = 75.0;
+	if (settings.vsyncInterval == 0) settings.vsyncInterval = 1;
+	if (settings.spinMs < 0) settings.spinMs = 0;
+}
+
+void FramePacer::waitForFrameStart(const double predictedVsync)
+{
+	TRACE_SCOPE("frame pacing");
+	const double period = 1.0 / settings.refreshRate;
+	double target = predictedVsync + (settings.vsyncInterval - 1) * period + settings.startOffsetMs / 1000.0;
+	double now = ovr_GetTimeInSeconds();
+
+	// coarse sleep, stopping early by the expected wakeup lateness
+	double sleepUntil = target - (oversleepMs + settings.spinMs) / 1000.0;
+	if (sleepUntil > now)
+	{
+		std::this_thread::sleep_for(std::chrono::duration< double >(sleepUntil - now));
+		now = ovr_GetTimeInSeconds();
+		// late wakeups raise the margin at once, early ones lower it slowly
+		double lateMs = (now - sleepUntil) * 1000.0;
+		if (lateMs > oversleepMs) oversleepMs = lateMs;
+		else oversleepMs += (std::max(lateMs, 0.0) - oversleepMs) * 0.05;
+	}
+
+	// spin the rest
+	while (now < target)
+		now = ovr_GetTimeInSeconds();
+
+	startErrors.add((now - target) * 1000.0);
+}
@@ -14,6 +14,11 @@ int CAMERA_TOEIN_ANGLE = 0;
 int CAMERA_KEYSTONING_ANGLE = 0;
 
 bool undistort = false, toon = false;
+bool LATENCY_PROBE = false;							// stamp frames and measure video latency from rendered pixels (see LatencyProbe)
+bool SYNTHETIC_SOURCE = false;						// generated video instead of camera devices (see SyntheticSource, [Synthetic] in parameters.cfg)
+bool SCRIPTED_HMD = false;							// simulated headset, no Oculus runtime (see ScriptedHmdDevice, [ScriptedHmd] in parameters.cfg)
+bool FAULT_INJECTION = false;						// cameras drop out and hang on a schedule (see FaultInjectingSource, [FaultInjection] in parameters.cfg)
+bool BENCHMARK = false;								// offscreen, no input, fixed number of frames then JSON report (see [Benchmark] in parameters.cfg)
 
 //Globals used from Camera.cpp and Scene.cpp
 std::chrono::steady_clock::time_point camera_last_frame_request_time = std::chrono::steady_clock::now();
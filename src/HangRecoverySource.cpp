@@ -0,0 +1,127 @@
+#include "HangRecoverySource.h"
+#include <iostream>
+#include <thread>
+
+HangRecoverySource::HangRecoverySource(std::unique_ptr<CaptureSource> wrappedSource)
+{
+	capabilities = wrappedSource->getCapabilities();
+	name = wrappedSource->getName();
+	fps = wrappedSource->getFps();
+	spare = wrappedSource->createFresh();
+	startWorker(std::move(wrappedSource));
+}
+
+HangRecoverySource::~HangRecoverySource()
+{
+	// capture thread is not running: the worker is idle (or abandoned, and exits on its own)
+	{
+		std::lock_guard<std::mutex> guard(worker->mutex);
+		worker->stopRequested = true;
+	}
+	worker->changed.notify_all();
+}
+
+void HangRecoverySource::startWorker(std::unique_ptr<CaptureSource> source)
+{
+	std::shared_ptr<Worker> started = std::make_shared<Worker>();
+	started->source = std::move(source);
+	{
+		std::lock_guard<std::mutex> guard(workerMutex);
+		worker = started;
+	}
+	std::thread(&HangRecoverySource::workerMain, started).detach();
+}
+
+void HangRecoverySource::workerMain(std::shared_ptr<Worker> worker)
+{
+	std::unique_lock<std::mutex> lock(worker->mutex);
+	while (true)
+	{
+		worker->changed.wait(lock, [&worker]() { return worker->grabRequested || worker->stopRequested; });
+		if (worker->stopRequested) return;
+		worker->grabRequested = false;
+
+		lock.unlock();
+		bool grabbed = worker->source->grab();
+		lock.lock();
+
+		// nobody waits for this grab any more: the source is done with
+		if (worker->abandoned)
+		{
+			worker->source->release();
+			return;
+		}
+		worker->grabResult = grabbed;
+		worker->grabbing = false;
+		worker->changed.notify_all();
+	}
+}
+
+bool HangRecoverySource::isAbandoned() const
+{
+	std::lock_guard<std::mutex> guard(worker->mutex);
+	return worker->abandoned;
+}
+
+bool HangRecoverySource::open()
+{
+	if (isAbandoned())
+	{
+		// the stuck source stays with its thread: start over with a fresh one
+		if (!spare) return false;
+		std::cout << name << ": abandoned in grab(), opening it again." << std::endl;
+		startWorker(std::move(spare));
+		spare = worker->source->createFresh();
+	}
+	bool opened = worker->source->open();
+	if (opened) fps = worker->source->getFps();
+	return opened;
+}
+
+bool HangRecoverySource::isOpened() const
+{
+	return !isAbandoned() && worker->source->isOpened();
+}
+
+void HangRecoverySource::release()
+{
+	// an abandoned source is released by its thread, once its grab() returns
+	if (!isAbandoned()) worker->source->release();
+}
+
+bool HangRecoverySource::grab()
+{
+	std::unique_lock<std::mutex> lock(worker->mutex);
+	if (worker->abandoned) return false;
+	worker->grabRequested = true;
+	worker->grabbing = true;
+	worker->changed.notify_all();
+	worker->changed.wait(lock, [this]() { return !worker->grabbing || worker->abandoned; });
+	return !worker->abandoned && worker->grabResult;
+}
+
+void HangRecoverySource::interrupt()
+{
+	std::shared_ptr<Worker> current;
+	{
+		std::lock_guard<std::mutex> guard(workerMutex);
+		current = worker;
+	}
+	{
+		std::lock_guard<std::mutex> guard(current->mutex);
+		if (current->grabbing && !current->abandoned)
+		{
+			current->abandoned = true;
+			abandonedGrabs++;
+		}
+	}
+	current->changed.notify_all();
+	current->source->interrupt();		// allowed from any thread (it may return sooner on its own)
+}
+
+std::unique_ptr<CaptureSource> HangRecoverySource::createFresh() const
+{
+	std::unique_ptr<CaptureSource> fresh = worker->source->createFresh();
+	if (!fresh) return nullptr;
+	return std::unique_ptr<CaptureSource>(new HangRecoverySource(std::move(fresh)));
+}
@@ -0,0 +1,76 @@
+#include "Histogram.h"
+
+Histogram::Histogram(const double bucketWidth) : bucketWidthMs(bucketWidth), maxMs(0)
+{
+	for (unsigned int i = 0; i < BucketCount; i++) buckets[i] = 0;
+}
+
+void Histogram::add(const double ms)
+{
+	unsigned int bucket = ms <= 0 ? 0 : (unsigned int)(ms / bucketWidthMs);
+	if (bucket >= BucketCount) bucket = BucketCount - 1;
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+	double currentMax = maxMs.load(std::memory_order_relaxed);
+	while (ms > currentMax && !maxMs.compare_exchange_weak(currentMax, ms, std::memory_order_relaxed)) {}
+}
+
+void Histogram::reset()
+{
+	for (unsigned int i = 0; i < BucketCount; i++) buckets[i].store(0, std::memory_order_relaxed);
+	maxMs.store(0, std::memory_order_relaxed);
+}
+
+unsigned long long Histogram::getCount() const
+{
+	unsigned long long count = 0;
+	for (unsigned int i = 0; i < BucketCount; i++) count += buckets[i].load(std::memory_order_relaxed);
+	return count;
+}
+
+double Histogram::getPercentile(const double p) const
+{
+	unsigned long long count = getCount();
+	if (count == 0) return 0;
+	// rank of the sample holding percentile p (1-based)
+	unsigned long long rank = (unsigned long long)(p * count + 0.5);
+	if (rank < 1) rank = 1;
+	unsigned long long accumulated = 0;
+	for (unsigned int i = 0; i < BucketCount - 1; i++)
+	{
+		accumulated += buckets[i].load(std::memory_order_relaxed);
+		if (accumulated >= rank) return (i + 1) * bucketWidthMs;
+	}
+	return getMax();	// falls in the overflow bucket
+}
+
+unsigned long long Histogram::getCountAbove(const double ms) const
+{
+	unsigned int first = ms <= 0 ? 0 : (unsigned int)(ms / bucketWidthMs) + 1;
+	unsigned long long count = 0;
+	for (unsigned int i = first; i < BucketCount; i++) count += buckets[i].load(std::memory_order_relaxed);
+	return count;
+}
+
+void Histogram::printSummary(std::ostream& out, const std::string& name, const double budgetMs) const
+{
+	out << name << ": "
+		<< "n " << getCount()
+		<< "  p50 " << getPercentile(0.5)
+		<< "  p90 " << getPercentile(0.9)
+		<< "  p99 " << getPercentile(0.99)
+		<< "  max " << getMax() << " ms"
+		<< "  over " << budgetMs << "ms: " << getCountAbove(budgetMs) << std::endl;
+}
+
+void Histogram::write(std::ostream& out, const std::string& name, const double budgetMs) const
+{
+	out << "# " << name << " (bucket width " << bucketWidthMs << " ms, last bucket is overflow)" << std::endl;
+	printSummary(out, "# " + name, budgetMs);
+	for (unsigned int i = 0; i < BucketCount; i++)
+	{
+		unsigned long long count = buckets[i].load(std::memory_order_relaxed);
+		if (count > 0) out << i * bucketWidthMs << "\t" << count << std::endl;
+	}
+	out << std::endl;
+}
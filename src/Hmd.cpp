@@ -0,0 +1,145 @@
+#include "Hmd.h"
+#include <iostream>
+#include <stdexcept>
+
+////////////////////////////////////////////////
+// Default math (same formulas as Oculus SDK 0.5)
+////////////////////////////////////////////////
+void HmdDevice::getRenderScaleAndOffset(const ovrFovPort& fov, const ovrSizei& textureSize, const ovrRecti& viewport, ovrVector2f uvScaleOffset[2]) const
+{
+	// tan angles -> NDC of the eye viewport
+	float ndcScaleX = 2.0f / (fov.LeftTan + fov.RightTan);
+	float ndcOffsetX = (fov.LeftTan - fov.RightTan) * ndcScaleX * 0.5f;
+	float ndcScaleY = 2.0f / (fov.UpTan + fov.DownTan);
+	float ndcOffsetY = (fov.UpTan - fov.DownTan) * ndcScaleY * 0.5f;
+
+	// NDC [-1,1] -> UV [0,1], restricted to the viewport rendered in the texture
+	float viewportScaleX = (float)viewport.Size.w / (float)textureSize.w;
+	float viewportScaleY = (float)viewport.Size.h / (float)textureSize.h;
+	uvScaleOffset[0].x = ndcScaleX * 0.5f * viewportScaleX;
+	uvScaleOffset[0].y = ndcScaleY * 0.5f * viewportScaleY;
+	uvScaleOffset[1].x = (ndcOffsetX * 0.5f + 0.5f) * viewportScaleX + (float)viewport.Pos.x / (float)textureSize.w;
+	uvScaleOffset[1].y = (ndcOffsetY * 0.5f + 0.5f) * viewportScaleY + (float)viewport.Pos.y / (float)textureSize.h;
+}
+
+ovrMatrix4f HmdDevice::getProjection(const ovrFovPort& fov, const float znear, const float zfar) const
+{
+	float scaleX = 2.0f / (fov.LeftTan + fov.RightTan);
+	float offsetX = (fov.LeftTan - fov.RightTan) * scaleX * 0.5f;
+	float scaleY = 2.0f / (fov.UpTan + fov.DownTan);
+	float offsetY = (fov.UpTan - fov.DownTan) * scaleY * 0.5f;
+	const float handedness = -1.0f;		// right handed
+
+	ovrMatrix4f projection = {};
+	projection.M[0][0] = scaleX;
+	projection.M[0][2] = handedness * offsetX;
+	projection.M[1][1] = scaleY;
+	projection.M[1][2] = handedness * -offsetY;
+	projection.M[2][2] = -handedness * zfar / (znear - zfar);
+	projection.M[2][3] = (zfar * znear) / (znear - zfar);
+	projection.M[3][2] = handedness;
+	return projection;
+}
+
+////////////////////////////////////////////////
+// Oculus SDK 0.5
+////////////////////////////////////////////////
+bool OvrHmdDevice::isInitialized = false;
+unsigned short int OvrHmdDevice::ovr_Users = 0;
+bool OvrHmdDevice::init()
+{
+	if( ! isInitialized )
+	{
+		if (!ovr_Initialize()) return false;
+		isInitialized = true;
+	}
+	ovr_Users++;
+	return true;
+}
+void OvrHmdDevice::shutdown()
+{
+	ovr_Users--;
+	if( ovr_Users == 0 && isInitialized )
+	{
+		ovr_Shutdown();
+		isInitialized = false;
+	}
+}
+
+OvrHmdDevice* OvrHmdDevice::create(const unsigned int ID)
+{
+	// Init OVR lib (if I am the first instance created)
+	if (!OvrHmdDevice::init())
+	{
+		std::cout << "LibOVR could not be initialized." << std::endl;
+		return nullptr;
+	}
+
+	// ---------------------------------
+	// Try to locate physical Rift device
+	ovrHmd hmd = ovrHmd_Create(ID);
+	if (!hmd)
+	{
+		// No Rift detected: no sensor data, but Oculus window will be displayed anyway
+		std::cout << "Oculus Rift NOT found.\nSimulating Oculus DK2..." << std::endl;
+		hmd = ovrHmd_CreateDebug(ovrHmd_DK2);
+		if (!hmd)
+		{
+			OvrHmdDevice::shutdown();
+			return nullptr;
+		}
+		std::cout<<"Simulation enabled: a window will show a dummy Oculus DK2 output." << std::endl;
+		return new OvrHmdDevice(hmd, true);
+	}
+
+	// Rift detected
+	std::cout << "Oculus Rift found." << std::endl;
+	std::cout << "\tProduct Name: " << hmd->ProductName << std::endl;
+	std::cout << "\tProduct ID: " << hmd->ProductId << std::endl;
+	std::cout << "\tFirmware: " << hmd->FirmwareMajor << "." << hmd->FirmwareMinor << std::endl;
+	std::cout << "\tResolution: " << hmd->Resolution.w << "x" << hmd->Resolution.h << std::endl;
+
+	// If Rift not supported, throw exception
+	if (!ovrHmd_ConfigureTracking(hmd, ovrTrackingCap_Orientation | ovrTrackingCap_MagYawCorrection | ovrTrackingCap_Position, 0))
+	{
+		ovrHmd_Destroy(hmd);
+		OvrHmdDevice::shutdown();
+		throw std::ios_base::failure("\tThis Rift does not support the features needed by the application.");
+	}
+	return new OvrHmdDevice(hmd, false);
+}
+
+OvrHmdDevice::~OvrHmdDevice()
+{
+	if (hmd) ovrHmd_Destroy(hmd);
+
+	// Shutdown OVR lib (if I am the last device to be destroyed)
+	OvrHmdDevice::shutdown();
+}
+
+double OvrHmdDevice::getRefreshRate() const
+{
+	// not in ovrHmdDesc (SDK 0.5): vsync interval measured by the runtime if known, panel rate of the model otherwise
+	float vsyncToNextVsync = ovrHmd_GetFloat(hmd, "VsyncToNextVsync", 0.0f);
+	if (vsyncToNextVsync > 0) return 1.0 / vsyncToNextVsync;
+	return hmd->Type == ovrHmd_DK1 ? 60.0 : 75.0;
+}
+
+void OvrHmdDevice::createDistortionMesh(const ovrEyeRenderDesc& renderDesc, const unsigned int distortionCaps, HmdDistortionMesh& out) const
+{
+	ovrDistortionMesh meshData;
+	ovrHmd_CreateDistortionMesh(hmd, renderDesc.Eye, renderDesc.Fov, distortionCaps, &meshData);
+	out.vertices.assign(meshData.pVertexData, meshData.pVertexData + meshData.VertexCount);
+	out.indices.assign(meshData.pIndexData, meshData.pIndexData + meshData.IndexCount);
+	ovrHmd_DestroyDistortionMesh(&meshData);
+}
+
+void OvrHmdDevice::getRenderScaleAndOffset(const ovrFovPort& fov, const ovrSizei& textureSize, const ovrRecti& viewport, ovrVector2f uvScaleOffset[2]) const
+{
+	ovrHmd_GetRenderScaleAndOffset(fov, textureSize, viewport, uvScaleOffset);
+}
+
+void OvrHmdDevice::getEyePoses(const unsigned int frameIndex, const ovrVector3f hmdToEyeViewOffset[2], ovrPosef outEyePoses[2], ovrTrackingState* outTrackingState)
+{
+	ovrHmd_GetEyePoses(hmd, frameIndex, hmdToEyeViewOffset, outEyePoses, outTrackingState);
+}
@@ -0,0 +1,45 @@
+#include "IdleWorkQueue.h"
+#include "Trace.h"
+
+void IdleWorkQueue::post(const char* name, const double estimatedMs, const Job& job)
+{
+	PendingJob pending = { name, estimatedMs, job };
+	jobs.push_back(pending);
+}
+
+double IdleWorkQueue::drainUntil(const std::chrono::steady_clock::time_point deadline)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point now = start;
+	while (!jobs.empty())
+	{
+		// in posting order: a job that does not fit blocks the ones after it (they may depend on it)
+		std::chrono::duration< double, std::milli > left = deadline - now;
+		if (jobs.front().estimatedMs > left.count()) break;
+		PendingJob pending = jobs.front();
+		jobs.pop_front();
+		run(pending);
+		idleJobs++;
+		now = std::chrono::steady_clock::now();
+	}
+	double spentMs = std::chrono::duration< double, std::milli >(now - start).count();
+	idleWorkTimes.add(spentMs);
+	return spentMs;
+}
+
+void IdleWorkQueue::flush()
+{
+	while (!jobs.empty())
+	{
+		PendingJob pending = jobs.front();
+		jobs.pop_front();
+		run(pending);
+		flushedJobs++;
+	}
+}
+
+void IdleWorkQueue::run(PendingJob& pending)
+{
+	TRACE_SCOPE(pending.name);
+	pending.job();
+}
@@ -0,0 +1,142 @@
+#include "LatencyProbe.h"
+
+namespace
+{
+	// Check nibble: catches reads of something that is not a stamp (i.e. samples off the video plane)
+	unsigned int stampCheck(const unsigned int id)
+	{
+		return ((id) ^ (id >> 4) ^ (id >> 8) ^ 0xA) & 0xF;
+	}
+
+	// Centre of a stamp cell in image uv coordinates (cells cover the central 60% of the image)
+	Ogre::Vector2 stampCellCentre(const unsigned int column, const unsigned int row)
+	{
+		return Ogre::Vector2(
+			0.2f + (column + 0.5f) * 0.6f / LatencyProbe::StampColumns,
+			0.2f + (row + 0.5f) * 0.6f / LatencyProbe::StampRows);
+	}
+}
+
+void LatencyProbe::stamp(cv::Mat& image, const unsigned long long frameId)
+{
+	if (image.empty()) return;
+	unsigned int id = stampOf(frameId);
+	unsigned int code = id | (stampCheck(id) << StampIdBits);
+
+	int cellWidth = (int)(image.cols * 0.6f / StampColumns);
+	int cellHeight = (int)(image.rows * 0.6f / StampRows);
+	for (unsigned int row = 0; row < StampRows; row++)
+	{
+		for (unsigned int column = 0; column < StampColumns; column++)
+		{
+			unsigned int bit = row * StampColumns + column;
+			Ogre::Vector2 centre = stampCellCentre(column, row);
+			cv::Rect cell((int)(centre.x * image.cols) - cellWidth / 2, (int)(centre.y * image.rows) - cellHeight / 2, cellWidth, cellHeight);
+			cv::rectangle(image, cell, ((code >> bit) & 1) ? cv::Scalar(255, 255, 255) : cv::Scalar(0, 0, 0), CV_FILLED);
+		}
+	}
+}
+
+LatencyProbe::LatencyProbe(Ogre::Root* root, Scene* scene, Ogre::TexturePtr eyeTexture) : mRoot(root), mScene(scene), mEyeTexture(eyeTexture)
+{
+	if (mEyeTexture.isNull())
+		OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Latency probe needs the eye render texture", "LatencyProbe::LatencyProbe");
+
+	readback.resize(mEyeTexture->getWidth() * mEyeTexture->getHeight() * 4);
+	readbackBox = Ogre::PixelBox(mEyeTexture->getWidth(), mEyeTexture->getHeight(), 1, Ogre::PF_BYTE_RGBA, &readback[0]);
+	grabTimes.assign(StampIdCount + 1, 0.0);
+
+	mEyeTarget = mEyeTexture->getBuffer()->getRenderTarget();
+	mEyeTarget->addListener(this);		// added after Rift listener: called once eye render is complete
+	mRoot->addFrameListener(this);
+}
+
+LatencyProbe::~LatencyProbe()
+{
+	mEyeTarget->removeListener(this);
+	mRoot->removeFrameListener(this);
+}
+
+void LatencyProbe::frameUploaded(const FrameCaptureData& frame)
+{
+	if (frame.id == 0 || frame.grabTime <= 0) return;
+	grabTimes[stampOf(frame.id)] = frame.grabTime;
+	grabToTexture.add((ovr_GetTimeInSeconds() - frame.grabTime) * 1000.0);
+}
+
+void LatencyProbe::postRenderTargetUpdate(const Ogre::RenderTargetEvent& rte)
+{
+	if (rte.source != mEyeTarget) return;
+
+	mEyeTexture->getBuffer()->blitToMemory(readbackBox);
+	// texture row order depends on render system: try the last one that worked first
+	int stamp = decode(flippedReadback);
+	if (stamp == 0)
+	{
+		stamp = decode(!flippedReadback);
+		if (stamp != 0) flippedReadback = !flippedReadback;
+	}
+	if (stamp == 0) decodeFailures++;
+	displayedStamp = stamp;
+}
+
+bool LatencyProbe::frameEnded(const Ogre::FrameEvent& evt)
+{
+	// record only the first presentation of each frame (the same frame stays on screen until a new one arrives)
+	if (displayedStamp != 0 && displayedStamp != presentedStamp && grabTimes[displayedStamp] > 0)
+	{
+		grabToPresent.add((ovr_GetTimeInSeconds() - grabTimes[displayedStamp]) * 1000.0);
+		presentedStamp = displayedStamp;
+	}
+	return true;
+}
+
+int LatencyProbe::decode(const bool flipY)
+{
+	const int width = (int)readbackBox.getWidth();
+	const int height = (int)readbackBox.getHeight();
+	unsigned int code = 0;
+	for (unsigned int row = 0; row < StampRows; row++)
+	{
+		for (unsigned int column = 0; column < StampColumns; column++)
+		{
+			Ogre::Vector2 viewportPoint;
+			if (!mScene->projectVideoImagePoint(0, stampCellCentre(column, row), viewportPoint)) return 0;
+			int x = (int)(viewportPoint.x * (width - 1));
+			int y = (int)((flipY ? 1.0f - viewportPoint.y : viewportPoint.y) * (height - 1));
+
+			// average a 3x3 neighbourhood (texture filtering blurs cell borders, not centres)
+			unsigned int luminance = 0, samples = 0;
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					int sx = Ogre::Math::Clamp(x + dx, 0, width - 1);
+					int sy = Ogre::Math::Clamp(y + dy, 0, height - 1);
+					const unsigned char* pixel = &readback[(sy * readbackBox.rowPitch + sx) * 4];
+					luminance += (pixel[0] + pixel[1] + pixel[2]) / 3;
+					samples++;
+				}
+			}
+			if (luminance / samples > 127) code |= 1 << (row * StampColumns + column);
+		}
+	}
+
+	unsigned int id = code & StampIdCount;
+	if (id == 0 || (code >> StampIdBits) != stampCheck(id)) return 0;
+	return (int)id;
+}
+
+void LatencyProbe::report(std::ostream& out)
+{
+	grabToTexture.report(out);
+	grabToPresent.report(out);
+	if (decodeFailures > 0) out << "\tlatency probe: " << decodeFailures << " eye renders without a readable stamp" << std::endl;
+	decodeFailures = 0;
+}
+
+void LatencyProbe::write(std::ostream& out) const
+{
+	grabToTexture.write(out);
+	grabToPresent.write(out);
+}
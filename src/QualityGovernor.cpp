@@ -0,0 +1,79 @@
+#include "QualityGovernor.h"
+#include <algorithm>
+
+QualityGovernor::QualityGovernor(const Settings& governorSettings) : settings(governorSettings)
+{
+	if (settings.densityStep <= 0) settings.densityStep = 0.1f;
+	if (settings.minDensity > 1.0f) settings.minDensity = 1.0f;
+	if (settings.minDensity < settings.densityStep) settings.minDensity = settings.densityStep;
+	if (settings.maxDensity < 1.0f) settings.maxDensity = 1.0f;
+	if (settings.windowFrames == 0) settings.windowFrames = 1;
+
+	// build the ladder (densities are computed from 1.0 so that 1.0 itself is always a level)
+	std::vector<float> lowerDensities;
+	for (int step = 1; 1.0f - step * settings.densityStep >= settings.minDensity - 0.001f; step++)
+		lowerDensities.push_back(1.0f - step * settings.densityStep);
+	for (std::vector<float>::reverse_iterator it = lowerDensities.rbegin(); it != lowerDensities.rend(); ++it)
+	{
+		Level level = { *it, 0 };
+		levels.push_back(level);
+	}
+	Level native = { 1.0f, 0 };
+	levels.push_back(native);
+	for (unsigned int fsaa = 2; fsaa <= settings.maxFsaa; fsaa *= 2)
+	{
+		Level level = { 1.0f, fsaa };
+		levels.push_back(level);
+	}
+	current = (unsigned int)levels.size() - 1;		// starting level: native density, full MSAA
+	unsigned int bestFsaa = levels[current].fsaa;
+	for (int step = 1; 1.0f + step * settings.densityStep <= settings.maxDensity + 0.001f; step++)
+	{
+		Level level = { 1.0f + step * settings.densityStep, bestFsaa };
+		levels.push_back(level);
+	}
+
+	window.reserve(settings.windowFrames);
+}
+
+bool QualityGovernor::addFrame(const double ms)
+{
+	window.push_back(ms);
+	if (window.size() < settings.windowFrames) return false;
+
+	// p90 of the window (nth_element reorders, but the window is discarded anyway)
+	std::vector<double>::iterator p90 = window.begin() + (window.size() * 9) / 10;
+	if (p90 == window.end()) --p90;
+	std::nth_element(window.begin(), p90, window.end());
+	double frameTime = *p90;
+	window.clear();
+
+	if (heldWindows > 0)
+	{
+		heldWindows--;
+		return false;
+	}
+
+	if (frameTime > settings.lowerAbove * settings.budgetMs)
+	{
+		calmWindows = 0;
+		if (current == 0) return false;
+		current--;
+		heldWindows = settings.holdWindows;
+		return true;
+	}
+
+	if (frameTime < settings.raiseBelow * settings.budgetMs)
+	{
+		calmWindows++;
+		if (calmWindows < settings.raiseWindows || current + 1 >= levels.size()) return false;
+		calmWindows = 0;
+		current++;
+		heldWindows = settings.holdWindows;
+		return true;
+	}
+
+	// between thresholds: quality is right
+	calmWindows = 0;
+	return false;
+}
@@ -1,30 +1,10 @@
 #include "Rift.h"
+#include <cstring>
+#include "DistortionMesh.h"
+#include "Trace.h"
+#include "ScriptedHmd.h"
 
 
-//////////////////////////////////////////
-// Static members for handling the API:
-//////////////////////////////////////////
-bool Rift::isInitialized = false;
-unsigned short int Rift::ovr_Users = 0;
-void Rift::init()
-{
-	if( ! isInitialized )
-	{
-		ovr_Initialize();
-		isInitialized = true;
-	}
-	ovr_Users++;
-}
-void Rift::shutdown()
-{
-	ovr_Users--;
-	if( ovr_Users == 0 && isInitialized )
-	{
-		ovr_Shutdown();
-		isInitialized = false;
-	}
-}
-
 /////////////////////////////////////////
 // Per-Device methods (non static):
 /////////////////////////////////////////
@@ -33,60 +13,51 @@ void Rift::shutdown()
 Rift::Rift(const unsigned int ID, Ogre::Root* const root, Ogre::RenderWindow* &renderWindow, const bool rotateView)
 {
 	if (root == nullptr) throw std::invalid_argument("'root' is null. Rift instance not created.");
-	mRenderTexture[0] = nullptr;
-	mRenderTexture[1] = nullptr;
-
-	// Init OVR lib (if I am the first instance created)
-	Rift::init();
 
 	// ---------------------------------
-	// Try to locate physical Rift device
-	hmd = NULL;
+	// Try to locate physical Rift device (or the SDK debug DK2)
 	std::cout << "Creating Rift (ID: " << ID << ")" << std::endl;
-	hmd = ovrHmd_Create(ID);
-	if (!hmd)
+	std::unique_ptr<HmdDevice> device(OvrHmdDevice::create(ID));
+	if (!device)
+	{
+		// No Oculus runtime: the app still runs, with simulated head motion
+		std::cout << "Oculus SDK not available. Using a scripted HMD..." << std::endl;
+		device.reset(new ScriptedHmdDevice(ScriptedHmdDevice::Settings()));
+	}
+	setDevice(std::move(device), ID);
+}
+
+Rift::Rift(std::unique_ptr<HmdDevice> device, Ogre::Root* const root, Ogre::RenderWindow* &renderWindow, const bool rotateView)
+{
+	if (root == nullptr) throw std::invalid_argument("'root' is null. Rift instance not created.");
+	if (device == nullptr) throw std::invalid_argument("'device' is null. Rift instance not created.");
+	setDevice(std::move(device), 0);
+}
+
+void Rift::setDevice(std::unique_ptr<HmdDevice> device, const unsigned int ID)
+{
+	mRenderTexture[0] = nullptr;
+	mRenderTexture[1] = nullptr;
+	hmd = std::move(device);
+
+	if (hmd->isSimulated())
 	{
 		// No Rift detected: no sensor data, but Oculus window will be displayed anyway
-		hmd = NULL;
-		std::cout << "Oculus Rift NOT found.\nSimulating Oculus DK2..." << std::endl;
-		
-		hmd = ovrHmd_CreateDebug(ovrHmd_DK2);
-		if (!hmd)
-		{
-			Rift::shutdown();
-			throw std::ios_base::failure("Unable to initialize Rift class.");
-		}
 		mRiftID = ovrHmd_DK2;
 		simulationMode = true;
-		std::cout<<"Simulation enabled: a window will show a dummy Oculus DK2 output." << std::endl;
-
 	}
 	else
 	{
 		// Rift detected
 		simulationMode = false;
-		std::cout << "Oculus Rift found." << std::endl;
-		std::cout << "\tProduct Name: " << hmd->ProductName << std::endl;
-		std::cout << "\tProduct ID: " << hmd->ProductId << std::endl;
-		std::cout << "\tFirmware: " << hmd->FirmwareMajor << "." << hmd->FirmwareMinor << std::endl;
-		std::cout << "\tResolution: " << hmd->Resolution.w << "x" << hmd->Resolution.h << std::endl;
-		std::cout << "Oculus Rift found." << std::endl;
-
-		// If Rift not supported, throw exception
-		if (!ovrHmd_ConfigureTracking(hmd, ovrTrackingCap_Orientation | ovrTrackingCap_MagYawCorrection | ovrTrackingCap_Position, 0))
-		{
-			ovrHmd_Destroy(hmd);
-			Rift::shutdown();
-			throw std::ios_base::failure("\tThis Rift does not support the features needed by the application.");
-		}
 
 		// Save id
 		mRiftID = ID;
 
 		// Determine Oculus Type
-		if (hmd->Type == ovrHmd_DK1)
+		if (hmd->getType() == ovrHmd_DK1)
 			this->rotateView = false;
-		else if (hmd->Type == ovrHmd_DK2)
+		else if (hmd->getType() == ovrHmd_DK2)
 			this->rotateView = false;	//on windows and sdk 0.5, this worked with "true"
 										//on ubuntu and sdk 0.5, this worked with "false"
 
@@ -118,10 +89,7 @@ Rift::Rift(const unsigned int ID, Ogre::Root* const root, Ogre::RenderWindow* &r
 }
 Rift::~Rift()
 {
-	if (hmd) ovrHmd_Destroy(hmd);
-
-	// Shutdown OVR lib (if I am the last Rift object to be destroyed)
-	Rift::shutdown();
+	// hmd is released here: OVR lib is shut down with the last OvrHmdDevice destroyed
 }
 
 Ogre::RenderWindow* Rift::createRiftDisplayWindow(Ogre::Root* const root)
@@ -143,10 +111,10 @@ Ogre::RenderWindow* Rift::createRiftDisplayWindow(Ogre::Root* const root)
 	}
 
 	// Creating Oculus rendering window
-	if (hmd->Type == ovrHmd_DK1)
+	if (hmd->getType() == ovrHmd_DK1)
 		mRenderWindow = root->createRenderWindow("Oculus Rift Live Visualization", 1280, 800, true, &miscParams);
 		//mWindow = mRoot->createRenderWindow("Oculus Rift Liver Visualization", 1920*0.5, 1080*0.5, false, &miscParams);
-	else if (hmd->Type == ovrHmd_DK2)
+	else if (hmd->getType() == ovrHmd_DK2)
 	{
 		if (simulationMode) mRenderWindow = root->createRenderWindow("Oculus Rift Live Visualization", 1920, 1080, false, &miscParams);
 		else /* rotated */	mRenderWindow = root->createRenderWindow("Oculus Rift Live Visualization", 1080, 1920, false, &miscParams);
@@ -154,10 +122,29 @@ Ogre::RenderWindow* Rift::createRiftDisplayWindow(Ogre::Root* const root)
 
 	// Register render listener (to perform operations right before and after rendering the window)
 	mRenderWindow->addListener(this);
+	mDisplayTarget = mRenderWindow;
 
 	return mRenderWindow;
 }
 
+Ogre::RenderTexture* Rift::createRiftDisplayTexture(Ogre::Root* const root)
+{
+	// Same size as the HMD screen, so distortion costs as much as it would on the Rift
+	ovrSizei resolution = hmd->getResolution();
+	mDisplayTexture = Ogre::TextureManager::getSingleton().createManual(
+		"RiftDisplayTexture", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
+		Ogre::TEX_TYPE_2D, resolution.w, resolution.h, 0, Ogre::PF_R8G8B8,
+		Ogre::TU_RENDERTARGET);
+	Ogre::RenderTexture* displayTexture = mDisplayTexture->getBuffer()->getRenderTarget();
+
+	// Auto updated (by renderOneFrame) like a window would be
+	displayTexture->setAutoUpdated(true);
+	displayTexture->addListener(this);
+	mDisplayTarget = displayTexture;
+
+	return displayTexture;
+}
+
 Ogre::RenderWindow* Rift::createDebugRiftDisplayWindow(Ogre::Root* const root)
 {
 	//Setup Oculus rendering window options
@@ -168,9 +155,9 @@ Ogre::RenderWindow* Rift::createDebugRiftDisplayWindow(Ogre::Root* const root)
 		// setting on main screen
 		miscParams["monitorIndex"] = Ogre::StringConverter::toString(0);
 		// creating debug rendering window
-		if (hmd->Type == ovrHmd_DK1)
+		if (hmd->getType() == ovrHmd_DK1)
 			debugWindow = root->createRenderWindow("Oculus DEBUG Rift Live Visualization", 1280, 800, false, &miscParams);
-		else if (hmd->Type == ovrHmd_DK2)
+		else if (hmd->getType() == ovrHmd_DK2)
 		{
 			debugWindow = root->createRenderWindow("Oculus Rift DEBUG Live Visualization", 1080/2, 1920/2, false, &miscParams);
 		}
@@ -180,7 +167,7 @@ Ogre::RenderWindow* Rift::createDebugRiftDisplayWindow(Ogre::Root* const root)
 
 }
 
-void Rift::createRiftDisplayScene(Ogre::Root* const root)
+void Rift::createRiftDisplayScene(Ogre::Root* const root, const float maxDensity, const unsigned int fsaa)
 {
 	mSceneMgr = root->createSceneManager(Ogre::ST_GENERIC);
 	mSceneMgr->setAmbientLight(Ogre::ColourValue(0.5, 0.5, 0.5));
@@ -191,53 +178,33 @@ void Rift::createRiftDisplayScene(Ogre::Root* const root)
 	// See also .glsl shaders in /media folder!
 	// ---------------------------------------
 
-	// CONFIGURE Render Textures sizes (with recommended FOV by SDK)
-	Sizei recommendedTex0Size = ovrHmd_GetFovTextureSize(hmd, ovrEye_Left,
-		hmd->DefaultEyeFov[0], 1.0f);
-	Sizei recommendedTex1Size = ovrHmd_GetFovTextureSize(hmd, ovrEye_Right,
-		hmd->DefaultEyeFov[1], 1.0f);
-
-	/*Sizei renderTargetSize;
-	renderTargetSize.w = recommendedTex0Size.w + recommendedTex1Size.w;
-	renderTargetSize.h = std::max( recommendedTex0Size.h, recommendedTex1Size.h );*/
-	//std::cout << "Error?" << std::endl;
+	// CONFIGURE Render Textures sizes (with recommended FOV by SDK, at pixel density 1.0)
+	recommendedTexSize[0] = hmd->getFovTextureSize(ovrEye_Left,
+		hmd->getDefaultEyeFov(0));
+	recommendedTexSize[1] = hmd->getFovTextureSize(ovrEye_Right,
+		hmd->getDefaultEyeFov(1));
 
 	// Generate Ogre RenderTarget Textures (to apply to distortion meshes)
-	mLeftEyeRenderTexture = Ogre::TextureManager::getSingleton().createManual(
-		"RiftRenderTextureLeft", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
-		Ogre::TEX_TYPE_2D, recommendedTex0Size.w, recommendedTex0Size.h, 0, Ogre::PF_R8G8B8,
-		Ogre::TU_RENDERTARGET);
-	mRightEyeRenderTexture = Ogre::TextureManager::getSingleton().createManual(
-		"RiftRenderTextureRight", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
-		Ogre::TEX_TYPE_2D, recommendedTex1Size.w, recommendedTex1Size.h, 0, Ogre::PF_R8G8B8,
-		Ogre::TU_RENDERTARGET);
-
-	// Assign the textures to materials (to be used later)
+	// They are allocated for the highest pixel density: lower densities render into a sub-rectangle (see setEyeRenderQuality())
+	// One texture per eye, or a single side-by-side one (see setSharedEyeTexture())
+	maxPixelDensity = std::max(maxDensity, 1.0f);
+	eyeFsaa = fsaa;
 	mMatLeft = Ogre::MaterialManager::getSingleton().getByName("Oculus/LeftEye");
-	mMatLeft->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setTexture(mLeftEyeRenderTexture);
 	mMatRight = Ogre::MaterialManager::getSingleton().getByName("Oculus/RightEye");
-	mMatRight->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setTexture(mRightEyeRenderTexture);
-
-	// CONFIGURE viewports to render on Ogre RenderTarget Textures
-	ovrRecti viewports[2];
-	viewports[0].Pos.x = 0;
-	viewports[0].Pos.y = 0;
-	viewports[0].Size.w = recommendedTex0Size.w;
-	viewports[0].Size.h = recommendedTex0Size.h;
-	viewports[1].Pos.x = recommendedTex0Size.w;
-	viewports[1].Pos.y = 0;
-	viewports[1].Size.w = recommendedTex1Size.w;
-	viewports[1].Size.h = recommendedTex1Size.h;
+	mMatLookup[0] = Ogre::MaterialManager::getSingleton().getByName("Oculus/LeftEyeLookup");
+	mMatLookup[1] = Ogre::MaterialManager::getSingleton().getByName("Oculus/RightEyeLookup");
+	createDistortionConstants();
+	createEyeTextures();
 
 	// CONFIGURE per-eye proprieties (for creating distortion meshes)
 	// ovrEyeRenderDesc eyeRenderDesc[2]; // commented: moved in class definition, they are also needed before rendering!
-	eyeRenderDesc[0] = ovrHmd_GetRenderDesc(hmd, ovrEye_Left, hmd->DefaultEyeFov[0]);
-	eyeRenderDesc[1] = ovrHmd_GetRenderDesc(hmd, ovrEye_Right, hmd->DefaultEyeFov[1]);
+	eyeRenderDesc[0] = hmd->getRenderDesc(ovrEye_Left, hmd->getDefaultEyeFov(0));
+	eyeRenderDesc[1] = hmd->getRenderDesc(ovrEye_Right, hmd->getDefaultEyeFov(1));
 
 	std::cout << eyeRenderDesc[0].Fov.DownTan << std::endl;
 	std::cout << eyeRenderDesc[0].Eye << std::endl;
 
-	Ogre::SceneNode* meshNode = mSceneMgr->getRootSceneNode()->createChildSceneNode();
+	mDistortionNode = mSceneMgr->getRootSceneNode()->createChildSceneNode();
 
 	// Define features to enable from Oculus SDK
 	unsigned int distortionCaps = 0
@@ -245,81 +212,45 @@ void Rift::createRiftDisplayScene(Ogre::Root* const root)
 		| ovrDistortionCap_Overdrive
 		| ovrDistortionCap_TimeWarp;
 
-	// Generate the Distortion Meshes for each eye (and do Oculus vertex shader first setup)
-	ovrVector2f UVScaleOffset[2];	//0 = Scale, 1 = Offset		// these two parameters will be set NOW into the shaders, since there will be
-	Ogre::GpuProgramParametersSharedPtr params;					// no need to change them at runtime (as Documentation suggests..)
+	// Generate the Distortion Meshes for each eye (from the disk cache if possible, see DistortionMesh.h)
+	DistortionMeshCache meshCache(distortionMeshCachePrefix);
+	std::chrono::steady_clock::time_point meshStart_time = std::chrono::steady_clock::now();
+	size_t meshVertices = 0, meshIndices = 0;
+	int cachedMeshes = 0;
 	for (int eyeNum = 0; eyeNum < 2; eyeNum++)
 	{
-		ovrDistortionMesh meshData;
-		ovrHmd_CreateDistortionMesh(hmd,
-			eyeRenderDesc[eyeNum].Eye,
-			eyeRenderDesc[eyeNum].Fov,
-			distortionCaps,
-			&meshData);
-		
-		if (eyeNum == 0)
-		{
-			ovrHmd_GetRenderScaleAndOffset(eyeRenderDesc[eyeNum].Fov,
-				recommendedTex0Size, viewports[eyeNum],
-				UVScaleOffset);
-			params = mMatLeft->getTechnique(0)->getPass(0)->getVertexProgramParameters();
-		}
+		HmdDistortionMesh meshData;
+		std::string cacheKey = DistortionMeshCache::makeKey(*hmd, eyeNum, eyeRenderDesc[eyeNum], distortionCaps);
+		if (meshCache.load(cacheKey, meshData))
+			cachedMeshes++;
 		else
 		{
-			ovrHmd_GetRenderScaleAndOffset(eyeRenderDesc[eyeNum].Fov,
-				recommendedTex1Size, viewports[eyeNum],
-				UVScaleOffset);
-			params = mMatRight->getTechnique(0)->getPass(0)->getVertexProgramParameters();
+			hmd->createDistortionMesh(eyeRenderDesc[eyeNum],
+				distortionCaps,
+				meshData);
+			meshCache.save(cacheKey, meshData);
 		}
-		params->setNamedConstant("eyeToSourceUVScale", Ogre::Vector2(UVScaleOffset[0].x, UVScaleOffset[0].y));
-		params->setNamedConstant("eyeToSourceUVOffset", Ogre::Vector2(UVScaleOffset[1].x, UVScaleOffset[1].y));
-
-		//std::cout << "UVScaleOffset[0]: " << UVScaleOffset[0].x << ", " << UVScaleOffset[0].y << std::endl;
-		//std::cout << "UVScaleOffset[1]: " << UVScaleOffset[1].x << ", " << UVScaleOffset[1].y << std::endl;
-
-		// create ManualObject
-		// TODO: Destroy the manual objects!!
-		Ogre::ManualObject* manual;
-		if (eyeNum == 0)
-		{
-			manual = mSceneMgr->createManualObject("RiftRenderObjectLeft");
-			manual->begin("Oculus/LeftEye", Ogre::RenderOperation::OT_TRIANGLE_LIST);
-			//manual->begin("BaseWhiteNoLighting", Ogre::RenderOperation::OT_TRIANGLE_LIST);
-		}
-		else
-		{
-			manual = mSceneMgr->createManualObject("RiftRenderObjectRight");
-			manual->begin("Oculus/RightEye", Ogre::RenderOperation::OT_TRIANGLE_LIST);
-			//manual->begin("BaseWhiteNoLighting", Ogre::RenderOperation::OT_TRIANGLE_LIST);
-		}
-
-		for (unsigned int i = 0; i < meshData.VertexCount; i++)
-		{
-			ovrDistortionVertex v = meshData.pVertexData[i];
-			manual->position(v.ScreenPosNDC.x,
-				v.ScreenPosNDC.y, 0);
-			manual->textureCoord(v.TanEyeAnglesR.x,//*UVScaleOffset[0].x + UVScaleOffset[1].x,
-				v.TanEyeAnglesR.y);//*UVScaleOffset[0].y + UVScaleOffset[1].y);
-			manual->textureCoord(v.TanEyeAnglesG.x,//*UVScaleOffset[0].x + UVScaleOffset[1].x,
-				v.TanEyeAnglesG.y);//*UVScaleOffset[0].y + UVScaleOffset[1].y);
-			manual->textureCoord(v.TanEyeAnglesB.x,//*UVScaleOffset[0].x + UVScaleOffset[1].x,
-				v.TanEyeAnglesB.y);//*UVScaleOffset[0].y + UVScaleOffset[1].y);
-			float vig = std::max(v.VignetteFactor, 0.0f);
-			float tw = std::max(v.TimeWarpFactor, 0.0f);
-			manual->colour(vig, vig, vig, tw);
-		}
-		for (unsigned int i = 0; i < meshData.IndexCount; i++)
-		{
-			manual->index(meshData.pIndexData[i]);
-		}
-
-		// tell Ogre, your definition has finished
-		manual->end();
-
-		ovrHmd_DestroyDistortionMesh(&meshData);
-
-		meshNode->attachObject(manual);
+		meshVertices += meshData.vertices.size();
+		meshIndices += meshData.indices.size();
+
+		// static packed mesh (tan eye angles are quantized: the shader scales them back)
+		// TODO: Destroy the meshes!!
+		float tanEyeAngleScale = 1.0f;
+		Ogre::MeshPtr mesh = createPackedDistortionMesh(eyeNum == 0 ? "RiftDistortionMeshLeft" : "RiftDistortionMeshRight",
+			meshData, eyeNum == 0 ? "Oculus/LeftEye" : "Oculus/RightEye", tanEyeAngleScale);
+		Ogre::MaterialPtr material = (eyeNum == 0) ? mMatLeft : mMatRight;
+		material->getTechnique(0)->getPass(0)->getVertexProgramParameters()->setNamedConstant("tanEyeAngleScale", tanEyeAngleScale);
+
+		mDistortionMesh[eyeNum] = mSceneMgr->createEntity(eyeNum == 0 ? "RiftRenderObjectLeft" : "RiftRenderObjectRight", mesh);
+		mDistortionNode->attachObject(mDistortionMesh[eyeNum]);
+
+		// kept for the lookup mode, baked on first use (see setDistortionMode())
+		distortionMeshData[eyeNum] = std::move(meshData);
 	}
+	double meshMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - meshStart_time).count();
+	std::cout << "Distortion meshes: " << meshVertices << " vertices, " << meshIndices << " indices, "
+		<< "vertex memory " << meshVertices * PackedDistortionVertexSize << " bytes (unpacked: " << meshVertices * ManualDistortionVertexSize << "), "
+		<< "built in " << meshMs << " ms (" << cachedMeshes << " of 2 from cache)" << std::endl;
 
 	// Create a camera in the Oculus inner scene so the two meshes can be rendered onto it:
 	mCamera = mSceneMgr->createCamera("OculusRiftExternalCamera");
@@ -332,11 +263,15 @@ void Rift::createRiftDisplayScene(Ogre::Root* const root)
 		mCamera->roll(Ogre::Degree(-90));
 	}
 	mSceneMgr->getRootSceneNode()->attachObject(mCamera);
-	meshNode->setPosition(0, 0, -1);
-	meshNode->setScale(1, 1, -1);
+	mDistortionNode->setPosition(0, 0, -1);
+	mDistortionNode->setScale(1, 1, -1);
+
+	// Oculus shaders first setup (UV scale/offset only change with pixel density)
+	updateEyeViewports();
+	setDistortionMode(distortionMode);
 
 	// Get IPD from Rift Driver and set it up (in meters)
-	mIPD = ovrHmd_GetFloat(hmd, OVR_KEY_IPD, 0.064f);
+	mIPD = hmd->getIPD();
 	std::cout << mIPD << std::endl;
 	mPosition = Ogre::Vector3::ZERO;
 }
@@ -346,8 +281,8 @@ void Rift::setCameraMatrices( Ogre::Camera* camLeft, Ogre::Camera* camRight )
 {
 	
 	// Fix virtual camera aspect ratio by asking OculusSDK for the correct FOV/Distortion matrix
-	ovrFovPort fovLeft = hmd->DefaultEyeFov[ovrEye_Left];
-	ovrFovPort fovRight = hmd->DefaultEyeFov[ovrEye_Right];
+	ovrFovPort fovLeft = hmd->getDefaultEyeFov(ovrEye_Left);
+	ovrFovPort fovRight = hmd->getDefaultEyeFov(ovrEye_Right);
 
 	float combinedTanHalfFovHorizontal = std::max( fovLeft.LeftTan, fovLeft.RightTan );
 	float combinedTanHalfFovVertical = std::max( fovLeft.UpTan, fovLeft.DownTan );
@@ -362,8 +297,8 @@ void Rift::setCameraMatrices( Ogre::Camera* camLeft, Ogre::Camera* camRight )
 	//camLeft->setAspectRatio(aspectRatioLeft);
 	//camRight->setAspectRatio(aspectRatioRight);
 	
-	ovrMatrix4f projL = ovrMatrix4f_Projection ( fovLeft, 0.001, 50.0, true );
-	ovrMatrix4f projR = ovrMatrix4f_Projection ( fovRight, 0.001, 50.0, true );
+	ovrMatrix4f projL = hmd->getProjection ( fovLeft, 0.001f, 50.0f );
+	ovrMatrix4f projR = hmd->getProjection ( fovRight, 0.001f, 50.0f );
 
 	camLeft->setCustomProjectionMatrix( true,
 		Ogre::Matrix4( projL.M[0][0], projL.M[0][1], projL.M[0][2], projL.M[0][3],
@@ -378,39 +313,324 @@ void Rift::setCameraMatrices( Ogre::Camera* camLeft, Ogre::Camera* camRight )
 
 }
 
-void Rift::attachCameras(Ogre::Camera* const camLeft, Ogre::Camera* const camRight)
+// tangent of a half FOV angle widened by paddingDegrees
+static float padFovTan(const float tan, const float paddingDegrees)
+{
+	float angle = std::atan(tan) + Ogre::Degree(paddingDegrees).valueRadians();
+	return std::tan(std::min(angle, Ogre::Math::HALF_PI * 0.99f));
+}
+
+ovrFovPort Rift::getCombinedEyeFov(const float paddingDegrees)
+{
+	ovrFovPort fovLeft = hmd->getDefaultEyeFov(ovrEye_Left);
+	ovrFovPort fovRight = hmd->getDefaultEyeFov(ovrEye_Right);
+	ovrFovPort combined;
+	combined.LeftTan = padFovTan(std::max(fovLeft.LeftTan, fovRight.LeftTan), paddingDegrees);
+	combined.RightTan = padFovTan(std::max(fovLeft.RightTan, fovRight.RightTan), paddingDegrees);
+	combined.UpTan = padFovTan(std::max(fovLeft.UpTan, fovRight.UpTan), paddingDegrees);
+	combined.DownTan = padFovTan(std::max(fovLeft.DownTan, fovRight.DownTan), paddingDegrees);
+	return combined;
+}
+
+void Rift::setLateLatch(const bool enable, const float paddingDegrees)
+{
+	if (!mEyeCamera[0] || !mEyeCamera[1] || !mHeadNode)
+		throw Ogre::Exception(Ogre::Exception::ERR_INVALID_STATE, "Eye cameras and head node must be set before late latch", "Rift::setLateLatch");
+
+	Ogre::SceneManager* eyeSceneMgr = mEyeCamera[0]->getSceneManager();
+	eyeSceneMgr->removeRenderQueueListener(this);
+	destroyLatchCulling();
+	lateLatch = enable;
+	if (!lateLatch) return;
+
+	eyeSceneMgr->addRenderQueueListener(this);
+	for (int eye = 0; eye < 2; eye++)
+	{
+		Ogre::Camera* cam = mEyeCamera[eye];
+		if (cam->getCullingFrustum()) continue;		// already culled by a shared frustum (stereo culling)
+
+		// eye FOV widened by the padding, placed as the camera (cameras are attached to the head node)
+		ovrFovPort fov = eyeRenderDesc[eye].Fov;
+		float nearClip = cam->getNearClipDistance();
+		mLatchCullingFrustum[eye] = new Ogre::Frustum(eye == 0 ? "LateLatchCullingLeft" : "LateLatchCullingRight");
+		mLatchCullingFrustum[eye]->setVisible(false);
+		mLatchCullingFrustum[eye]->setNearClipDistance(nearClip);
+		mLatchCullingFrustum[eye]->setFarClipDistance(cam->getFarClipDistance());
+		mLatchCullingFrustum[eye]->setFrustumExtents(-padFovTan(fov.LeftTan, paddingDegrees) * nearClip, padFovTan(fov.RightTan, paddingDegrees) * nearClip,
+			padFovTan(fov.UpTan, paddingDegrees) * nearClip, -padFovTan(fov.DownTan, paddingDegrees) * nearClip);
+		mLatchCullingNode[eye] = mHeadNode->createChildSceneNode(cam->getPosition(), cam->getOrientation());
+		mLatchCullingNode[eye]->attachObject(mLatchCullingFrustum[eye]);
+		cam->setCullingFrustum(mLatchCullingFrustum[eye]);
+	}
+}
+
+void Rift::destroyLatchCulling()
+{
+	for (int eye = 0; eye < 2; eye++)
+	{
+		if (!mLatchCullingFrustum[eye]) continue;
+		if (mEyeCamera[eye]->getCullingFrustum() == mLatchCullingFrustum[eye])
+			mEyeCamera[eye]->setCullingFrustum(nullptr);
+		mLatchCullingNode[eye]->detachObject(mLatchCullingFrustum[eye]);
+		delete mLatchCullingFrustum[eye];
+		mLatchCullingNode[eye]->getCreator()->destroySceneNode(mLatchCullingNode[eye]);
+		mLatchCullingFrustum[eye] = nullptr;
+		mLatchCullingNode[eye] = nullptr;
+	}
+}
+
+// Called after culling and after the camera state has been set, before the first draw of the eye
+void Rift::preRenderQueues()
+{
+	if (eyeInProgress < 0 || latchedCamera) return;		// not an eye render (i.e. debug window camera)
+	TRACE_SCOPE("late latch");
+	ovrPosef latePoses[2];
+	ovrTrackingState ts;
+	hmd->getEyePoses(0, &(eyeRenderDesc[eyeInProgress].HmdToEyeViewOffset), latePoses, &ts);
+	if (!(ts.StatusFlags & (ovrStatus_OrientationTracked | ovrStatus_PositionTracked))) return;
+	// the eye is rendered with this pose: timewarp (phase 5) has to start from it too
+	headPose[eyeInProgress] = latePoses[0];
+
+	// The head node was posed (and the scene culled) with its current local transform L.
+	// Moving it to the late local transform L' moves the camera by M = H * L^-1 * L' * H^-1 (H: head node world transform),
+	// so the late view matrix is view * M^-1 = view * H * L'^-1 * L * H^-1
+	Posef pose = ts.HeadPose.ThePose;
+	Ogre::Matrix4 culledLocal, lateLocalInverse;
+	culledLocal.makeTransform(mHeadNode->getPosition(), mHeadNode->getScale(), mHeadNode->getOrientation());
+	lateLocalInverse.makeInverseTransform(Ogre::Vector3(pose.Translation.x, pose.Translation.y, pose.Translation.z), mHeadNode->getScale(),
+		Ogre::Quaternion(pose.Rotation.w, pose.Rotation.x, pose.Rotation.y, pose.Rotation.z));
+	const Ogre::Matrix4& head = mHeadNode->_getFullTransform();
+	Ogre::Camera* cam = mEyeCamera[eyeInProgress];
+	Ogre::Matrix4 view = cam->getViewMatrix(true) * head * lateLocalInverse * culledLocal * head.inverseAffine();
+
+	// shaders read the camera (per renderable), fixed function the render system: nothing else changes
+	cam->setCustomViewMatrix(true, view);
+	cam->getSceneManager()->getDestinationRenderSystem()->_setViewMatrix(view);
+	latchedCamera = cam;
+}
+
+void Rift::postRenderQueues()
 {
-	// Tell Ogre to put virtual camera rendered images on the two textures for distortion meshes (RenderTexture is a viewport on a texture)
-	mRenderTexture[ovrEye_Left] = mLeftEyeRenderTexture->getBuffer()->getRenderTarget();
-	mRenderTexture[ovrEye_Left]->addViewport(camLeft);	// camLeft rendering will warp so that it covers all mLeftEyeRenderTexture surface
-	mRenderTexture[ovrEye_Right] = mRightEyeRenderTexture->getBuffer()->getRenderTarget();
-	mRenderTexture[ovrEye_Right]->addViewport(camRight);	// same for camRight and mRightEyeRenderTexture
+	if (!latchedCamera) return;
+	latchedCamera->setCustomViewMatrix(false);
+	latchedCamera = nullptr;
+}
 
-	// Setup viewports proprieties
-	mRenderTexture[ovrEye_Left]->getViewport(0)->setClearEveryFrame(true);
-	mRenderTexture[ovrEye_Left]->getViewport(0)->setBackgroundColour(Ogre::ColourValue::Black);
-	mRenderTexture[ovrEye_Left]->getViewport(0)->setOverlaysEnabled(true);
+void Rift::attachCameras(Ogre::Camera* const camLeft, Ogre::Camera* const camRight)
+{
+	mEyeCamera[ovrEye_Left] = camLeft;
+	mEyeCamera[ovrEye_Right] = camRight;
+	attachEyeCamera(ovrEye_Left);
+	attachEyeCamera(ovrEye_Right);
+	updateEyeViewports();
+}
 
-	mRenderTexture[ovrEye_Right]->getViewport(0)->setClearEveryFrame(true);
-	mRenderTexture[ovrEye_Right]->getViewport(0)->setBackgroundColour(Ogre::ColourValue::Black);
-	mRenderTexture[ovrEye_Right]->getViewport(0)->setOverlaysEnabled(true);
+void Rift::attachEyeCamera(const int eye)
+{
+	// Tell Ogre to put virtual camera rendered images on the texture for the distortion mesh (RenderTexture is a viewport on a texture)
+	// camera rendering will warp so that it covers the eye viewport (see updateEyeViewports())
+	// With a shared texture both viewports are on the same target: z-order is the render order suggested by SDK
+	int zOrder = (sharedEyeTexture && hmd->getEyeRenderOrder(0) != eye) ? 1 : 0;
+	mRenderTexture[eye] = getEyeTexture(eye)->getBuffer()->getRenderTarget();
+	mEyeViewport[eye] = mRenderTexture[eye]->addViewport(mEyeCamera[eye], zOrder);
+
+	// Setup viewport proprieties
+	mEyeViewport[eye]->setClearEveryFrame(true);
+	mEyeViewport[eye]->setBackgroundColour(Ogre::ColourValue::Black);
+	mEyeViewport[eye]->setOverlaysEnabled(true);
 
 	// Oculus documentation suggests to ask to SDK for which eye should be rendered first.
 	// Just before rendering mWindow, we will ask that and render the two textures manually.
 	// So they must not be in any case rendered automatically by Ogre rendering loop.
-	mRenderTexture[ovrEye_Left]->setAutoUpdated(false);
-	mRenderTexture[ovrEye_Right]->setAutoUpdated(false);
+	mRenderTexture[eye]->setAutoUpdated(false);
 
 	// Register render listener (to perform operations right before and after rendering the textures)
-	mRenderTexture[ovrEye_Left]->addListener(this);
-	mRenderTexture[ovrEye_Right]->addListener(this);
+	if (!sharedEyeTexture || eye == ovrEye_Left) mRenderTexture[eye]->addListener(this);
+}
+
+void Rift::createEyeTextures()
+{
+	Ogre::TextureManager& textureManager = Ogre::TextureManager::getSingleton();
+
+	// release previous textures (their render targets and viewports go with them)
+	for (int eye = 0; eye < 2; eye++)
+	{
+		if (mRenderTexture[eye] && (eye == ovrEye_Left || mRenderTexture[eye] != mRenderTexture[ovrEye_Left]))
+		{
+			mRenderTexture[eye]->removeAllListeners();
+			mRenderTexture[eye]->removeAllViewports();
+		}
+	}
+	mRenderTexture[0] = mRenderTexture[1] = nullptr;
+	mEyeViewport[0] = mEyeViewport[1] = nullptr;
+	if (!mLeftEyeRenderTexture.isNull()) textureManager.remove(mLeftEyeRenderTexture->getHandle());
+	if (!mRightEyeRenderTexture.isNull() && mRightEyeRenderTexture != mLeftEyeRenderTexture) textureManager.remove(mRightEyeRenderTexture->getHandle());
+	mLeftEyeRenderTexture.setNull();
+	mRightEyeRenderTexture.setNull();
+
+	// eye areas at maximum pixel density
+	unsigned int width[2], height[2];
+	for (int eye = 0; eye < 2; eye++)
+	{
+		width[eye] = (unsigned int)std::ceil(recommendedTexSize[eye].w * maxPixelDensity);
+		height[eye] = (unsigned int)std::ceil(recommendedTexSize[eye].h * maxPixelDensity);
+	}
+
+	if (sharedEyeTexture)
+	{
+		// Both eyes side by side: one target bind per frame, one texture sampled by both distortion meshes
+		mLeftEyeRenderTexture = textureManager.createManual(
+			"RiftRenderTextureShared", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
+			Ogre::TEX_TYPE_2D, width[0] + width[1], std::max(height[0], height[1]),
+			0, Ogre::PF_R8G8B8, Ogre::TU_RENDERTARGET, 0, false, eyeFsaa);
+		mRightEyeRenderTexture = mLeftEyeRenderTexture;
+		rightEyeOffsetX = (int)width[0];
+	}
+	else
+	{
+		mLeftEyeRenderTexture = textureManager.createManual(
+			"RiftRenderTextureLeft", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
+			Ogre::TEX_TYPE_2D, width[0], height[0],
+			0, Ogre::PF_R8G8B8, Ogre::TU_RENDERTARGET, 0, false, eyeFsaa);
+		mRightEyeRenderTexture = textureManager.createManual(
+			"RiftRenderTextureRight", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
+			Ogre::TEX_TYPE_2D, width[1], height[1],
+			0, Ogre::PF_R8G8B8, Ogre::TU_RENDERTARGET, 0, false, eyeFsaa);
+		rightEyeOffsetX = 0;
+	}
+
+	// Assign the textures to the distortion materials
+	mMatLeft->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setTexture(mLeftEyeRenderTexture);
+	mMatRight->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setTexture(mRightEyeRenderTexture);
+	mMatLookup[0]->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setTexture(mLeftEyeRenderTexture);
+	mMatLookup[1]->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setTexture(mRightEyeRenderTexture);
+
+	// render again the same cameras (if already attached)
+	for (int eye = 0; eye < 2; eye++)
+		if (mEyeCamera[eye]) attachEyeCamera(eye);
+}
+
+void Rift::updateEyeViewports()
+{
+	for (int eye = 0; eye < 2; eye++)
+	{
+		Ogre::TexturePtr texture = getEyeTexture(eye);
+		ovrSizei textureSize;
+		textureSize.w = (int)texture->getWidth();
+		textureSize.h = (int)texture->getHeight();
+
+		// eye is rendered in the top-left sub-rectangle (of its half, if shared) matching current pixel density
+		ovrRecti viewport;
+		viewport.Pos.x = (eye == ovrEye_Right) ? rightEyeOffsetX : 0;
+		viewport.Pos.y = 0;
+		viewport.Size.w = std::min((int)(recommendedTexSize[eye].w * pixelDensity + 0.5f), textureSize.w - viewport.Pos.x);
+		viewport.Size.h = std::min((int)(recommendedTexSize[eye].h * pixelDensity + 0.5f), textureSize.h);
+		if (mEyeViewport[eye])
+			mEyeViewport[eye]->setDimensions((Ogre::Real)viewport.Pos.x / textureSize.w, 0, (Ogre::Real)viewport.Size.w / textureSize.w, (Ogre::Real)viewport.Size.h / textureSize.h);
+
+		// distortion mesh samples only that sub-rectangle
+		ovrVector2f UVScaleOffset[2];	//0 = Scale, 1 = Offset
+		hmd->getRenderScaleAndOffset(eyeRenderDesc[eye].Fov, textureSize, viewport, UVScaleOffset);
+		float* uvScale = mDistortionConstants[eye]->getFloatPointer(uvScaleIndex);
+		float* uvOffset = mDistortionConstants[eye]->getFloatPointer(uvOffsetIndex);
+		uvScale[0] = UVScaleOffset[0].x;
+		uvScale[1] = UVScaleOffset[0].y;
+		uvOffset[0] = UVScaleOffset[1].x;
+		uvOffset[1] = UVScaleOffset[1].y;
+		mDistortionConstants[eye]->_markDirty();
+	}
+}
+
+void Rift::createDistortionConstants()
+{
+	// mesh: distortion and timewarp in the vertex shader, lookup: in the fragment shader. Both read the eye block.
+	Ogre::MaterialPtr meshMaterials[2] = { mMatLeft, mMatRight };
+	for (int eye = 0; eye < 2; eye++)
+	{
+		mDistortionConstants[eye] = Ogre::GpuProgramManager::getSingleton().createSharedParameters(eye == 0 ? "RiftDistortionLeft" : "RiftDistortionRight");
+		mDistortionConstants[eye]->addConstantDefinition("eyeToSourceUVScale", Ogre::GCT_FLOAT2);
+		mDistortionConstants[eye]->addConstantDefinition("eyeToSourceUVOffset", Ogre::GCT_FLOAT2);
+		mDistortionConstants[eye]->addConstantDefinition("eyeRotationStart", Ogre::GCT_MATRIX_4X4);
+		mDistortionConstants[eye]->addConstantDefinition("eyeRotationEnd", Ogre::GCT_MATRIX_4X4);
+		meshMaterials[eye]->getTechnique(0)->getPass(0)->getVertexProgramParameters()->addSharedParameters(mDistortionConstants[eye]);
+		mMatLookup[eye]->getTechnique(0)->getPass(0)->getFragmentProgramParameters()->addSharedParameters(mDistortionConstants[eye]);
+	}
+
+	// both blocks have the same layout
+	uvScaleIndex = mDistortionConstants[0]->getConstantDefinition("eyeToSourceUVScale").physicalIndex;
+	uvOffsetIndex = mDistortionConstants[0]->getConstantDefinition("eyeToSourceUVOffset").physicalIndex;
+	eyeRotationStartIndex = mDistortionConstants[0]->getConstantDefinition("eyeRotationStart").physicalIndex;
+	eyeRotationEndIndex = mDistortionConstants[0]->getConstantDefinition("eyeRotationEnd").physicalIndex;
+}
+
+void Rift::setDistortionMode(const DistortionMode mode)
+{
+	distortionMode = mode;
+	if (!mDistortionMesh[0]) return;	// scene not created yet: applied by createRiftDisplayScene()
+
+	if (distortionMode == DistortionMode::Lookup && !mDistortionQuad[0])
+		createDistortionLookup();
+	for (int eye = 0; eye < 2; eye++)
+	{
+		mDistortionMesh[eye]->setVisible(distortionMode == DistortionMode::Mesh);
+		if (mDistortionQuad[eye]) mDistortionQuad[eye]->setVisible(distortionMode == DistortionMode::Lookup);
+	}
+}
+
+void Rift::createDistortionLookup()
+{
+	std::chrono::steady_clock::time_point bakeStart_time = std::chrono::steady_clock::now();
+	size_t lookupBytes = 0;
+	for (int eye = 0; eye < 2; eye++)
+	{
+		// one texel per display pixel at scale 1.0 (bilinear filtering fills in lower scales)
+		unsigned int width = std::max(16, (int)(eyeRenderDesc[eye].DistortedViewport.Size.w * distortionLookupScale + 0.5f));
+		unsigned int height = std::max(16, (int)(eyeRenderDesc[eye].DistortedViewport.Size.h * distortionLookupScale + 0.5f));
+		Ogre::TexturePtr lookup[2];
+		Ogre::Vector4 bounds;
+		bakeDistortionLookup(eye == 0 ? "RiftDistortionLookupLeft" : "RiftDistortionLookupRight", distortionMeshData[eye], width, height, lookup, bounds);
+		lookupBytes += 2 * Ogre::PixelUtil::getMemorySize(width, height, 1, Ogre::PF_FLOAT16_RGBA);
+		distortionMeshData[eye] = HmdDistortionMesh();
+
+		Ogre::Pass* pass = mMatLookup[eye]->getTechnique(0)->getPass(0);
+		pass->getTextureUnitState(1)->setTexture(lookup[0]);
+		pass->getTextureUnitState(2)->setTexture(lookup[1]);
+
+		// one quad over the area of the mesh (bounds: left, bottom, right, top), lookup row 0 at the top
+		mDistortionQuad[eye] = mSceneMgr->createManualObject(eye == 0 ? "RiftLookupQuadLeft" : "RiftLookupQuadRight");
+		mDistortionQuad[eye]->begin(mMatLookup[eye]->getName(), Ogre::RenderOperation::OT_TRIANGLE_STRIP);
+		mDistortionQuad[eye]->position(bounds.x, bounds.w, 0);
+		mDistortionQuad[eye]->textureCoord(0, 0);
+		mDistortionQuad[eye]->position(bounds.x, bounds.y, 0);
+		mDistortionQuad[eye]->textureCoord(0, 1);
+		mDistortionQuad[eye]->position(bounds.z, bounds.w, 0);
+		mDistortionQuad[eye]->textureCoord(1, 0);
+		mDistortionQuad[eye]->position(bounds.z, bounds.y, 0);
+		mDistortionQuad[eye]->textureCoord(1, 1);
+		mDistortionQuad[eye]->end();
+		mDistortionNode->attachObject(mDistortionQuad[eye]);
+	}
+	double bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bakeStart_time).count();
+	std::cout << "Distortion lookup: " << lookupBytes << " bytes of textures, baked in " << bakeMs << " ms" << std::endl;
+}
+
+void Rift::setEyeRenderQuality(const float density, const unsigned int fsaa)
+{
+	// MSAA is a property of the texture: a new one is needed (listeners and viewports are moved to it)
+	if (fsaa != eyeFsaa)
+	{
+		eyeFsaa = fsaa;
+		createEyeTextures();
+	}
+	pixelDensity = Ogre::Math::Clamp(density, 0.1f, maxPixelDensity);
+	updateEyeViewports();
 }
 
 bool Rift::update( float dt )
 {
 	if( !hmd ) return true;
 
-	ovrTrackingState ts = ovrHmd_GetTrackingState(hmd, frameTiming.ScanoutMidpointSeconds);
+	ovrTrackingState ts = hmd->getTrackingState(frameTiming.ScanoutMidpointSeconds);
 
 	if (ts.StatusFlags & (ovrStatus_OrientationTracked | ovrStatus_PositionTracked)) {
 		// The cpp compatibility layer is used to convert ovrPosef to Posef (see OVR_Math.h)
@@ -464,88 +684,130 @@ bool Rift::update( float dt )
 	return true;
 }
 
-// All render targets (mRenderWindow and mRenderTexture[]) are registered to this listener
+// All render targets (mRenderWindow or mDisplayTexture, and mRenderTexture[]) are registered to this listener
 void Rift::preRenderTargetUpdate(const Ogre::RenderTargetEvent& rte)
 {
 
-	if(rte.source == mRenderWindow)	// I am rendering the main window to be displayed on the Rift
+	if(rte.source == mDisplayTarget)	// I am rendering the main window to be displayed on the Rift (or its offscreen copy)
 	{
 		// Phase (1): tell Oculus SDK that the frame (the one to be displayed on the rift) is about to be rendered
-		frameTiming = ovrHmd_BeginFrameTiming(hmd, 0);
+		frameTiming = hmd->beginFrameTiming(0);
 		
 		// Phase (2) and (3): render the two eye RenderTextures (in the order suggested by SDK)
 		// This will call again preRenderTargetUpdate() but for the two RenderTextures
-		for (int eyeIndex = 0; eyeIndex < ovrEye_Count; eyeIndex++)
+		// (shared texture: one update, preViewportUpdate() is called for each eye viewport, already in SDK order)
+		// (skipped on reprojection frames: the last eye images and their render poses are used again in phase 5)
+		bool renderEyes = !pause && !reprojectionFrame;
+		if (renderEyes) renderedFrames++;
+		else reprojectedFrames++;
+		std::chrono::steady_clock::time_point eyePassStart_time = std::chrono::steady_clock::now();
+		if (sharedEyeTexture)
+		{
+			TRACE_SCOPE("eye RTT shared");
+			if(renderEyes) mRenderTexture[ovrEye_Left]->update();
+		}
+		else for (int eyeIndex = 0; eyeIndex < ovrEye_Count; eyeIndex++)
 		{
-			nextEyeToRender = hmd->EyeRenderOrder[eyeIndex];
-			if(!pause) mRenderTexture[nextEyeToRender]->update();
+			nextEyeToRender = hmd->getEyeRenderOrder(eyeIndex);
+			TRACE_SCOPE(nextEyeToRender == ovrEye_Left ? "eye RTT left" : "eye RTT right");
+			if(renderEyes)
+			{
+				std::chrono::steady_clock::time_point eyeStart_time = std::chrono::steady_clock::now();
+				mRenderTexture[nextEyeToRender]->update();
+				eyeRenderTimes[nextEyeToRender].add(std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - eyeStart_time).count());
+			}
 		}
+		if(renderEyes) eyePassTimes.add(std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - eyePassStart_time).count());
 
 		// Phase (4): Wait till time-warp point to reduce latency (to get closest as possible to the screen time).
-		// You can put some operations BEFORE THIS POINT to squeeze some extra CPU.
-		ovr_WaitTillTime(frameTiming.TimewarpPointSeconds);
+		// You can put some operations BEFORE THIS POINT to squeeze some extra CPU: queued idle work runs here,
+		// as long as it fits before the time-warp point (not counted as wait).
+		if (idleWork)
+		{
+			TRACE_SCOPE("idle work");
+			std::chrono::duration< double > untilTimewarp(frameTiming.TimewarpPointSeconds - ovr_GetTimeInSeconds());
+			idleWork->drainUntil(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(untilTimewarp));
+		}
+		{
+			TRACE_SCOPE("WaitTillTime");
+			std::chrono::steady_clock::time_point waitStart_time = std::chrono::steady_clock::now();
+			hmd->waitTillTime(frameTiming.TimewarpPointSeconds);
+			lastWaitMs = std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - waitStart_time).count();
+		}
 
 		// Final Rendering Phase (5): predict eye pose one last time and apply timewarp to each eye
+		std::chrono::steady_clock::time_point timewarpStart_time = std::chrono::steady_clock::now();
 		for (int eyeNum = 0; eyeNum < 2; eyeNum++)
 		{
-			// Init shader parameters pointer
-			Ogre::GpuProgramParametersSharedPtr params;
-			switch (eyeNum) // order of shading is not important, only need to do everything for each eye
-			{
-			case 0:
-				params = mMatLeft->getTechnique(0)->getPass(0)->getVertexProgramParameters();
-				break;
-			case 1:
-				params = mMatRight->getTechnique(0)->getPass(0)->getVertexProgramParameters();
-				break;
-			default:
-				break;
-			}
-
 			// Sample the third time eye pose and get the two time-warp matrices
+			// (order of shading is not important, only need to do everything for each eye)
 			ovrMatrix4f tWM[2];
-			ovrHmd_GetEyeTimewarpMatrices(hmd, (ovrEyeType)eyeNum, headPose[eyeNum], tWM);
-
-			// Set time-warp matrices in the Oculus vertex shader
-			params->setNamedConstant("eyeRotationStart",
-				Ogre::Matrix4(tWM[0].M[0][0], tWM[0].M[0][1], tWM[0].M[0][2], tWM[0].M[0][3],
-				tWM[0].M[1][0], tWM[0].M[1][1], tWM[0].M[1][2], tWM[0].M[1][3],
-				tWM[0].M[2][0], tWM[0].M[2][1], tWM[0].M[2][2], tWM[0].M[2][3],
-				tWM[0].M[3][0], tWM[0].M[3][1], tWM[0].M[3][2], tWM[0].M[3][3]
-				));
-			params->setNamedConstant("eyeRotationEnd",
-				Ogre::Matrix4(tWM[1].M[0][0], tWM[1].M[0][1], tWM[1].M[0][2], tWM[1].M[0][3],
-				tWM[1].M[1][0], tWM[1].M[1][1], tWM[1].M[1][2], tWM[1].M[1][3],
-				tWM[1].M[2][0], tWM[1].M[2][1], tWM[1].M[2][2], tWM[1].M[2][3],
-				tWM[1].M[3][0], tWM[1].M[3][1], tWM[1].M[3][2], tWM[1].M[3][3]
-				));
+			hmd->getEyeTimewarpMatrices(eyeNum, headPose[eyeNum], tWM);
+
+			// Set time-warp matrices in the eye constant block (row major, as Ogre::Matrix4):
+			// copied once into the programs of the eye, whichever distortion mode draws
+			std::memcpy(mDistortionConstants[eyeNum]->getFloatPointer(eyeRotationStartIndex), tWM[0].M, sizeof(tWM[0].M));
+			std::memcpy(mDistortionConstants[eyeNum]->getFloatPointer(eyeRotationEndIndex), tWM[1].M, sizeof(tWM[1].M));
+			mDistortionConstants[eyeNum]->_markDirty();
 		}
+		timewarpSetupTimes.add(std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - timewarpStart_time).count());
 	}
-	else // I am rendering one of the two RenderTextures
+	else if (!sharedEyeTexture) // I am rendering one of the two RenderTextures
 	{
 		// Phase (2) and (3): predict eye/head pose, apply head pose then render (one eye at a time)
-		ovrTrackingState ts; // order of the eye matters (nextEyeToRender is used)
-		ovrHmd_GetEyePoses(hmd, 0, &(eyeRenderDesc[nextEyeToRender].HmdToEyeViewOffset), headPose, &ts);
-		if (ts.StatusFlags & (ovrStatus_OrientationTracked | ovrStatus_PositionTracked))
-		{
-			Posef pose = ts.HeadPose.ThePose;
-			mOrientation = Ogre::Quaternion(pose.Rotation.w, pose.Rotation.x, pose.Rotation.y, pose.Rotation.z);
-			mPosition = Ogre::Vector3(pose.Translation.x, pose.Translation.y, pose.Translation.z);
-			mHeadNode->setOrientation(mOrientation);
-			mHeadNode->setPosition(mPosition);
-		}
+		applyEyePose();
 	}
 
 }
+
+// Shared eye texture: same as phase (2) and (3) above, but per eye viewport
+void Rift::preViewportUpdate(const Ogre::RenderTargetViewportEvent& evt)
+{
+	if (!sharedEyeTexture || evt.source->getTarget() != mRenderTexture[ovrEye_Left]) return;
+	nextEyeToRender = (evt.source == mEyeViewport[ovrEye_Left]) ? ovrEye_Left : ovrEye_Right;
+	applyEyePose();
+	eyeViewportStart_time = std::chrono::steady_clock::now();
+}
+void Rift::postViewportUpdate(const Ogre::RenderTargetViewportEvent& evt)
+{
+	if (!sharedEyeTexture || evt.source->getTarget() != mRenderTexture[ovrEye_Left]) return;
+	eyeInProgress = -1;
+	eyeRenderTimes[nextEyeToRender].add(std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - eyeViewportStart_time).count());
+}
+
+void Rift::applyEyePose()
+{
+	eyeInProgress = nextEyeToRender;
+	ovrTrackingState ts; // order of the eye matters (nextEyeToRender is used)
+	ovrPosef eyePoses[2];
+	hmd->getEyePoses(0, &(eyeRenderDesc[nextEyeToRender].HmdToEyeViewOffset), eyePoses, &ts);
+	headPose[nextEyeToRender] = eyePoses[0];	// pose of the offset passed, only this eye's (the other one was rendered with its own)
+	if (ts.StatusFlags & (ovrStatus_OrientationTracked | ovrStatus_PositionTracked))
+	{
+		Posef pose = ts.HeadPose.ThePose;
+		mOrientation = Ogre::Quaternion(pose.Rotation.w, pose.Rotation.x, pose.Rotation.y, pose.Rotation.z);
+		mPosition = Ogre::Vector3(pose.Translation.x, pose.Translation.y, pose.Translation.z);
+		mHeadNode->setOrientation(mOrientation);
+		mHeadNode->setPosition(mPosition);
+	}
+}
 void Rift::postRenderTargetUpdate(const Ogre::RenderTargetEvent& rte)
 {
 	// Phase (6): tell Oculus SDK that the frame just finished rendering
-	if(rte.source==mRenderWindow) ovrHmd_EndFrameTiming(hmd);
+	if(rte.source==mDisplayTarget)
+	{
+		TRACE_SCOPE("EndFrameTiming");
+		hmd->endFrameTiming();
+	}
+	else if (!sharedEyeTexture)
+	{
+		eyeInProgress = -1;
+	}
 }
 
 
 void Rift::recenterPose()
 {
 	if ( hmd )
-		ovrHmd_RecenterPose( hmd );
+		hmd->recenterPose();
 }
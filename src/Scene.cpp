@@ -1,6 +1,7 @@
 
 #include "Scene.h"
 #include <cmath>
+#include <algorithm>
 #define _USE_MATH_DEFINES
 #include <math.h>
 
@@ -30,6 +31,7 @@ Scene::Scene( Ogre::Root* root, OIS::Mouse* mouse, OIS::Keyboard* keyboard )
 }
 Scene::~Scene()
 {
+	if (mStereoCuller) delete mStereoCuller;
 	if (mSceneMgr) delete mSceneMgr;
 }
 
@@ -450,6 +452,8 @@ void Scene::createPinholeVideos(const float WPlane, const float HPlane, const Og
 
 	// Save updated camera offset (for later runtime adjustments)
 	videoOffset = offset;
+	videoPlaneWidth = WPlane;
+	videoPlaneHeight = HPlane;
 
 	//Set camera listeners to this class (so that I can do stuff before and after each renders)
 	//mCamLeft->addListener(this);			// THIS IS DONE WHEN SEETHROUGH FEATURE IS ENABLED
@@ -518,9 +522,11 @@ void Scene::createFisheyeVideos(const Ogre::Vector3 offset = Ogre::Vector3::ZERO
 	// CREATE SHAPES
 	// -------------
 
-	//Create an entity out of a loaded static mesh (a half sphere modeled/uvmapped in blender)
-	Ogre::Entity* videoSphereEntityLeft = mSceneMgr->createEntity("FisheyeUndistort.polysphere.mesh");
-	Ogre::Entity* videoSphereEntityRight = mSceneMgr->createEntity("FisheyeUndistort.polysphere.mesh");
+	//Create an entity out of a sphere generated from the lens model (one mesh per eye: texture calibration is baked in UVs)
+	mLeftFisheyeMesh = createFisheyeMesh("FisheyeVideoSphereLeft");
+	mRightFisheyeMesh = createFisheyeMesh("FisheyeVideoSphereRight");
+	Ogre::Entity* videoSphereEntityLeft = mSceneMgr->createEntity(mLeftFisheyeMesh->getName());
+	Ogre::Entity* videoSphereEntityRight = mSceneMgr->createEntity(mRightFisheyeMesh->getName());
 
 	//Attach to each mHeadStabilizationNode a SceneNode that follows virtual camera position in respect to the neck
 	//so that we can deal with mVideoLeft and mVideoRight positions relatively to each camera despite Stabilization
@@ -585,6 +591,10 @@ void Scene::createFisheyeVideos(const Ogre::Vector3 offset = Ogre::Vector3::ZERO
 	mRightCameraRenderMaterial->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setTexture(mRightCameraRenderTexture);
 	//mRightCameraRenderMaterial->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setTexture(mRightCameraRenderTexture);
 
+	// Shader constant is written by index from now on (see setVideoDimmed())
+	resolveFisheyeShaderConstants(mLeftCameraRenderMaterial, mLeftFisheyeConstants);
+	resolveFisheyeShaderConstants(mRightCameraRenderMaterial, mRightFisheyeConstants);
+
 	// Assign materials to videoPlaneEntities
 	videoSphereEntityLeft->setMaterial(mLeftCameraRenderMaterial);
 	videoSphereEntityRight->setMaterial(mRightCameraRenderMaterial);
@@ -611,12 +621,137 @@ void Scene::setRiftPose( Ogre::Quaternion orientation, Ogre::Vector3 pos )
 //////////////////////////////////////////////////////////////
 // Handle Camera update:
 //////////////////////////////////////////////////////////////
-void Scene::setVideoImagePoseLeft(const Ogre::PixelBox &image, Ogre::Quaternion pose)
+void Scene::setVideoLeftDimmed(const bool dimmed)
+{
+	if (dimmed == videoLeftIsDimmed) return;
+	videoLeftIsDimmed = dimmed;
+	setVideoDimmed(mLeftCameraRenderMaterial, dimmed);
+}
+
+void Scene::setVideoRightDimmed(const bool dimmed)
+{
+	if (dimmed == videoRightIsDimmed) return;
+	videoRightIsDimmed = dimmed;
+	setVideoDimmed(mRightCameraRenderMaterial, dimmed);
+}
+
+bool Scene::projectVideoImagePoint(const int eye, const Ogre::Vector2& uv, Ogre::Vector2& viewportPoint)
+{
+	if (currentCameraModel != Pinhole || !mVideoLeft || !mVideoRight) return false;
+	Ogre::SceneNode* video = (eye == 0) ? mVideoLeft : mVideoRight;
+	Ogre::Camera* cam = (eye == 0) ? mCamLeft : mCamRight;
+
+	// plane mesh lies on local XY (normal Z), texture v = 0 on its top edge
+	Ogre::Vector3 local((uv.x - 0.5f) * videoPlaneWidth, (0.5f - uv.y) * videoPlaneHeight, 0.0f);
+	Ogre::Vector3 world = video->_getFullTransform() * local;
+	Ogre::Vector4 clip = cam->getProjectionMatrix() * cam->getViewMatrix() * Ogre::Vector4(world.x, world.y, world.z, 1.0f);
+	if (clip.w <= 0) return false;		// behind the camera
+
+	viewportPoint.x = (clip.x / clip.w + 1.0f) * 0.5f;
+	viewportPoint.y = (1.0f - clip.y / clip.w) * 0.5f;
+	return viewportPoint.x >= 0 && viewportPoint.x <= 1 && viewportPoint.y >= 0 && viewportPoint.y <= 1;
+}
+
+bool Scene::getVisibleVideoRegion(const int eye, const float margin, Ogre::FloatRect& region)
+{
+	if (currentCameraModel != Pinhole || !mVideoLeft || !mVideoRight) return false;
+	Ogre::SceneNode* video = (eye == 0) ? mVideoLeft : mVideoRight;
+	Ogre::Camera* cam = (eye == 0) ? mCamLeft : mCamRight;
+
+	// Plane where it is with no stabilization rotation: the region is kept until the layout changes, while stabilization
+	// turns the plane every frame by the head motion of the capture delay (left to the margin).
+	// planeToWorld = P * S * R, with S the stabilization node transform: rebuilt with S0 = S without its orientation.
+	Ogre::Matrix4 planeToWorld = video->_getFullTransform();
+	Ogre::SceneNode* stabilization = (eye == 0) ? mLeftStabilizationNode : mRightStabilizationNode;
+	if (stabilization)
+	{
+		Ogre::Matrix4 stabilizationToWorld = stabilization->_getFullTransform();
+		Ogre::Matrix4 stabilizationLocal, stabilizationLocalUnrotated;
+		stabilizationLocal.makeTransform(stabilization->getPosition(), stabilization->getScale(), stabilization->getOrientation());
+		stabilizationLocalUnrotated.makeTransform(stabilization->getPosition(), stabilization->getScale(), Ogre::Quaternion::IDENTITY);
+		planeToWorld = stabilizationToWorld * stabilizationLocal.inverseAffine() * stabilizationLocalUnrotated * stabilizationToWorld.inverseAffine() * planeToWorld;
+	}
+
+	// The frustum cuts the plane inside the quad hit by its four corner rays: bounds of that quad, in plane space
+	Ogre::Matrix4 worldToPlane = planeToWorld.inverseAffine();
+	const Ogre::Vector2 corners[4] = { Ogre::Vector2(0, 0), Ogre::Vector2(1, 0), Ogre::Vector2(0, 1), Ogre::Vector2(1, 1) };
+	Ogre::Vector2 minUV(Ogre::Math::POS_INFINITY, Ogre::Math::POS_INFINITY);
+	Ogre::Vector2 maxUV(Ogre::Math::NEG_INFINITY, Ogre::Math::NEG_INFINITY);
+	for (const Ogre::Vector2& corner : corners)
+	{
+		Ogre::Ray ray = cam->getCameraToViewportRay(corner.x, corner.y);
+		Ogre::Vector3 origin = worldToPlane.transformAffine(ray.getOrigin());
+		Ogre::Vector3 direction = worldToPlane.transformAffine(ray.getOrigin() + ray.getDirection()) - origin;
+		if (std::abs(direction.z) < 1e-6f) return false;
+		float t = -origin.z / direction.z;
+		if (t <= 0) return false;		// corner ray misses the plane: can not tell, whole image
+		Ogre::Vector3 hit = origin + direction * t;
+		Ogre::Vector2 uv(hit.x / videoPlaneWidth + 0.5f, 0.5f - hit.y / videoPlaneHeight);
+		minUV.makeFloor(uv);
+		maxUV.makeCeil(uv);
+	}
+
+	region.left = Ogre::Math::Clamp(minUV.x - margin, 0.0f, 1.0f);
+	region.top = Ogre::Math::Clamp(minUV.y - margin, 0.0f, 1.0f);
+	region.right = Ogre::Math::Clamp(maxUV.x + margin, 0.0f, 1.0f);
+	region.bottom = Ogre::Math::Clamp(maxUV.y + margin, 0.0f, 1.0f);
+	return region.right > region.left && region.bottom > region.top;
+}
+
+void Scene::setVideoDimmed(Ogre::MaterialPtr& material, const bool dimmed)
+{
+	if (material.isNull()) return;
+	const float factor = dimmed ? videoDimFactor : 1.0f;
+	Ogre::Pass* pass = material->getTechnique(0)->getPass(0);
+
+	switch (currentCameraModel)
+	{
+	case Pinhole:
+		// fixed function: modulate texture with a manual grey colour
+		pass->getTextureUnitState(0)->setColourOperationEx(Ogre::LBX_MODULATE, Ogre::LBS_TEXTURE, Ogre::LBS_MANUAL, Ogre::ColourValue::White, Ogre::ColourValue(factor, factor, factor));
+		break;
+
+	case Fisheye:
+	{
+		// fragment shader: texture is multiplied by dimFactor
+		FisheyeShaderConstants& constants = (material == mLeftCameraRenderMaterial) ? mLeftFisheyeConstants : mRightFisheyeConstants;
+		constants.params->_writeRawConstants(constants.dimFactor, &factor, 1);
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+void Scene::setVideoImageSizeLeft(const size_t width, const size_t height)
+{
+	resizeVideoTexture(mLeftCameraRenderTexture, width, height);
+}
+void Scene::setVideoImageSizeRight(const size_t width, const size_t height)
+{
+	resizeVideoTexture(mRightCameraRenderTexture, width, height);
+}
+void Scene::resizeVideoTexture(Ogre::TexturePtr& texture, const size_t width, const size_t height)
+{
+	if (texture.isNull() || width == 0 || height == 0) return;
+	if (texture->getWidth() == width && texture->getHeight() == height) return;
+
+	// manual texture: same object (materials keep pointing to it), new buffer
+	std::cout << "Video texture " << texture->getName() << " resized to " << width << "x" << height << std::endl;
+	texture->freeInternalResources();
+	texture->setWidth(width);
+	texture->setHeight(height);
+	texture->createInternalResources();
+}
+
+void Scene::setVideoImagePoseLeft(const Ogre::PixelBox &image, Ogre::Quaternion pose, const Ogre::Box* textureBox)
 {
 	if (videoIsEnabled)
 	{
 		// update image pixels
-		mLeftCameraRenderTexture->getBuffer()->blitFromMemory(image);
+		if (textureBox) mLeftCameraRenderTexture->getBuffer()->blitFromMemory(image, *textureBox);
+		else mLeftCameraRenderTexture->getBuffer()->blitFromMemory(image);
 		camera_frame_updated = true;
 
 		// update image position/orientation (THIS IS TOO COOL SO I KEEP THIS)
@@ -631,12 +766,13 @@ void Scene::setVideoImagePoseLeft(const Ogre::PixelBox &image, Ogre::Quaternion
 	}
 
 }
-void Scene::setVideoImagePoseRight(const Ogre::PixelBox &image, Ogre::Quaternion pose)
+void Scene::setVideoImagePoseRight(const Ogre::PixelBox &image, Ogre::Quaternion pose, const Ogre::Box* textureBox)
 {
 	if (videoIsEnabled)
 	{
 		// update image pixels
-		mRightCameraRenderTexture->getBuffer()->blitFromMemory(image);
+		if (textureBox) mRightCameraRenderTexture->getBuffer()->blitFromMemory(image, *textureBox);
+		else mRightCameraRenderTexture->getBuffer()->blitFromMemory(image);
 		//camera_frame_updated = true;
 
 		// update image position/orientation (THIS IS TOO COOL SO I KEEP THIS)
@@ -670,29 +806,11 @@ void Scene::update(float dt)
 	}
 	*/
 
-	// WARNING: THIS IS A HACK!!
-	// UPDATES ORIENTATION OF THE VIDEOPLANES SO THAT VIRTUAL AND REAL ALWAYS MATCH!!
-	// WORKS ONLY WITHIN A CERTAIN DISTANCE AND IS HARDCODED FOR THE CURRENT SETUP with Oculus DK2 at Cvap in KTH
-	// For details contact fakkoweb@libero.it
-	// REMEMBER THAT WITH TOED-IN CAMERAS REALITY AND VIRTUALITY CAN MATCH ONLY AT A SPECIFIED DISTANCE OR (if well done) IT CAN DIFFER ALWAYS OF THE OFFSET BETWEEN CAMERAS AND EYES
-	// Since in our implementation such discrepancy is still perceived as high, we dynamically adjust video planes so that they always match, and will adapt from 20cm to 2meters from the marker!
-	
-	
-	float currentMarkerZ = mCubeRedReference->getPosition().z;
-	if(currentMarkerZ > 0.0f && currentMarkerZ < 1.74f) // the selected range for hack goes from 0.285f to 1.73f and correspond respectively to -0.8f deg and 0.9 deg of videoPlane toe-in rotation.
-	{
-		float videoToeInAngleAdjustFactor = (currentMarkerZ - 0.285)/(1.74f-0.285);
-		float videoToeInAdjustRange = 0.9f-(-0.3f);
-		// videoToeInAngle = 0 corresponds to optimal vieweing distance -> where camera optical axes converge!!
-		videoToeInAngle = -0.3f + videoToeInAngleAdjustFactor*videoToeInAdjustRange;	// JUST A LINEAR APPROXIMATION!!
-		
-		mToeInCorrectionLeft->resetOrientation();
-		mToeInCorrectionLeft->yaw(Ogre::Degree(-videoToeInAngle));
-		mToeInCorrectionRight->resetOrientation();
-		mToeInCorrectionRight->yaw(Ogre::Degree(videoToeInAngle));
-		//std::cout<<"New angle! "<<videoToeInAngle<<std::endl;
-	}
-	
+	// Video toe-in correction for the current marker distance (see computeVideoToeInAngle())
+	// N.B. App applies it from the simulation snapshot instead (see Simulation), this is for scenes updated directly
+	float angle;
+	if (computeVideoToeInAngle(mCubeRedReference->getPosition().z, angle))
+		setVideoToeInAngle(angle);
 
 	// get full body absolute orientation (in world reference)
 	Ogre::Vector3 dirX = mBodyTiltNode->_getDerivedOrientation()*Ogre::Vector3::UNIT_X;
@@ -700,15 +818,180 @@ void Scene::update(float dt)
 
 	//mBodyNode->setPosition(mBodyNode->getPosition() + dirZ*forward*dt + dirX*leftRight*dt);
 }
+// WARNING: THIS IS A HACK!!
+// UPDATES ORIENTATION OF THE VIDEOPLANES SO THAT VIRTUAL AND REAL ALWAYS MATCH!!
+// WORKS ONLY WITHIN A CERTAIN DISTANCE AND IS HARDCODED FOR THE CURRENT SETUP with Oculus DK2 at Cvap in KTH
+// For details contact fakkoweb@libero.it
+// REMEMBER THAT WITH TOED-IN CAMERAS REALITY AND VIRTUALITY CAN MATCH ONLY AT A SPECIFIED DISTANCE OR (if well done) IT CAN DIFFER ALWAYS OF THE OFFSET BETWEEN CAMERAS AND EYES
+// Since in our implementation such discrepancy is still perceived as high, we dynamically adjust video planes so that they always match, and will adapt from 20cm to 2meters from the marker!
+bool Scene::computeVideoToeInAngle(const float markerZ, float& angle)
+{
+	if (markerZ > 0.0f && markerZ < 1.74f) // the selected range for hack goes from 0.285f to 1.73f and correspond respectively to -0.8f deg and 0.9 deg of videoPlane toe-in rotation.
+	{
+		float videoToeInAngleAdjustFactor = (markerZ - 0.285)/(1.74f-0.285);
+		float videoToeInAdjustRange = 0.9f-(-0.3f);
+		// videoToeInAngle = 0 corresponds to optimal vieweing distance -> where camera optical axes converge!!
+		angle = -0.3f + videoToeInAngleAdjustFactor*videoToeInAdjustRange;	// JUST A LINEAR APPROXIMATION!!
+		return true;
+	}
+	return false;
+}
+
+void Scene::setVideoToeInAngle(const float angle)
+{
+	if (angle == videoToeInAngle) return;
+	videoToeInAngle = angle;
+	videoLayoutVersion++;
+	mToeInCorrectionLeft->resetOrientation();
+	mToeInCorrectionLeft->yaw(Ogre::Degree(-videoToeInAngle));
+	mToeInCorrectionRight->resetOrientation();
+	mToeInCorrectionRight->yaw(Ogre::Degree(videoToeInAngle));
+	//std::cout<<"New angle! "<<videoToeInAngle<<std::endl;
+}
+
+void Scene::resolveFisheyeShaderConstants(Ogre::MaterialPtr& material, FisheyeShaderConstants& constants)
+{
+	constants.params = material->getTechnique(0)->getPass(0)->getFragmentProgramParameters();
+	constants.dimFactor = constants.params->getConstantDefinition("dimFactor").physicalIndex;
+}
+
+Ogre::MeshPtr Scene::createFisheyeMesh(const std::string& name)
+{
+	// Unit sphere cap looking down -z (camera stays in its centre), one vertex in the centre of the view
+	// and rings x segments vertices around it, up to half the lens FOV
+	const unsigned int rings = std::max(fisheyeLens.rings, 1u);
+	const unsigned int segments = std::max(fisheyeLens.segments, 3u);
+	const size_t vertexCount = 1 + (size_t)rings * segments;
+	if (vertexCount > 65536)
+		OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Fisheye mesh " + name + " has " + Ogre::StringConverter::toString(vertexCount) + " vertices (up to 65536 supported)", "Scene::createFisheyeMesh");
+	const float maxTheta = Ogre::Degree(std::min(std::max(fisheyeLens.fovDegrees, 1.0f), 359.0f)).valueRadians() * 0.5f;
+
+	// Distance from the image centre of a ray at angle theta from the optical axis (any unit, normalized below)
+	const FisheyeLens& lens = fisheyeLens;
+	auto imageRadius = [&lens](const float theta) -> float
+	{
+		switch (lens.projection)
+		{
+		case FisheyeLens::Equidistant:
+		{
+			const float t2 = theta * theta;
+			return theta * (1 + t2 * (lens.k[0] + t2 * (lens.k[1] + t2 * (lens.k[2] + t2 * lens.k[3]))));
+		}
+		case FisheyeLens::Equisolid:
+			return std::sin(theta * 0.5f);
+		case FisheyeLens::Stereographic:
+			return std::tan(theta * 0.5f);
+		case FisheyeLens::Orthographic:
+		default:
+			return std::sin(theta);
+		}
+	};
+	const float edgeRadius = imageRadius(maxTheta);
+	const float radiusScale = (edgeRadius > 0) ? 0.5f / edgeRadius : 0.0f;
+
+	// Lens projection of each vertex (u right, v down from the image centre, image circle of radius 0.5):
+	// same convention as the modeled sphere it replaces, texture calibration is applied on top (see writeFisheyeUVs())
+	std::vector<float> positions;
+	positions.reserve(vertexCount * 3);
+	fisheyeLensUVs.clear();
+	fisheyeLensUVs.reserve(vertexCount);
+	positions.push_back(0); positions.push_back(0); positions.push_back(-1);
+	fisheyeLensUVs.push_back(Ogre::Vector2::ZERO);
+	for (unsigned int i = 1; i <= rings; i++)
+	{
+		const float theta = maxTheta * i / rings;
+		const float r = imageRadius(theta) * radiusScale;
+		for (unsigned int j = 0; j < segments; j++)
+		{
+			const float phi = Ogre::Math::TWO_PI * j / segments;
+			positions.push_back(std::sin(theta) * std::cos(phi));
+			positions.push_back(std::sin(theta) * std::sin(phi));
+			positions.push_back(-std::cos(theta));
+			fisheyeLensUVs.push_back(Ogre::Vector2(r * std::cos(phi), -r * std::sin(phi)));
+		}
+	}
+
+	// Counter-clockwise as seen from the centre (material culls clockwise faces)
+	std::vector<Ogre::uint16> indices;
+	indices.reserve(3 * segments * (2 * rings - 1));
+	for (unsigned int j = 0; j < segments; j++)
+	{
+		const unsigned int next = (j + 1) % segments;
+		indices.push_back(0);
+		indices.push_back((Ogre::uint16)(1 + j));
+		indices.push_back((Ogre::uint16)(1 + next));
+		for (unsigned int i = 1; i < rings; i++)
+		{
+			const Ogre::uint16 inner = (Ogre::uint16)(1 + (i - 1) * segments + j);
+			const Ogre::uint16 innerNext = (Ogre::uint16)(1 + (i - 1) * segments + next);
+			const Ogre::uint16 outer = (Ogre::uint16)(inner + segments);
+			const Ogre::uint16 outerNext = (Ogre::uint16)(innerNext + segments);
+			indices.push_back(inner); indices.push_back(outer); indices.push_back(outerNext);
+			indices.push_back(inner); indices.push_back(outerNext); indices.push_back(innerNext);
+		}
+	}
+
+	Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().createManual(name, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+	Ogre::SubMesh* subMesh = mesh->createSubMesh();
+	subMesh->useSharedVertices = false;
+	subMesh->operationType = Ogre::RenderOperation::OT_TRIANGLE_LIST;
+
+	// source 0: positions (static), source 1: texture coordinates (rewritten on calibration changes)
+	subMesh->vertexData = new Ogre::VertexData();
+	subMesh->vertexData->vertexStart = 0;
+	subMesh->vertexData->vertexCount = vertexCount;
+	Ogre::VertexDeclaration* decl = subMesh->vertexData->vertexDeclaration;
+	decl->addElement(0, 0, Ogre::VET_FLOAT3, Ogre::VES_POSITION);
+	decl->addElement(1, 0, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES, 0);
+
+	Ogre::HardwareVertexBufferSharedPtr positionBuffer = Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
+		decl->getVertexSize(0), vertexCount, Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+	positionBuffer->writeData(0, positionBuffer->getSizeInBytes(), positions.data(), true);
+	subMesh->vertexData->vertexBufferBinding->setBinding(0, positionBuffer);
+
+	Ogre::HardwareVertexBufferSharedPtr uvBuffer = Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
+		decl->getVertexSize(1), vertexCount, Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY);
+	subMesh->vertexData->vertexBufferBinding->setBinding(1, uvBuffer);
+
+	Ogre::HardwareIndexBufferSharedPtr indexBuffer = Ogre::HardwareBufferManager::getSingleton().createIndexBuffer(
+		Ogre::HardwareIndexBuffer::IT_16BIT, indices.size(), Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+	indexBuffer->writeData(0, indexBuffer->getSizeInBytes(), indices.data(), true);
+	subMesh->indexData->indexBuffer = indexBuffer;
+	subMesh->indexData->indexStart = 0;
+	subMesh->indexData->indexCount = indices.size();
+
+	mesh->_setBounds(Ogre::AxisAlignedBox(-1, -1, -1, 1, 1, 1));
+	mesh->_setBoundingSphereRadius(1);
+	mesh->load();
+
+	writeFisheyeUVs(mesh, 1.0f, 1.0f, Ogre::Vector2(-0.5f, -0.5f));
+	return mesh;
+}
+
+void Scene::writeFisheyeUVs(Ogre::MeshPtr& mesh, const float aspectRatio, const float scale, const Ogre::Vector2& offset)
+{
+	// Texture calibration applied once per vertex (what the fragment shader used to do per pixel):
+	// scale (x also by aspect ratio) around the image centre, then move it to offset
+	Ogre::HardwareVertexBufferSharedPtr uvBuffer = mesh->getSubMesh(0)->vertexData->vertexBufferBinding->getBuffer(1);
+	const float scaleU = 1 / (aspectRatio * scale);
+	const float scaleV = 1 / scale;
+	float* uv = static_cast<float*>(uvBuffer->lock(Ogre::HardwareBuffer::HBL_DISCARD));
+	for (const Ogre::Vector2& lensUV : fisheyeLensUVs)
+	{
+		*uv++ = lensUV.x * scaleU - offset.x;
+		*uv++ = (lensUV.y - 1) * scaleV + 1 + offset.y;
+	}
+	uvBuffer->unlock();
+}
+
 void Scene::updateVideos()
 {
+	videoLayoutVersion++;
+
 	// Combine scaling factors (to use when needed)
 	float direct_scaling = videoClippingScaleFactor * videoFovScaleFactor;
 	float inverse_scaling = videoClippingScaleFactor * (1/videoFovScaleFactor);
 
-	// Pointer to pass arguments to shader
-	Ogre::GpuProgramParametersSharedPtr parametersFisheyeShader;
-
 	// Setup mVideoLeft SceneNode position/scale/orientation
 	// Position:For Pinhole model:
 	//			X-axis:	we assume real cameras distance (ICD) is the same as IPD, so X should be solidal to virtual cameras X value -> see setIPD()
@@ -801,15 +1084,8 @@ void Scene::updateVideos()
 			videoClippingScaleFactor,
 			videoClippingScaleFactor
 			);		
-		parametersFisheyeShader = mLeftCameraRenderMaterial->getTechnique(0)->getPass(0)->getFragmentProgramParameters();
-		parametersFisheyeShader->setNamedConstant("adjustTextureAspectRatio", videoLeftTextureCalibrationAspectRatio);
-		parametersFisheyeShader->setNamedConstant("adjustTextureScale", videoLeftTextureCalibrationScale);
-		parametersFisheyeShader->setNamedConstant("adjustTextureOffset", videoLeftTextureCalibrationOffset);
-		parametersFisheyeShader = mRightCameraRenderMaterial->getTechnique(0)->getPass(0)->getFragmentProgramParameters();
-		parametersFisheyeShader->setNamedConstant("adjustTextureAspectRatio", videoRightTextureCalibrationAspectRatio);
-		parametersFisheyeShader->setNamedConstant("adjustTextureScale", videoRightTextureCalibrationScale);
-		parametersFisheyeShader->setNamedConstant("adjustTextureOffset", videoRightTextureCalibrationOffset);
-		parametersFisheyeShader.setNull();
+		writeFisheyeUVs(mLeftFisheyeMesh, videoLeftTextureCalibrationAspectRatio, videoLeftTextureCalibrationScale, videoLeftTextureCalibrationOffset);
+		writeFisheyeUVs(mRightFisheyeMesh, videoRightTextureCalibrationAspectRatio, videoRightTextureCalibrationScale, videoRightTextureCalibrationOffset);
 		break;
 
 	default:
@@ -964,7 +1240,14 @@ void Scene::enableVideo()
 {
 	if (!videoIsEnabled)
 	{
-		if (mVideoLeft)
+		if (mVideoLeft && mStereoCuller)
+		{
+			// planes stay visible, per eye filtering is done by queue group (see cameraPreRenderScene())
+			mVideoLeft->setVisible(true, false);
+			mVideoRight->setVisible(true, false);
+			videoIsEnabled = true;
+		}
+		else if (mVideoLeft)
 		{
 			mCamLeft->addListener(this);
 			mCamRight->addListener(this);
@@ -982,8 +1265,11 @@ void Scene::disableVideo()
 	{
 		if (mVideoLeft)
 		{
-			mCamLeft->removeListener(this);
-			mCamRight->removeListener(this);
+			if (!mStereoCuller)
+			{
+				mCamLeft->removeListener(this);
+				mCamRight->removeListener(this);
+			}
 			mVideoLeft->setVisible(false, false);
 			mVideoRight->setVisible(false, false);
 			videoIsEnabled = false;
@@ -1027,8 +1313,44 @@ bool Scene::mouseReleased( const OIS::MouseEvent& e, OIS::MouseButtonID id )
 //////////////////////////////////////////////////////////////
 // Handle Virtual Camera Events:
 //////////////////////////////////////////////////////////////
+void Scene::enableStereoCulling(const float leftTan, const float rightTan, const float upTan, const float downTan)
+{
+	if (mStereoCuller) return;
+	mStereoCuller = new StereoCuller(mSceneMgr, mCamLeft, mCamRight, mHeadNode);
+	mStereoCuller->setFov(leftTan, rightTan, upTan, downTan);
+
+	// Video planes: each one in its own render queue group, so that the shared render queue can be filtered per eye
+	if (mVideoLeft)
+	{
+		for (unsigned short i = 0; i < mVideoLeft->numAttachedObjects(); i++) mVideoLeft->getAttachedObject(i)->setRenderQueueGroup(VideoLeftQueueGroup);
+		for (unsigned short i = 0; i < mVideoRight->numAttachedObjects(); i++) mVideoRight->getAttachedObject(i)->setRenderQueueGroup(VideoRightQueueGroup);
+		mVideoLeft->setVisible(videoIsEnabled, false);
+		mVideoRight->setVisible(videoIsEnabled, false);
+		if (!videoIsEnabled)		// otherwise already listening
+		{
+			mCamLeft->addListener(this);
+			mCamRight->addListener(this);
+		}
+	}
+	excludeVideoQueueGroups(nullptr);
+}
+
+// Render queue groups the eye must not render (nullptr: not an eye, no video at all)
+void Scene::excludeVideoQueueGroups(Ogre::Camera* cam)
+{
+	mSceneMgr->clearSpecialCaseRenderQueues();
+	if (cam != mCamLeft) mSceneMgr->addSpecialCaseRenderQueue(VideoLeftQueueGroup);
+	if (cam != mCamRight) mSceneMgr->addSpecialCaseRenderQueue(VideoRightQueueGroup);
+	mSceneMgr->setSpecialCaseRenderQueueMode(Ogre::SceneManager::SCRQM_EXCLUDE);
+}
+
 void Scene::cameraPreRenderScene(Ogre::Camera* cam)
 {
+	if (mStereoCuller)
+	{
+		excludeVideoQueueGroups(cam);
+		return;
+	}
 	if (cam == mCamLeft)
 	{
 		mVideoLeft->setVisible(true, false);
@@ -1050,10 +1372,12 @@ void Scene::cameraPostRenderScene(Ogre::Camera* cam)
 			//std::cout << "Camera milliseconds delay: " << camera_last_frame_display_delay.count() << " ms"<< std::endl;
 			camera_frame_updated = false;
 		}
-		mVideoLeft->setVisible(false, false);
+		if (!mStereoCuller) mVideoLeft->setVisible(false, false);
 	}
 	if (cam == mCamRight)
 	{
-		mVideoRight->setVisible(false, false);
+		if (!mStereoCuller) mVideoRight->setVisible(false, false);
 	}
+	// other cameras (i.e. god camera) never show video
+	if (mStereoCuller) excludeVideoQueueGroups(nullptr);
 }
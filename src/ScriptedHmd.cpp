@@ -0,0 +1,280 @@
+#include "ScriptedHmd.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+	// Oculus DK2 values, as reported by SDK 0.5
+	const ovrSizei dk2Resolution = { 1920, 1080 };
+	const float dk2PixelsPerTanAngle = 549.6f;
+	const float dk2UpDownTan = 1.3292f;
+	const float dk2InnerTan = 1.0586f;		// towards the nose
+	const float dk2OuterTan = 1.0924f;
+
+	// Generated distortion: barrel (radial polynomial on eye viewport NDC) with small chromatic spread
+	const unsigned int meshCells = 32;
+	const float barrelK1 = 0.12f;
+	const float barrelK2 = 0.04f;
+	const float chromaRed = 0.996f;
+	const float chromaBlue = 1.012f;
+
+	ovrQuatf toOvr(const Ogre::Quaternion& q) { ovrQuatf r = { q.x, q.y, q.z, q.w }; return r; }
+	ovrVector3f toOvr(const Ogre::Vector3& v) { ovrVector3f r = { v.x, v.y, v.z }; return r; }
+}
+
+ScriptedHmdDevice::ScriptedHmdDevice(const Settings& hmdSettings) : settings(hmdSettings)
+{
+	if (settings.profile == Trace) loadTrace(settings.traceFile);
+	if (settings.refreshRate <= 0) settings.refreshRate = 75.0;
+	startTime = ovr_GetTimeInSeconds();
+	nextFrameTime = startTime;
+	std::cout << "Scripted HMD enabled: no Oculus runtime is used, head motion is simulated." << std::endl;
+}
+
+void ScriptedHmdDevice::loadTrace(const std::string& fileName)
+{
+	std::ifstream file(fileName);
+	if (!file.is_open()) throw std::runtime_error("Scripted HMD: cannot open pose trace " + fileName);
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream values(line);
+		TraceSample sample;
+		if (!(values >> sample.time >> sample.orientation.w >> sample.orientation.x >> sample.orientation.y >> sample.orientation.z
+			>> sample.position.x >> sample.position.y >> sample.position.z))
+			continue;		// malformed line
+		sample.orientation.normalise();
+		if (!trace.empty() && sample.time <= trace.back().time) continue;		// times must increase
+		trace.push_back(sample);
+	}
+	if (trace.empty()) throw std::runtime_error("Scripted HMD: no valid pose in trace " + fileName);
+	std::cout << "Scripted HMD: " << trace.size() << " poses loaded from " << fileName << std::endl;
+}
+
+void ScriptedHmdDevice::evaluate(const double t, Ogre::Quaternion& orientation, Ogre::Vector3& position) const
+{
+	const double phase = 2.0 * Ogre::Math::PI * settings.frequencyHz * t;
+	position = Ogre::Vector3::ZERO;
+	switch (settings.profile)
+	{
+	case Yaw:
+		orientation.FromAngleAxis(Ogre::Degree(settings.amplitudeDeg * (float)std::sin(phase)), Ogre::Vector3::UNIT_Y);
+		break;
+	case Figure8:
+		orientation = Ogre::Quaternion(Ogre::Degree(settings.amplitudeDeg * (float)std::sin(phase)), Ogre::Vector3::UNIT_Y)
+			* Ogre::Quaternion(Ogre::Degree(0.5f * settings.amplitudeDeg * (float)std::sin(2.0 * phase)), Ogre::Vector3::UNIT_X);
+		break;
+	case Trace:
+	{
+		// looped: time wraps at the last sample
+		double duration = trace.back().time - trace.front().time;
+		double traceTime = trace.front().time + (duration > 0 ? std::fmod(std::max(t, 0.0), duration) : 0);
+		std::vector<TraceSample>::const_iterator next = std::upper_bound(trace.begin(), trace.end(), traceTime,
+			[](const double time, const TraceSample& sample) { return time < sample.time; });
+		if (next == trace.begin() || next == trace.end())
+		{
+			const TraceSample& sample = (next == trace.end()) ? trace.back() : trace.front();
+			orientation = sample.orientation;
+			position = sample.position;
+			break;
+		}
+		const TraceSample& previous = *(next - 1);
+		float blend = (float)((traceTime - previous.time) / (next->time - previous.time));
+		orientation = Ogre::Quaternion::Slerp(blend, previous.orientation, next->orientation, true);
+		position = previous.position + (next->position - previous.position) * blend;
+		break;
+	}
+	case Static:
+	default:
+		orientation = Ogre::Quaternion::IDENTITY;
+		break;
+	}
+}
+
+ovrSizei ScriptedHmdDevice::getResolution() const
+{
+	return dk2Resolution;
+}
+
+ovrFovPort ScriptedHmdDevice::getDefaultEyeFov(const int eye) const
+{
+	ovrFovPort fov;
+	fov.UpTan = dk2UpDownTan;
+	fov.DownTan = dk2UpDownTan;
+	fov.LeftTan = (eye == ovrEye_Left) ? dk2OuterTan : dk2InnerTan;
+	fov.RightTan = (eye == ovrEye_Left) ? dk2InnerTan : dk2OuterTan;
+	return fov;
+}
+
+ovrSizei ScriptedHmdDevice::getFovTextureSize(const int eye, const ovrFovPort& fov) const
+{
+	ovrSizei size;
+	size.w = (int)std::ceil((fov.LeftTan + fov.RightTan) * dk2PixelsPerTanAngle);
+	size.h = (int)std::ceil((fov.UpTan + fov.DownTan) * dk2PixelsPerTanAngle);
+	return size;
+}
+
+ovrEyeRenderDesc ScriptedHmdDevice::getRenderDesc(const int eye, const ovrFovPort& fov) const
+{
+	ovrEyeRenderDesc desc = {};
+	desc.Eye = (ovrEyeType)eye;
+	desc.Fov = fov;
+	desc.DistortedViewport.Pos.x = (eye == ovrEye_Left) ? 0 : dk2Resolution.w / 2;
+	desc.DistortedViewport.Pos.y = 0;
+	desc.DistortedViewport.Size.w = dk2Resolution.w / 2;
+	desc.DistortedViewport.Size.h = dk2Resolution.h;
+	desc.PixelsPerTanAngleAtCenter.x = dk2PixelsPerTanAngle;
+	desc.PixelsPerTanAngleAtCenter.y = dk2PixelsPerTanAngle;
+	desc.HmdToEyeViewOffset.x = (eye == ovrEye_Left) ? settings.ipd * 0.5f : -settings.ipd * 0.5f;
+	return desc;
+}
+
+void ScriptedHmdDevice::createDistortionMesh(const ovrEyeRenderDesc& renderDesc, const unsigned int distortionCaps, HmdDistortionMesh& out) const
+{
+	const ovrFovPort& fov = renderDesc.Fov;
+	const float scaleX = 2.0f / (fov.LeftTan + fov.RightTan);
+	const float scaleY = 2.0f / (fov.UpTan + fov.DownTan);
+	const bool vignette = (distortionCaps & ovrDistortionCap_Vignette) != 0;
+
+	out.vertices.clear();
+	out.indices.clear();
+	out.vertices.reserve((meshCells + 1) * (meshCells + 1));
+	out.indices.reserve(meshCells * meshCells * 6);
+
+	for (unsigned int row = 0; row <= meshCells; row++)
+	{
+		for (unsigned int column = 0; column <= meshCells; column++)
+		{
+			// NDC in the eye half of the screen
+			float u = -1.0f + 2.0f * column / meshCells;
+			float v = 1.0f - 2.0f * row / meshCells;
+
+			// undistorted tan angles for this screen point (y pointing down, as in the SDK)
+			float tanX = u / scaleX - (fov.LeftTan - fov.RightTan) * 0.5f;
+			float tanY = -v / scaleY - (fov.UpTan - fov.DownTan) * 0.5f;
+			float r2 = u * u + v * v;
+			float barrel = 1.0f + barrelK1 * r2 + barrelK2 * r2 * r2;
+
+			ovrDistortionVertex vertex = {};
+			vertex.ScreenPosNDC.x = (renderDesc.Eye == ovrEye_Left) ? (u - 1.0f) * 0.5f : (u + 1.0f) * 0.5f;
+			vertex.ScreenPosNDC.y = v;
+			vertex.TanEyeAnglesR.x = tanX * barrel * chromaRed;
+			vertex.TanEyeAnglesR.y = tanY * barrel * chromaRed;
+			vertex.TanEyeAnglesG.x = tanX * barrel;
+			vertex.TanEyeAnglesG.y = tanY * barrel;
+			vertex.TanEyeAnglesB.x = tanX * barrel * chromaBlue;
+			vertex.TanEyeAnglesB.y = tanY * barrel * chromaBlue;
+			float edge = std::max(std::fabs(u), std::fabs(v));
+			vertex.VignetteFactor = vignette ? Ogre::Math::Clamp((1.0f - edge) * 12.0f, 0.0f, 1.0f) : 1.0f;
+			vertex.TimeWarpFactor = (u + 1.0f) * 0.5f;
+			out.vertices.push_back(vertex);
+		}
+	}
+
+	for (unsigned int row = 0; row < meshCells; row++)
+	{
+		for (unsigned int column = 0; column < meshCells; column++)
+		{
+			unsigned short topLeft = (unsigned short)(row * (meshCells + 1) + column);
+			unsigned short bottomLeft = (unsigned short)(topLeft + meshCells + 1);
+			out.indices.push_back(topLeft);
+			out.indices.push_back(bottomLeft);
+			out.indices.push_back(topLeft + 1);
+			out.indices.push_back(topLeft + 1);
+			out.indices.push_back(bottomLeft);
+			out.indices.push_back(bottomLeft + 1);
+		}
+	}
+}
+
+ovrTrackingState ScriptedHmdDevice::getTrackingState(const double absTime)
+{
+	Ogre::Quaternion orientation;
+	Ogre::Vector3 position;
+	evaluate(absTime - startTime, orientation, position);
+	{
+		std::lock_guard<std::mutex> guard(recenterMutex);
+		orientation = recenter * orientation;
+	}
+
+	ovrTrackingState state = {};
+	state.HeadPose.ThePose.Orientation = toOvr(orientation);
+	state.HeadPose.ThePose.Position = toOvr(position);
+	state.HeadPose.TimeInSeconds = absTime;
+	state.StatusFlags = ovrStatus_OrientationTracked | ovrStatus_PositionTracked | ovrStatus_HmdConnected;
+	return state;
+}
+
+void ScriptedHmdDevice::getEyePoses(const unsigned int frameIndex, const ovrVector3f hmdToEyeViewOffset[2], ovrPosef outEyePoses[2], ovrTrackingState* outTrackingState)
+{
+	ovrTrackingState state = getTrackingState(ovr_GetTimeInSeconds());
+	const ovrPosef& head = state.HeadPose.ThePose;
+	Ogre::Quaternion orientation(head.Orientation.w, head.Orientation.x, head.Orientation.y, head.Orientation.z);
+	Ogre::Vector3 position(head.Position.x, head.Position.y, head.Position.z);
+	for (int eye = 0; eye < 2; eye++)
+	{
+		Ogre::Vector3 offset(hmdToEyeViewOffset[eye].x, hmdToEyeViewOffset[eye].y, hmdToEyeViewOffset[eye].z);
+		outEyePoses[eye].Orientation = head.Orientation;
+		outEyePoses[eye].Position = toOvr(position - orientation * offset);
+	}
+	if (outTrackingState) *outTrackingState = state;
+}
+
+void ScriptedHmdDevice::recenterPose()
+{
+	Ogre::Quaternion orientation;
+	Ogre::Vector3 position;
+	evaluate(ovr_GetTimeInSeconds() - startTime, orientation, position);
+	std::lock_guard<std::mutex> guard(recenterMutex);
+	recenter = Ogre::Quaternion(-orientation.getYaw(), Ogre::Vector3::UNIT_Y);
+}
+
+ovrFrameTiming ScriptedHmdDevice::beginFrameTiming(const unsigned int frameIndex)
+{
+	double now = ovr_GetTimeInSeconds();
+	ovrFrameTiming timing = {};
+	timing.ThisFrameSeconds = now;
+	if (settings.simulateVsync)
+	{
+		// next vblank on the refresh grid (a late frame waits for the following one, as a real display would)
+		double period = 1.0 / settings.refreshRate;
+		nextFrameTime = startTime + std::ceil((now - startTime) / period) * period;
+		timing.DeltaSeconds = (float)period;
+		timing.NextFrameSeconds = nextFrameTime;
+		timing.TimewarpPointSeconds = nextFrameTime - 0.003;		// leave time for the distortion pass
+		timing.ScanoutMidpointSeconds = nextFrameTime + 0.5 * period;
+	}
+	else
+	{
+		// never throttled: every deadline is now
+		timing.NextFrameSeconds = now;
+		timing.TimewarpPointSeconds = now;
+		timing.ScanoutMidpointSeconds = now;
+	}
+	timing.EyeScanoutSeconds[0] = timing.ScanoutMidpointSeconds;
+	timing.EyeScanoutSeconds[1] = timing.ScanoutMidpointSeconds;
+	return timing;
+}
+
+void ScriptedHmdDevice::waitTillTime(const double absTime)
+{
+	double remaining = absTime - ovr_GetTimeInSeconds();
+	if (remaining > 0) std::this_thread::sleep_for(std::chrono::duration< double >(remaining));
+}
+
+void ScriptedHmdDevice::getEyeTimewarpMatrices(const int eye, const ovrPosef& renderPose, ovrMatrix4f twmOut[2])
+{
+	for (int i = 0; i < 2; i++)
+	{
+		twmOut[i] = ovrMatrix4f();
+		for (int j = 0; j < 4; j++) twmOut[i].M[j][j] = 1.0f;
+	}
+}
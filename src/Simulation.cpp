@@ -0,0 +1,101 @@
+#include "Simulation.h"
+#include "Scene.h"
+#include "Trace.h"
+
+Simulation::Simulation(FrameCaptureHandler* const cameraLeft, FrameCaptureHandler* const cameraRight) : mCameraLeft(cameraLeft), mCameraRight(cameraRight)
+{
+	snapshot = std::make_shared<const SimulationSnapshot>();
+}
+
+Simulation::~Simulation()
+{
+	stop();
+}
+
+void Simulation::start(const double tickRate)
+{
+	if (isThreaded() || tickRate <= 0) return;
+	stopped = false;
+	simulationThread = std::thread(&Simulation::threadMain, this, tickRate);
+}
+
+void Simulation::stop()
+{
+	stopped = true;
+	if (simulationThread.joinable()) simulationThread.join();
+}
+
+void Simulation::threadMain(const double tickRate)
+{
+	TRACE_THREAD_NAME("Simulation");
+	const std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration< double >(1.0 / tickRate));
+	std::chrono::steady_clock::time_point nextTick_time = std::chrono::steady_clock::now();
+	while (!stopped)
+	{
+		tick();
+		// fixed tick: a late tick is not made up for, the next one is scheduled from now
+		nextTick_time += period;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (nextTick_time < now) nextTick_time = now;
+		std::this_thread::sleep_until(nextTick_time);
+	}
+}
+
+void Simulation::tick()
+{
+	TRACE_SCOPE("simulation tick");
+	std::chrono::steady_clock::time_point tickStart_time = std::chrono::steady_clock::now();
+	state.tick++;
+	state.time = ovr_GetTimeInSeconds();
+
+	// VIDEO: a new left frame makes a new pair with the latest right frame
+	if (mCameraRight) mCameraRight->get(nextFrameRight);
+	FrameCaptureData frameLeft;
+	if (mCameraLeft && mCameraLeft->get(frameLeft))
+	{
+		state.videoLeft = frameLeft;
+		state.videoRight = nextFrameRight;
+		state.videoId++;
+		if (stereoDepth) stereoDepth->submit(state.videoLeft.image.rgb, state.videoRight.image.rgb, state.videoLeft.image.roi & state.videoRight.image.roi);
+
+		// MARKERS: detected on the left video, anchors for the scene
+		if (!frameLeft.markers.empty())
+		{
+			state.markers.clear();
+			for (const ARCaptureData& marker : frameLeft.markers)
+			{
+				MarkerAnchor anchor;
+				anchor.position = Ogre::Vector3((float)marker.position[0], (float)marker.position[1], (float)marker.position[2]);
+				anchor.orientation = Ogre::Quaternion((float)marker.orientation[0], (float)marker.orientation[1], (float)marker.orientation[2], (float)marker.orientation[3]);
+				state.markers.push_back(anchor);
+			}
+			state.markersId++;
+
+			// the scene follows the last marker
+			state.videoToeIn = Scene::computeVideoToeInAngle(state.markers.back().position.z, state.videoToeInAngle);
+		}
+	}
+
+	// CONVERGENCE: the focus depth of the camera pair, when known, overrides the marker distance
+	// (clamped to the range the toe-in fit is known for: the correction saturates instead of freezing)
+	float focusDepth;
+	if (stereoDepth && stereoDepth->getFocusDepth(focusDepth))
+	{
+		state.focusDepth = focusDepth;
+		state.videoToeIn = Scene::computeVideoToeInAngle(Ogre::Math::Clamp(focusDepth, 0.285f, 1.73f), state.videoToeInAngle);
+	}
+	else state.focusDepth = 0;
+
+	std::shared_ptr<const SimulationSnapshot> published = std::make_shared<const SimulationSnapshot>(state);
+	{
+		std::lock_guard<std::mutex> guard(snapshotMutex);
+		snapshot = published;
+	}
+	tickTimes.add(std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - tickStart_time).count());
+}
+
+std::shared_ptr<const SimulationSnapshot> Simulation::getSnapshot() const
+{
+	std::lock_guard<std::mutex> guard(snapshotMutex);
+	return snapshot;
+}
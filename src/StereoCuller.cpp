@@ -0,0 +1,142 @@
+#include "StereoCuller.h"
+#include <algorithm>
+
+namespace
+{
+	// Collects the renderables of a queued collection (a renderable with a multi-pass material is visited once per pass)
+	class RenderableCollector : public Ogre::QueuedRenderableVisitor
+	{
+		public:
+			RenderableCollector(std::vector<Ogre::Renderable*>& out) : renderables(out) {}
+			virtual void visit(Ogre::RenderablePass* rp) { renderables.push_back(rp->renderable); }
+			virtual bool visit(const Ogre::Pass* p) { return true; }
+			virtual void visit(Ogre::Renderable* r) { renderables.push_back(r); }
+		private:
+			std::vector<Ogre::Renderable*>& renderables;
+	};
+}
+
+StereoCuller::StereoCuller(Ogre::SceneManager* sceneMgr, Ogre::Camera* camLeft, Ogre::Camera* camRight, Ogre::SceneNode* headNode) : mSceneMgr(sceneMgr), mCamLeft(camLeft), mCamRight(camRight)
+{
+	mCullingFrustum = new Ogre::Frustum("StereoCullingFrustum");
+	mCullingFrustum->setVisible(false);		// culling only, never rendered
+	mFrustumNode = headNode->createChildSceneNode("StereoCullingFrustumNode");
+	mFrustumNode->attachObject(mCullingFrustum);
+
+	mCamLeft->setCullingFrustum(mCullingFrustum);
+	mCamRight->setCullingFrustum(mCullingFrustum);
+	mCamLeft->addListener(this);
+	mCamRight->addListener(this);
+	mSceneMgr->addListener(this);
+	mSceneMgr->addRenderQueueListener(this);
+}
+
+StereoCuller::~StereoCuller()
+{
+	mSceneMgr->removeRenderQueueListener(this);
+	mSceneMgr->removeListener(this);
+	mCamLeft->removeListener(this);
+	mCamRight->removeListener(this);
+	mCamLeft->setCullingFrustum(nullptr);
+	mCamRight->setCullingFrustum(nullptr);
+	mSceneMgr->setFindVisibleObjects(true);
+
+	mFrustumNode->detachObject(mCullingFrustum);
+	delete mCullingFrustum;
+	mSceneMgr->destroySceneNode(mFrustumNode);
+}
+
+void StereoCuller::setFov(const float leftTan, const float rightTan, const float upTan, const float downTan)
+{
+	// small margin: the two eyes are posed at slightly different times (see Rift eye poses)
+	const float margin = 1.05f;
+	Ogre::Vector3 centre = (mCamLeft->getPosition() + mCamRight->getPosition()) * 0.5f;
+	float halfIPD = std::abs(mCamRight->getPosition().x - mCamLeft->getPosition().x) * 0.5f;
+
+	// apex moved back (+z, cameras look down -z) until the frustum sides pass outside both eyes
+	float back = halfIPD / std::min(leftTan, rightTan);
+	float nearClip = mCamLeft->getNearClipDistance();
+	mFrustumNode->setPosition(centre + Ogre::Vector3(0, 0, back));
+	mCullingFrustum->setNearClipDistance(nearClip);
+	mCullingFrustum->setFarClipDistance(std::max(mCamLeft->getFarClipDistance(), mCamRight->getFarClipDistance()) + back);
+	mCullingFrustum->setFrustumExtents(-leftTan * margin * nearClip, rightTan * margin * nearClip, upTan * margin * nearClip, -downTan * margin * nearClip);
+}
+
+void StereoCuller::cameraPreRenderScene(Ogre::Camera* cam)
+{
+	if (cachedFor && cachedFor != cam)
+	{
+		// second eye of the frame: no traversal, no culling
+		replaying = cam;
+		mSceneMgr->setFindVisibleObjects(false);
+	}
+	else
+	{
+		// first eye (or the same eye again, i.e. the other one was paused): fill the cache
+		cachedFor = cam;
+	}
+}
+
+void StereoCuller::cameraPostRenderScene(Ogre::Camera* cam)
+{
+	if (replaying == cam)
+	{
+		mSceneMgr->setFindVisibleObjects(true);
+		replaying = nullptr;
+		cachedFor = nullptr;
+	}
+}
+
+void StereoCuller::postFindVisibleObjects(Ogre::SceneManager* source, Ogre::SceneManager::IlluminationRenderStage irs, Ogre::Viewport* v)
+{
+	if (irs == Ogre::SceneManager::IRS_NONE && cachedFor && v->getCamera() == cachedFor)
+		cacheRenderQueue(source->getRenderQueue());
+}
+
+void StereoCuller::preRenderQueues()
+{
+	if (!replaying) return;
+	// without visible objects search the scene manager does not clear the queue either: it still holds what the
+	// last camera rendered queued (the first eye, or any other camera rendered in between), replaced by the cache
+	Ogre::RenderQueue* queue = mSceneMgr->getRenderQueue();
+	queue->clear();
+	for (const QueuedRenderable& queued : cache)
+		queue->addRenderable(queued.renderable, queued.groupId, queued.priority);
+}
+
+void StereoCuller::cacheRenderQueue(Ogre::RenderQueue* queue)
+{
+	cache.clear();
+	std::vector<Ogre::Renderable*> renderables;
+	RenderableCollector collector(renderables);
+
+	Ogre::RenderQueue::QueueGroupIterator groups = queue->_getQueueGroupIterator();
+	while (groups.hasMoreElements())
+	{
+		Ogre::uint8 groupId = groups.peekNextKey();
+		Ogre::RenderQueueGroup::PriorityMapIterator priorities = groups.getNext()->getIterator();
+		while (priorities.hasMoreElements())
+		{
+			Ogre::ushort priority = priorities.peekNextKey();
+			Ogre::RenderPriorityGroup* priorityGroup = priorities.getNext();
+
+			// every collection, each one walked in the organisation it is built for
+			renderables.clear();
+			priorityGroup->getSolidsBasic().acceptVisitor(&collector, Ogre::QueuedRenderableCollection::OM_PASS_GROUP);
+			priorityGroup->getSolidsDiffuseSpecular().acceptVisitor(&collector, Ogre::QueuedRenderableCollection::OM_PASS_GROUP);
+			priorityGroup->getSolidsDecal().acceptVisitor(&collector, Ogre::QueuedRenderableCollection::OM_PASS_GROUP);
+			priorityGroup->getSolidsNoShadowReceive().acceptVisitor(&collector, Ogre::QueuedRenderableCollection::OM_PASS_GROUP);
+			priorityGroup->getTransparentsUnsorted().acceptVisitor(&collector, Ogre::QueuedRenderableCollection::OM_PASS_GROUP);
+			priorityGroup->getTransparents().acceptVisitor(&collector, Ogre::QueuedRenderableCollection::OM_SORT_DESCENDING);
+
+			// addRenderable() queues all passes again: one entry per renderable
+			std::sort(renderables.begin(), renderables.end());
+			renderables.erase(std::unique(renderables.begin(), renderables.end()), renderables.end());
+			for (Ogre::Renderable* renderable : renderables)
+			{
+				QueuedRenderable queued = { renderable, groupId, priority };
+				cache.push_back(queued);
+			}
+		}
+	}
+}
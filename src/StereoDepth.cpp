@@ -0,0 +1,134 @@
+#include "StereoDepth.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "OVR.h"
+#include "Trace.h"
+
+StereoDepth::StereoDepth(const Settings& depthSettings) : settings(depthSettings)
+{
+	settings.disparities = std::max(16, (settings.disparities + 15) / 16 * 16);
+	settings.blockSize = std::max(5, settings.blockSize | 1);
+	if (settings.scale <= 0 || settings.scale > 1) settings.scale = 0.25;
+	if (settings.roiSize <= 0 || settings.roiSize > 1) settings.roiSize = 0.4;
+
+	// toed-in cameras: disparity is 0 at the convergence distance, negative beyond it
+	matcher.init(cv::StereoBM::BASIC_PRESET, settings.disparities, settings.blockSize);
+	matcher.state->minDisparity = settings.toeInDegrees > 0 ? -settings.disparities / 2 : 0;
+
+	matchingThread = std::thread(&StereoDepth::threadMain, this);
+}
+
+StereoDepth::~StereoDepth()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		stopRequested = true;
+	}
+	pairSubmitted.notify_one();
+	if (matchingThread.joinable()) matchingThread.join();
+}
+
+void StereoDepth::submit(const cv::Mat& left, const cv::Mat& right, const cv::Rect& valid)
+{
+	if (left.empty() || right.empty() || left.size() != right.size()) return;
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		// own copies: the images may be capture buffers written again by the next frame (i.e. toon filter output)
+		left.copyTo(pendingLeft);
+		right.copyTo(pendingRight);
+		pendingValid = valid;
+		pairPending = true;
+	}
+	pairSubmitted.notify_one();
+}
+
+bool StereoDepth::getFocusDepth(float& meters) const
+{
+	std::lock_guard<std::mutex> guard(mutex);
+	if (focusTime == 0 || ovr_GetTimeInSeconds() - focusTime > settings.staleSeconds) return false;
+	meters = (float)focusDepth;
+	return true;
+}
+
+void StereoDepth::threadMain()
+{
+	TRACE_THREAD_NAME("Stereo depth");
+	while (true)
+	{
+		cv::Rect valid;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			pairSubmitted.wait(lock, [this]() { return stopRequested || pairPending; });
+			if (stopRequested) return;
+			// the last matched pair becomes the buffers of the next submit (no allocation once sizes are stable)
+			cv::swap(matchLeft, pendingLeft);
+			cv::swap(matchRight, pendingRight);
+			valid = pendingValid;
+			pairPending = false;
+		}
+
+		std::chrono::steady_clock::time_point matchStart_time = std::chrono::steady_clock::now();
+		double depth;
+		bool matched = match(matchLeft, matchRight, valid, depth);
+		matchTimes.add(std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - matchStart_time).count());
+		if (!matched) continue;
+
+		double now = ovr_GetTimeInSeconds();
+		std::lock_guard<std::mutex> guard(mutex);
+		bool fresh = focusTime == 0 || now - focusTime > settings.staleSeconds;
+		double alpha = (fresh || settings.smoothingSeconds <= 0) ? 1.0 : 1.0 - std::exp(-(now - focusTime) / settings.smoothingSeconds);
+		focusDepth += (depth - focusDepth) * alpha;
+		focusTime = now;
+	}
+}
+
+bool StereoDepth::match(const cv::Mat& left, const cv::Mat& right, const cv::Rect& valid, double& depth)
+{
+	TRACE_SCOPE("stereo match");
+
+	// ROI around the centre, widened on the left by the search range (no match is possible there)
+	int roiWidth = (int)(left.cols * settings.roiSize);
+	int roiHeight = (int)(left.rows * settings.roiSize);
+	int searchMargin = (int)std::ceil((settings.disparities + std::max(0, -matcher.state->minDisparity)) / settings.scale);
+	cv::Rect roi(std::max(0, (left.cols - roiWidth) / 2 - searchMargin), (left.rows - roiHeight) / 2, 0, roiHeight);
+	roi.width = std::min(left.cols - roi.x, roiWidth + ((left.cols - roiWidth) / 2 - roi.x));
+	if (valid.area() > 0)
+	{
+		// undefined pixels are left out (the ROI proper loses what is cut on its right)
+		cv::Rect clamped = roi & valid;
+		roiWidth -= (roi.x + roi.width) - (clamped.x + clamped.width);
+		roi = clamped;
+		if (roiWidth <= 0 || roi.height <= 0) return false;
+	}
+
+	cv::cvtColor(left(roi), greyLeft, CV_BGR2GRAY);
+	cv::cvtColor(right(roi), greyRight, CV_BGR2GRAY);
+	cv::resize(greyLeft, smallLeft, cv::Size(), settings.scale, settings.scale, cv::INTER_AREA);
+	cv::resize(greyRight, smallRight, cv::Size(), settings.scale, settings.scale, cv::INTER_AREA);
+	if (smallLeft.rows < settings.blockSize || smallLeft.cols <= settings.disparities + settings.blockSize) return false;
+	matcher(smallLeft, smallRight, disparity, CV_16S);
+
+	// median of the matched disparities of the ROI proper (fixed point, 4 fractional bits)
+	const short unmatched = (short)((matcher.state->minDisparity - 1) * 16);
+	int firstColumn = disparity.cols - (int)(roiWidth * settings.scale);
+	std::vector<short> matched;
+	matched.reserve(disparity.rows * (disparity.cols - firstColumn));
+	for (int y = 0; y < disparity.rows; y++)
+	{
+		const short* row = disparity.ptr<short>(y);
+		for (int x = std::max(0, firstColumn); x < disparity.cols; x++)
+			if (row[x] > unmatched) matched.push_back(row[x]);
+	}
+	if (matched.empty() || matched.size() < settings.minValidFraction * disparity.rows * (disparity.cols - firstColumn)) return false;
+	std::nth_element(matched.begin(), matched.begin() + matched.size() / 2, matched.end());
+	double medianDisparity = matched[matched.size() / 2] / 16.0 / settings.scale;	// pixels, camera resolution
+
+	// disparity = f * B * (1/Z - 1/Zc), Zc convergence distance of the toed-in cameras (infinite if parallel)
+	double focal = settings.calibrationWidth > 0 ? settings.focalPixels * left.cols / settings.calibrationWidth : settings.focalPixels;
+	double inverseConvergence = settings.toeInDegrees > 0 ? std::tan(settings.toeInDegrees * CV_PI / 180.0) / (settings.baseline * 0.5) : 0;
+	double inverseDepth = medianDisparity / (focal * settings.baseline) + inverseConvergence;
+	if (focal <= 0 || inverseDepth <= 0) return false;		// beyond infinity: mismatch
+	depth = 1.0 / inverseDepth;
+	return true;
+}
@@ -0,0 +1,81 @@
+#include "StereoRectification.h"
+#include <stdexcept>
+
+namespace
+{
+	std::shared_ptr<const RemapTables> createTables(const cv::Mat& cameraMatrix, const cv::Mat& distortion, const cv::Mat& rectification, const cv::Mat& newCameraMatrix, const cv::Size& size)
+	{
+		std::shared_ptr<RemapTables> tables = std::make_shared<RemapTables>();
+		tables->size = size;
+		tables->cameraMatrix = cameraMatrix;
+		tables->distortion = distortion;
+		tables->rectification = rectification;
+		tables->newCameraMatrix = newCameraMatrix;
+		cv::initUndistortRectifyMap(cameraMatrix, distortion, rectification, newCameraMatrix, size, CV_16SC2, tables->map1, tables->map2);
+		return tables;
+	}
+
+	// focal lengths and principal point follow the image size (rows 0 and 1 of a 3x3 or 3x4 matrix)
+	cv::Mat scaleIntrinsics(const cv::Mat& matrix, const double scaleX, const double scaleY)
+	{
+		cv::Mat scaled = matrix.clone();
+		scaled.row(0) *= scaleX;
+		scaled.row(1) *= scaleY;
+		return scaled;
+	}
+}
+
+std::shared_ptr<StereoRectification> StereoRectification::load(const std::string& fileName, const aruco::CameraParameters& left, const aruco::CameraParameters& right)
+{
+	if (fileName.empty() || !left.isValid() || !right.isValid()) return nullptr;
+	cv::FileStorage file(fileName, cv::FileStorage::READ);
+	if (!file.isOpened()) return nullptr;
+
+	cv::Mat R, T;
+	file["R"] >> R;
+	file["T"] >> T;
+	if (R.rows != 3 || R.cols != 3 || T.total() != 3) throw std::runtime_error("Stereo calibration " + fileName + ": R (3x3) and T (3x1) expected");
+	if (left.CamSize != right.CamSize) throw std::runtime_error("Stereo calibration " + fileName + ": the two cameras are calibrated at different image sizes");
+	R.convertTo(R, CV_64F);
+	T.convertTo(T, CV_64F);
+
+	cv::Mat K[2], D[2];
+	const aruco::CameraParameters* cameras[2] = { &left, &right };
+	for (int eye = 0; eye < 2; eye++)
+	{
+		cameras[eye]->CameraMatrix.convertTo(K[eye], CV_64F);
+		cameras[eye]->Distorsion.convertTo(D[eye], CV_64F);
+	}
+
+	// alpha 0: only valid pixels are kept (no black borders), same focal length for both rectified images
+	cv::Mat R1, R2, P1, P2, Q;
+	cv::stereoRectify(K[0], D[0], K[1], D[1], left.CamSize, R, T, R1, R2, P1, P2, Q, cv::CALIB_ZERO_DISPARITY, 0);
+
+	std::shared_ptr<StereoRectification> rectification(new StereoRectification());
+	cv::Mat rotations[2] = { R1, R2 };
+	cv::Mat projections[2] = { P1, P2 };
+	for (int eye = 0; eye < 2; eye++)
+	{
+		rectification->tables[eye] = createTables(K[eye], D[eye], rotations[eye], projections[eye], cameras[eye]->CamSize);
+
+		aruco::CameraParameters& rectified = rectification->rectified[eye];
+		rectified = *cameras[eye];
+		projections[eye](cv::Rect(0, 0, 3, 3)).convertTo(rectified.CameraMatrix, CV_32F);
+		rectified.Distorsion = cv::Mat::zeros(4, 1, CV_32F);
+	}
+	rectification->baseline = cv::norm(T);
+	return rectification;
+}
+
+std::shared_ptr<const RemapTables> createUndistortTables(const aruco::CameraParameters& camera)
+{
+	return createTables(camera.CameraMatrix, camera.Distorsion, cv::Mat(), camera.CameraMatrix, camera.CamSize);
+}
+
+std::shared_ptr<const RemapTables> resizeRemapTables(const RemapTables& tables, const cv::Size& size)
+{
+	double scaleX = (double)size.width / tables.size.width;
+	double scaleY = (double)size.height / tables.size.height;
+	return createTables(scaleIntrinsics(tables.cameraMatrix, scaleX, scaleY), tables.distortion, tables.rectification,
+		scaleIntrinsics(tables.newCameraMatrix, scaleX, scaleY), size);
+}
@@ -0,0 +1,234 @@
+#include "SyntheticSource.h"
+#include <arucofidmarkers.h>
+#include <cmath>
+#include <thread>
+
+namespace
+{
+	cv::Mat makeCameraMatrix(const SyntheticSource::Settings& settings)
+	{
+		float fx = (float)((settings.width * 0.5) / std::tan(settings.hfovDeg * CV_PI / 360.0));
+		cv::Mat K = cv::Mat::eye(3, 3, CV_32F);
+		K.at<float>(0, 0) = fx;
+		K.at<float>(1, 1) = fx;		// square pixels
+		K.at<float>(0, 2) = settings.width * 0.5f;
+		K.at<float>(1, 2) = settings.height * 0.5f;
+		return K;
+	}
+}
+
+bool SyntheticSource::open()
+{
+	if (settings.width <= 0 || settings.height <= 0 || settings.fps <= 0)
+	{
+		std::cout << "Synthetic source " << settings.name << ": invalid resolution or frame rate." << std::endl;
+		return false;
+	}
+	if (settings.pixelType != CV_8UC3 && settings.pixelType != CV_8UC4 && settings.pixelType != CV_8UC1)
+	{
+		std::cout << "Synthetic source " << settings.name << ": unsupported pixel type." << std::endl;
+		return false;
+	}
+
+	cameraMatrix = makeCameraMatrix(settings);
+
+	// marker bitmaps (with a white quiet zone of half a marker cell around, needed by the detector)
+	markerImages.clear();
+	for (const Marker& marker : settings.markers)
+	{
+		cv::Mat bitmap, padded, bgr;
+		try
+		{
+			bitmap = aruco::FiducidalMarkers::createMarkerImage(marker.id, 100);
+		}
+		catch (cv::Exception& e)
+		{
+			std::cout << "Synthetic source " << settings.name << ": invalid marker id " << marker.id << std::endl;
+			return false;
+		}
+		cv::copyMakeBorder(bitmap, padded, 25, 25, 25, 25, cv::BORDER_CONSTANT, cv::Scalar(255));
+		cv::cvtColor(padded, bgr, CV_GRAY2BGR);
+		markerImages.push_back(bgr);
+	}
+
+	random.seed(0);		// same jitter sequence every run (comparable benchmarks)
+	frameCount = 0;
+	start_time = std::chrono::steady_clock::now();
+	nextFrame_time = start_time;
+	opened = true;
+	return true;
+}
+
+bool SyntheticSource::grab()
+{
+	if (!opened) return false;
+
+	// deliver frames on schedule, like a device would (a late caller gets the latest frame, skipped ones are lost)
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::chrono::duration< double > period(1.0 / settings.fps);
+	if (nextFrame_time > now)
+		std::this_thread::sleep_until(nextFrame_time);
+	else if (now - nextFrame_time > period)
+		nextFrame_time = now;
+	grabbedTime = std::chrono::duration< double >(nextFrame_time - start_time).count();
+	nextFrame_time += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+
+	if (settings.jitterMs > 0)
+	{
+		std::uniform_real_distribution<double> jitter(0.0, settings.jitterMs);
+		std::this_thread::sleep_for(std::chrono::duration< double, std::milli >(jitter(random)));
+	}
+
+	frameCount++;
+	return true;
+}
+
+bool SyntheticSource::retrieve(cv::Mat& out)
+{
+	if (!opened || frameCount == 0) return false;
+
+	// BGR is rendered straight into out, other formats into the render buffer then converted into out
+	// (either one reallocated only if needed)
+	cv::Mat& image = (settings.pixelType == CV_8UC3) ? out : rendered;
+	image.create(settings.height, settings.width, CV_8UC3);
+	renderPattern(image, grabbedTime);
+	for (unsigned int i = 0; i < settings.markers.size(); i++)
+		renderMarker(image, settings.markers[i], grabbedTime);
+
+	if (settings.drawFrameCounter)
+	{
+		std::string counter = "#" + std::to_string(frameCount);
+		cv::rectangle(image, cv::Rect(0, 0, 16 + 18 * (int)counter.size(), 44), cv::Scalar(0, 0, 0), CV_FILLED);
+		cv::putText(image, counter, cv::Point(8, 32), cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(255, 255, 255), 2);
+	}
+
+	switch (settings.pixelType)
+	{
+	case CV_8UC4:
+		cv::cvtColor(image, out, CV_BGR2BGRA);
+		break;
+	case CV_8UC1:
+		cv::cvtColor(image, out, CV_BGR2GRAY);
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+double SyntheticSource::get(const int propId) const
+{
+	switch (propId)
+	{
+	case CV_CAP_PROP_FRAME_WIDTH:	return settings.width;
+	case CV_CAP_PROP_FRAME_HEIGHT:	return settings.height;
+	case CV_CAP_PROP_FPS:			return settings.fps;
+	case CV_CAP_PROP_POS_FRAMES:	return (double)frameCount;
+	default:						return -1;		// as cv::VideoCapture does for unsupported properties (i.e. POS_MSEC)
+	}
+}
+
+bool SyntheticSource::getCameraParameters(aruco::CameraParameters& out) const
+{
+	out = aruco::CameraParameters(makeCameraMatrix(settings), cv::Mat::zeros(4, 1, CV_32F), cv::Size(settings.width, settings.height));
+	return true;
+}
+
+CaptureSource::Capabilities SyntheticSource::getCapabilities() const
+{
+	Capabilities capabilities;
+	capabilities.selfPaced = true;		// grab() waits for the next frame on schedule
+	capabilities.liveCapture = true;	// generated "now": the head pose at grab time is the one to use
+	return capabilities;
+}
+
+void SyntheticSource::renderPattern(cv::Mat& image, const double t) const
+{
+	const int width = image.cols;
+	const int height = image.rows;
+	const int offset = (int)(t * settings.patternSpeed);
+
+	switch (settings.pattern)
+	{
+	case ColourBars:
+	{
+		static const cv::Scalar colours[8] = {
+			cv::Scalar(255, 255, 255), cv::Scalar(0, 255, 255), cv::Scalar(255, 255, 0), cv::Scalar(0, 255, 0),
+			cv::Scalar(255, 0, 255), cv::Scalar(0, 0, 255), cv::Scalar(255, 0, 0), cv::Scalar(0, 0, 0) };
+		int barWidth = std::max(1, width / 8);
+		int shift = offset % (8 * barWidth);
+		for (int i = -8; i < 8; i++)
+		{
+			int x = i * barWidth + shift;
+			if (x + barWidth <= 0 || x >= width) continue;
+			cv::rectangle(image, cv::Rect(x, 0, barWidth, height), colours[(i + 8) % 8], CV_FILLED);
+		}
+		break;
+	}
+	case Checkerboard:
+	{
+		image.setTo(cv::Scalar(40, 40, 40));
+		int square = std::max(1, height / 9);
+		int shiftX = offset % (2 * square);
+		int shiftY = (offset / 2) % (2 * square);
+		for (int row = -2; row * square < height + 2 * square; row++)
+		{
+			for (int column = -2; column * square < width + 2 * square; column++)
+			{
+				if ((row + column) & 1) continue;
+				cv::rectangle(image, cv::Rect(column * square + shiftX, row * square + shiftY, square, square), cv::Scalar(215, 215, 215), CV_FILLED);
+			}
+		}
+		break;
+	}
+	case Gradient:
+	default:
+	{
+		// one row computed, repeated over the image (blue changes with rows)
+		cv::Mat row(1, width, CV_8UC3);
+		for (int x = 0; x < width; x++)
+			row.at<cv::Vec3b>(0, x) = cv::Vec3b(0, (unsigned char)((x + offset) & 0xFF), (unsigned char)((x * 2 + offset) & 0xFF));
+		for (int y = 0; y < height; y++)
+		{
+			cv::Mat destination = image.row(y);
+			cv::add(row, cv::Scalar((y * 255) / std::max(1, height - 1), 0, 0), destination);
+		}
+		break;
+	}
+	}
+}
+
+void SyntheticSource::renderMarker(cv::Mat& image, const Marker& marker, const double t) const
+{
+	size_t index = &marker - &settings.markers[0];
+	if (index >= markerImages.size()) return;
+	const cv::Mat& bitmap = markerImages[index];
+
+	// scripted pose
+	double phase = std::sin(2.0 * CV_PI * marker.frequencyHz * t);
+	cv::Mat tvec = (cv::Mat_<double>(3, 1) <<
+		marker.position.x + marker.amplitude.x * phase,
+		marker.position.y + marker.amplitude.y * phase,
+		marker.position.z + marker.amplitude.z * phase);
+	cv::Mat rvec = (cv::Mat_<double>(3, 1) << 0.0, marker.yawAmplitudeDeg * phase * CV_PI / 180.0, 0.0);
+	if (tvec.at<double>(2) <= 0.01) return;		// behind or too close to the lens
+
+	// padded bitmap corners in marker reference (marker is half of its padded image plus one quarter each side)
+	float half = marker.size * 1.5f * 0.5f;
+	std::vector<cv::Point3f> objectCorners;
+	objectCorners.push_back(cv::Point3f(-half, -half, 0));
+	objectCorners.push_back(cv::Point3f(half, -half, 0));
+	objectCorners.push_back(cv::Point3f(half, half, 0));
+	objectCorners.push_back(cv::Point3f(-half, half, 0));
+	std::vector<cv::Point2f> imageCorners;
+	cv::projectPoints(objectCorners, rvec, tvec, cameraMatrix, cv::Mat(), imageCorners);
+
+	std::vector<cv::Point2f> bitmapCorners;
+	bitmapCorners.push_back(cv::Point2f(0, 0));
+	bitmapCorners.push_back(cv::Point2f((float)bitmap.cols, 0));
+	bitmapCorners.push_back(cv::Point2f((float)bitmap.cols, (float)bitmap.rows));
+	bitmapCorners.push_back(cv::Point2f(0, (float)bitmap.rows));
+
+	cv::Mat homography = cv::getPerspectiveTransform(bitmapCorners, imageCorners);
+	cv::warpPerspective(bitmap, image, homography, image.size(), cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+}
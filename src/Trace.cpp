@@ -0,0 +1,164 @@
+#include "Trace.h"
+
+#ifdef OGREOCULUSAPP_TRACING
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+namespace Trace
+{
+	namespace
+	{
+		struct Event
+		{
+			const char* name;
+			double begin;
+			double end;
+			unsigned long long id;
+		};
+
+		// Single producer (owner thread) ring. The exporter reads it concurrently and drops
+		// whatever may have been overwritten while it was copying.
+		struct ThreadRing
+		{
+			static const unsigned long long Capacity = 1 << 14;		// power of two (index mask)
+			Event events[Capacity];
+			std::atomic<unsigned long long> written{ 0 };
+			unsigned int threadId = 0;			// tid in the exported trace
+			std::string threadName;				// guarded by registryMutex
+			bool retired = false;				// owner thread has exited: ring can be reused (guarded by registryMutex)
+		};
+
+		std::mutex registryMutex;				// only taken on thread registration/exit and on export
+		std::vector<ThreadRing*> registry;
+		unsigned int nextThreadId = 1;
+
+		// Returns the ring to its registry when the owner thread exits (capture threads come and go)
+		struct RingOwner
+		{
+			ThreadRing* ring = nullptr;
+			~RingOwner()
+			{
+				if (!ring) return;
+				std::lock_guard<std::mutex> guard(registryMutex);
+				ring->retired = true;
+			}
+		};
+
+		thread_local RingOwner localOwner;
+
+		ThreadRing* acquireRing()
+		{
+			std::lock_guard<std::mutex> guard(registryMutex);
+			ThreadRing* ring = nullptr;
+			// reuse a ring left by an exited thread (its history is lost), otherwise allocate a new one
+			for (ThreadRing* candidate : registry)
+			{
+				if (candidate->retired) { ring = candidate; break; }
+			}
+			if (!ring)
+			{
+				ring = new ThreadRing();
+				registry.push_back(ring);
+			}
+			ring->written = 0;
+			ring->retired = false;
+			ring->threadId = nextThreadId++;
+			ring->threadName.clear();
+			return ring;
+		}
+
+		inline ThreadRing* localRing()
+		{
+			if (!localOwner.ring) localOwner.ring = acquireRing();
+			return localOwner.ring;
+		}
+
+		void writeJsonString(std::ostream& out, const std::string& text)
+		{
+			out << '"';
+			for (char c : text)
+			{
+				if (c == '"' || c == '\\') out << '\\' << c;
+				else if ((unsigned char)c < 0x20) out << ' ';
+				else out << c;
+			}
+			out << '"';
+		}
+	}
+
+	double now()
+	{
+		static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+		return std::chrono::duration< double, std::micro >(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	void record(const char* name, const double beginUs, const double endUs, const unsigned long long id)
+	{
+		ThreadRing* ring = localRing();
+		unsigned long long index = ring->written.load(std::memory_order_relaxed);
+		Event& e = ring->events[index & (ThreadRing::Capacity - 1)];
+		e.name = name;
+		e.begin = beginUs;
+		e.end = endUs;
+		e.id = id;
+		ring->written.store(index + 1, std::memory_order_release);	// publish the event to the exporter
+	}
+
+	void setThreadName(const std::string& name)
+	{
+		ThreadRing* ring = localRing();
+		std::lock_guard<std::mutex> guard(registryMutex);
+		ring->threadName = name;
+	}
+
+	bool exportChromeJson(const std::string& fileName)
+	{
+		std::ofstream out(fileName.c_str());
+		if (!out) return false;
+
+		std::lock_guard<std::mutex> guard(registryMutex);
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+		out << std::fixed << std::setprecision(3);
+		bool first = true;
+		std::vector<Event> snapshot;
+		for (ThreadRing* ring : registry)
+		{
+			if (!ring->threadName.empty())
+			{
+				out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->threadId << ",\"args\":{\"name\":";
+				writeJsonString(out, ring->threadName);
+				out << "}}";
+				first = false;
+			}
+
+			// copy the valid window, then drop what the owner may have overwritten meanwhile
+			unsigned long long end = ring->written.load(std::memory_order_acquire);
+			unsigned long long begin = end > ThreadRing::Capacity ? end - ThreadRing::Capacity : 0;
+			snapshot.clear();
+			for (unsigned long long i = begin; i < end; i++)
+				snapshot.push_back(ring->events[i & (ThreadRing::Capacity - 1)]);
+			unsigned long long after = ring->written.load(std::memory_order_acquire);
+			unsigned long long firstValid = after + 1 > ThreadRing::Capacity ? after + 1 - ThreadRing::Capacity : 0;
+
+			for (unsigned long long i = begin; i < end; i++)
+			{
+				if (i < firstValid) continue;
+				const Event& e = snapshot[i - begin];
+				out << (first ? "" : ",\n") << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->threadId
+					<< ",\"ts\":" << e.begin << ",\"dur\":" << (e.end - e.begin);
+				if (e.id) out << ",\"args\":{\"frame\":" << e.id << "}";
+				out << "}";
+				first = false;
+			}
+		}
+		out << std::endl << "]}" << std::endl;
+		return out.good();
+	}
+}
+
+#endif
@@ -41,12 +41,45 @@
 			{
 				DEBUG_WINDOW = false;
 			}
+			// This flag stamps camera frames and measures video latency from the rendered eye image
+			if( arg == "--latency-probe" )
+			{
+				LATENCY_PROBE = true;
+			}
+			// This flag replaces camera devices with generated video (benchmarks and testing without cameras)
+			if( arg == "--synthetic" )
+			{
+				SYNTHETIC_SOURCE = true;
+			}
+			// This flag replaces the Rift with a scripted headset (no Oculus runtime needed, i.e. headless performance tests)
+			if( arg == "--scripted-hmd" )
+			{
+				SCRIPTED_HMD = true;
+			}
+			// This flag makes cameras drop out and hang on a schedule (exercises failure detection and reconnection)
+			if( arg == "--fault-injection" )
+			{
+				FAULT_INJECTION = true;
+			}
+			// This flag renders offscreen a fixed number of frames (scripted HMD, generated video), writes a report and exits
+			if( arg == "--benchmark" )
+			{
+				BENCHMARK = true;
+				SCRIPTED_HMD = true;
+				SYNTHETIC_SOURCE = true;
+				DEBUG_WINDOW = false;
+			}
 			if( arg == "--help" || arg == "-h" )
 			{
 				std::cout << "Available Commands:" << std::endl
 					<< "\t--rotate-view\tChanges the orientation of the main render window. Useful when your computer can't rotate the screen." << std::endl
 					<< "\t--no-rift\tFor debugging: disable the Oculus Rift." << std::endl
 					<< "\t--no-debug\tDisables the debug window." << std::endl
+					<< "\t--latency-probe\tStamps camera frames and reports grab-to-texture/grab-to-present latency (pinhole video)." << std::endl
+					<< "\t--synthetic\tUses generated video (patterns, frame counter, moving ArUco markers) instead of cameras." << std::endl
+					<< "\t--scripted-hmd\tSimulates the headset (poses from [ScriptedHmd] profile or trace), no Oculus runtime needed." << std::endl
+					<< "\t--fault-injection\tCameras drop out and hang as set in [FaultInjection], to exercise reconnection (stats on exit)." << std::endl
+					<< "\t--benchmark\tRenders [Benchmark] Frames offscreen with --scripted-hmd and --synthetic, then writes a JSON report and exits." << std::endl
 					<< "\t--help,-h\tShow this help message." << std::endl;
 				exit(0);	// show help and then close app.
 			}